@@ -0,0 +1,94 @@
+#ifndef SERVER_ALLOCATION_COUNTER_H
+#define SERVER_ALLOCATION_COUNTER_H
+#include <atomic>
+#include <cinttypes>
+#include <cstdlib>
+#include <new>
+
+/** Counts every call to the global operator new, for finding allocations on hot paths
+ *
+ * The count is always declared, but only moves when SH_COUNT_ALLOCATIONS is defined, which replaces the
+ * global allocation functions. Replacements can only be defined once in a program, so include this from
+ * exactly one translation unit: main.cpp in the server, or the benchmark that checks the count.
+ */
+namespace allocations {
+	inline std::atomic<uint64_t> count{0};
+
+	inline uint64_t total() {
+		return count.load(std::memory_order_relaxed);
+	}
+
+	inline constexpr bool counting() {
+#ifdef SH_COUNT_ALLOCATIONS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	namespace detail {
+		inline void *allocate(size_t size, size_t alignment) {
+			count.fetch_add(1, std::memory_order_relaxed);
+			size = size ? size : 1;
+			void *p = alignment > alignof(std::max_align_t)
+					? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+					: std::malloc(size);
+			if (!p) {
+				throw std::bad_alloc();
+			}
+			return p;
+		}
+	}
+}
+
+#ifdef SH_COUNT_ALLOCATIONS
+void *operator new(size_t size) {
+	return allocations::detail::allocate(size, 0);
+}
+
+void *operator new[](size_t size) {
+	return allocations::detail::allocate(size, 0);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+	return allocations::detail::allocate(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+	return allocations::detail::allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
+#endif
+
+#endif //SERVER_ALLOCATION_COUNTER_H
@@ -0,0 +1,159 @@
+/** Heap allocations on the paths every game takes, which fails if any appear where there should be none
+ *
+ * usage: allocationsBench [games]
+ *
+ * Games go through the same calls the WebSocket handlers make: a slot from the SlotMap, UserData
+ * constructed in place, addClient, a name, ready, random legal moves until the game ends, and then every
+ * client closing. One seat's socket refuses its first frames each game, so the backpressure queue is used
+ * too, and every other seat speaks protocol version 2. The first games warm up the slot map, the lobby index and the slabs, and after that:
+ * - a message allocates nothing
+ * - joining, leaving and the slot itself stay within JOIN_BUDGET allocations per player
+ *
+ * Built with SH_COUNT_ALLOCATIONS, and run by ctest.
+ */
+#include <algorithm>
+#include <random>
+#include <fmt/core.h>
+#include "../allocationCounter.h"
+#include "../bot.h"
+#include "../slotMap.h"
+
+namespace {
+	constexpr int WARMUP_GAMES = 4;
+	constexpr uint64_t MESSAGE_BUDGET = 0;
+	constexpr uint64_t JOIN_BUDGET = 0;
+	// frames refused by seat 0 at the start of each game
+	constexpr int REFUSED_FRAMES = 40;
+
+	struct alignas(8) ThrottledSocket {
+		UserData<ThrottledSocket> data;
+		int refuse = 0;
+
+		void *getUserData() {
+			return &data;
+		}
+
+		bool send(std::string_view, uWS::OpCode, bool) {
+			if (refuse > 0) {
+				refuse--;
+				return false;
+			}
+			return true;
+		}
+
+		template <typename F>
+		void cork(F &&f) {
+			f();
+		}
+
+		void end(int) {
+		}
+	};
+
+	struct Counts {
+		uint64_t joins = 0;
+		uint64_t joinAllocations = 0;
+		uint64_t maxJoinAllocations = 0;
+		uint64_t messages = 0;
+		uint64_t messageAllocations = 0;
+		uint64_t maxMessageAllocations = 0;
+	};
+
+	void play(SlotMap<ThrottledSocket> &managers, ThrottledSocket *sockets, int players, unsigned seed, Counts &counts) {
+		std::minstd_rand rng(seed);
+		auto before = allocations::total();
+		auto key = *managers.getSlot();
+		Manager<ThrottledSocket> &m = managers[key].value();
+		for (int i = 0; i < players; i++) {
+			auto *data = static_cast<UserData<ThrottledSocket> *>(sockets[i].getUserData());
+			new (data) UserData<ThrottledSocket>;
+			data->socket = &sockets[i];
+			data->version = i % 2 ? 1 : protocolV2::VERSION;
+			data->playerId = m.addClient(&sockets[i]);
+			data->manager = &m;
+			sockets[i].refuse = i == 0 ? REFUSED_FRAMES : 0;
+			char name[] = { static_cast<char>(bots::SET_NAME), 'P', static_cast<char>('a' + i) };
+			m.handleMessage(data->playerId, std::string_view(name, sizeof(name)));
+		}
+		for (int i = 0; i < players; i++) {
+			char ready = static_cast<char>(bots::move(bots::OTHER, 5));
+			m.handleMessage(i, std::string_view(&ready, 1));
+		}
+		auto joined = allocations::total() - before;
+
+		auto &game = m.getGame();
+		std::vector<std::pair<int, uint8_t>> options;
+		while (game.getState() < GameState::LIBERAL_POLICY_WIN) {
+			options.clear();
+			for (int seat = 0; seat < players; seat++) {
+				for (auto move : bots::legalMoves(game, seat)) {
+					options.emplace_back(seat, move);
+				}
+			}
+			auto [seat, move] = options[rng() % options.size()];
+			char message = static_cast<char>(move);
+			auto start = allocations::total();
+			m.handleMessage(seat, std::string_view(&message, 1));
+			auto used = allocations::total() - start;
+			counts.messages++;
+			counts.messageAllocations += used;
+			counts.maxMessageAllocations = std::max(counts.maxMessageAllocations, used);
+		}
+
+		before = allocations::total();
+		for (int i = 0; i < players; i++) {
+			auto *data = static_cast<UserData<ThrottledSocket> *>(sockets[i].getUserData());
+			data->~UserData();
+			m.onDisconnect(data->playerId, 1000);
+		}
+		auto total = joined + allocations::total() - before;
+		counts.joins += players;
+		counts.joinAllocations += total;
+		counts.maxJoinAllocations = std::max(counts.maxJoinAllocations, (total + players - 1) / players);
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned games = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+	if (!allocations::counting()) {
+		fmt::print("built without SH_COUNT_ALLOCATIONS, so there is nothing to count\n");
+		return 1;
+	}
+	SlotMap<ThrottledSocket> managers;
+	LobbyIndex lobbies;
+	Manager<ThrottledSocket>::lobbies = &lobbies;
+	static ThrottledSocket sockets[MAX_PLAYERS];
+
+	Counts warmup;
+	for (unsigned seed = 1; seed <= WARMUP_GAMES; seed++) {
+		for (int players = FIVE; players <= MAX_PLAYERS; players++) {
+			play(managers, sockets, players, seed, warmup);
+		}
+	}
+	Counts counts;
+	for (unsigned seed = 1; seed <= games; seed++) {
+		play(managers, sockets, FIVE + seed % (MAX_PLAYERS - FIVE + 1), WARMUP_GAMES + seed, counts);
+	}
+
+	fmt::print("{:<26} {:>10} {:>14} {:>10}\n", "", "count", "allocations", "max each");
+	fmt::print("{:<26} {:>10} {:>14} {:>10}\n", "warm-up joins", warmup.joins, warmup.joinAllocations,
+			warmup.maxJoinAllocations);
+	fmt::print("{:<26} {:>10} {:>14} {:>10}\n", "joins (with slot and leave)", counts.joins, counts.joinAllocations,
+			counts.maxJoinAllocations);
+	fmt::print("{:<26} {:>10} {:>14} {:>10}\n", "messages", counts.messages, counts.messageAllocations,
+			counts.maxMessageAllocations);
+	auto queued = slab::local().stats(slab::classFor(sizeof(Message) + sizeof(void *)));
+	fmt::print("backpressure slabs: {}, holding {} messages\n", queued.slabs, queued.live);
+
+	bool ok = true;
+	if (counts.maxMessageAllocations > MESSAGE_BUDGET) {
+		fmt::print("FAIL: a message allocated {} times, over the budget of {}\n", counts.maxMessageAllocations,
+				MESSAGE_BUDGET);
+		ok = false;
+	}
+	if (counts.maxJoinAllocations > JOIN_BUDGET) {
+		fmt::print("FAIL: a join allocated {} times, over the budget of {}\n", counts.maxJoinAllocations, JOIN_BUDGET);
+		ok = false;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+/** Resident memory after a simulated day of connection churn, with per-connection state on the general
+ * heap and in slabs
+ *
+ * usage: churnBench [peak connections] [heap|slab]
+ *
+ * Each step is a minute. Load follows a daily curve from 10% of the peak to all of it and back. Sessions
+ * last 30 minutes on average, and every minute a tenth of the connections are backed up, each queuing a
+ * burst of messages that drains by the next minute. Every game of eight has a one in ten chance of a
+ * delayed spectator, which gives it an EventRing. The objects are the sizes the server allocates, and
+ * the only difference between the runs is where they come from.
+ *
+ * Without a mode, both run in child processes, so neither sees memory the other left behind.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <type_traits>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fmt/core.h>
+#include "../eventRing.h"
+#include "../messageQueue.h"
+
+namespace {
+	constexpr size_t NODE_SIZE = sizeof(Message) + sizeof(void *);
+	constexpr int MINUTES = 24 * 60;
+	constexpr int GAME_SIZE = 8;
+
+	struct Heap {
+		static void *allocate(size_t size) {
+			return ::operator new(size);
+		}
+
+		static void deallocate(void *p) {
+			::operator delete(p);
+		}
+	};
+
+	struct Slabs {
+		static void *allocate(size_t size) {
+			return slab::local().allocate(slab::classFor(size));
+		}
+
+		static void deallocate(void *p) {
+			slab::local().deallocate(p);
+		}
+	};
+
+	size_t residentBytes() {
+		std::ifstream statm("/proc/self/statm");
+		size_t size = 0, resident = 0;
+		statm >> size >> resident;
+		return resident * sysconf(_SC_PAGESIZE);
+	}
+
+	struct Connection {
+		// queued messages, linked through their first bytes
+		void *queue = nullptr;
+		bool live = false;
+	};
+
+	template <typename Allocator>
+	void run(const char *name, size_t peak) {
+		std::minstd_rand rng(1);
+		std::vector<Connection> connections(peak + peak / 4);
+		std::vector<void *> rings(connections.size() / GAME_SIZE + 1);
+		std::vector<size_t> freeSlots;
+		for (size_t i = connections.size(); i-- > 0;) {
+			freeSlots.push_back(i);
+		}
+		size_t live = 0;
+		size_t peakResident = 0;
+		size_t troughResident = 0;
+		auto baseline = residentBytes();
+
+		auto drain = [](Connection &c) {
+			while (c.queue) {
+				void *next = *static_cast<void **>(c.queue);
+				Allocator::deallocate(c.queue);
+				c.queue = next;
+			}
+		};
+		auto close = [&](size_t i) {
+			drain(connections[i]);
+			connections[i].live = false;
+			freeSlots.push_back(i);
+			live--;
+			// the last one out of a game takes the delayed stream's ring with it
+			size_t game = i / GAME_SIZE;
+			bool empty = true;
+			for (size_t k = game * GAME_SIZE; k < std::min(connections.size(), (game + 1) * GAME_SIZE); k++) {
+				empty &= !connections[k].live;
+			}
+			if (empty && rings[game]) {
+				Allocator::deallocate(rings[game]);
+				rings[game] = nullptr;
+			}
+		};
+
+		for (int minute = 0; minute < MINUTES; minute++) {
+			double load = 0.55 - 0.45 * std::cos(2 * M_PI * minute / MINUTES);
+			auto target = static_cast<size_t>(peak * load);
+
+			for (size_t i = 0; i < connections.size(); i++) {
+				auto &c = connections[i];
+				if (!c.live) {
+					continue;
+				}
+				drain(c);
+				if (rng() % 30 == 0 || (live > target && rng() % 8 == 0)) {
+					close(i);
+					continue;
+				}
+				if (rng() % 10 == 0) {
+					for (int burst = 1 + rng() % 40; burst > 0; burst--) {
+						void *node = Allocator::allocate(NODE_SIZE);
+						std::memset(node, 0, NODE_SIZE);
+						*static_cast<void **>(node) = c.queue;
+						c.queue = node;
+					}
+				}
+			}
+			while (live < target && !freeSlots.empty()) {
+				size_t i = freeSlots.back();
+				freeSlots.pop_back();
+				connections[i].live = true;
+				live++;
+				size_t game = i / GAME_SIZE;
+				if (!rings[game] && rng() % (10 * GAME_SIZE) == 0) {
+					rings[game] = Allocator::allocate(sizeof(EventRing));
+					std::memset(rings[game], 0, sizeof(EventRing));
+				}
+			}
+
+			auto resident = residentBytes() - baseline;
+			if (minute == MINUTES / 2) {
+				peakResident = resident;
+			}
+			if (minute == MINUTES - 1) {
+				troughResident = resident;
+			}
+		}
+		fmt::print("{:<6} {:>10} {:>14.1f} {:>16.1f}\n", name, live, peakResident / 1048576.0, troughResident / 1048576.0);
+		if constexpr (std::is_same_v<Allocator, Slabs>) {
+			for (size_t i = 0; i < slab::CLASS_SIZES.size(); i++) {
+				auto s = slab::local().stats(i);
+				if (s.slabs) {
+					fmt::print("       {:>4} byte class: {} slabs, {} of {} objects live ({:.1f}% fragmented)\n",
+							s.objectSize, s.slabs, s.live, s.capacity, 100 - 100.0 * s.live / s.capacity);
+				}
+			}
+		}
+	}
+
+	void runMode(const char *mode, size_t peak) {
+		if (std::strcmp(mode, "heap") == 0) {
+			run<Heap>("heap", peak);
+		} else {
+			run<Slabs>("slab", peak);
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	size_t peak = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	fmt::print("{} connections at peak, {} simulated minutes\n\n", peak, MINUTES);
+	fmt::print("{:<6} {:>10} {:>14} {:>16}\n", "", "live", "MiB at peak", "MiB after 24h");
+	fflush(stdout);
+	if (argc > 2) {
+		runMode(argv[2], peak);
+		return 0;
+	}
+	for (const char *mode : { "heap", "slab" }) {
+		pid_t child = fork();
+		if (child == 0) {
+			runMode(mode, peak);
+			fflush(stdout);
+			_exit(0);
+		}
+		waitpid(child, nullptr, 0);
+	}
+	return 0;
+}
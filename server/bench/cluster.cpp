@@ -0,0 +1,238 @@
+/** How evenly a cluster's coordinator spreads new games over nodes on one machine
+ *
+ * usage: clusterBench [nodes] [creates per second] [poll ms]
+ *
+ * Each node is a process standing in for a server. It answers /metrics with its games created and
+ * destroyed, /create?ms=n with a game that ends n ms later, and /restart by losing every game, as a crashed
+ * and restarted node would. Creates arrive at a steady rate with lifetimes averaging LIFETIME_MILLIS, and
+ * halfway through node 0 restarts. The coordinator's side is cluster.h itself: the Balancer, fed by
+ * cluster::poll over loopback, against round robin and random choice.
+ *
+ * The spread is the difference between the busiest and the idlest node, as a share of the average, sampled
+ * every SAMPLE_MILLIS. Recovery is how long after the restart the spread stays under 10%.
+ */
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/wait.h>
+#include <fmt/core.h>
+#include "../cluster.h"
+
+namespace {
+	constexpr int BASE_PORT = 46000;
+	constexpr int RUN_MILLIS = 8000;
+	constexpr int LIFETIME_MILLIS = 2000;
+	constexpr int SAMPLE_MILLIS = 100;
+
+	using Clock = std::chrono::steady_clock;
+
+	uint32_t millis() {
+		using namespace std::chrono;
+		return duration_cast<milliseconds>(Clock::now().time_since_epoch()).count();
+	}
+
+	[[noreturn]] void serve(int port, int ready) {
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) || listen(fd, 512)) {
+			_exit(2);
+		}
+		char byte = 'k';
+		if (write(ready, &byte, 1) != 1) {
+			_exit(2);
+		}
+		std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<>> ends;
+		int64_t created = 0, destroyed = 0;
+		std::string request;
+		while (true) {
+			int c = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+			if (c < 0) {
+				continue;
+			}
+			request.clear();
+			char chunk[512];
+			while (request.find("\r\n\r\n") == std::string::npos) {
+				auto n = read(c, chunk, sizeof(chunk));
+				if (n <= 0) {
+					break;
+				}
+				request.append(chunk, n);
+			}
+			auto now = millis();
+			while (!ends.empty() && ends.top() <= now) {
+				ends.pop();
+				destroyed++;
+			}
+			std::string body = "ok";
+			if (request.compare(0, 13, "GET /metrics ") == 0) {
+				body = fmt::format("sh_games_created_total {}\nsh_games_destroyed_total {}\n", created, destroyed);
+			} else if (request.compare(0, 15, "GET /create?ms=") == 0) {
+				created++;
+				ends.push(now + std::strtoul(request.c_str() + 15, nullptr, 10));
+			} else if (request.compare(0, 13, "GET /restart ") == 0) {
+				destroyed += ends.size();
+				ends = {};
+			}
+			auto response = fmt::format("HTTP/1.1 200 OK\r\nContent-Length: {}\r\n\r\n{}", body.size(), body);
+			send(c, response.data(), response.size(), MSG_NOSIGNAL);
+			close(c);
+		}
+	}
+
+	enum Policy {
+		LEAST_LOADED,
+		ROUND_ROBIN,
+		RANDOM,
+	};
+
+	struct Results {
+		double spreadBefore = 0;
+		double spreadAfter = 0;
+		double worstAfter = 0;
+		int recoveryMillis = 0;
+		std::vector<int64_t> pollMicros;
+	};
+
+	Results run(const std::vector<cluster::Node> &nodes, Policy policy, unsigned rate, uint32_t pollMillis) {
+		for (auto &node : nodes) {
+			cluster::fetch(node, "/restart", 1000);
+		}
+		cluster::Balancer balancer(nodes.size());
+		std::atomic<bool> stop{false};
+		std::thread poller;
+		if (policy == LEAST_LOADED) {
+			poller = std::thread(cluster::poll, std::cref(nodes), std::ref(balancer), pollMillis, std::cref(stop));
+		}
+
+		std::minstd_rand rng(1);
+		std::exponential_distribution<double> lifetime(1.0 / LIFETIME_MILLIS);
+		Results results;
+		size_t next = 0;
+		int samplesBefore = 0, samplesAfter = 0;
+		int lastUneven = 0;
+		bool restarted = false;
+		auto start = Clock::now();
+		auto nextCreate = start;
+		auto nextSample = start;
+		while (true) {
+			auto now = Clock::now();
+			int elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
+			if (elapsed >= RUN_MILLIS) {
+				break;
+			}
+			if (!restarted && elapsed >= RUN_MILLIS / 2) {
+				cluster::fetch(nodes[0], "/restart", 1000);
+				restarted = true;
+			}
+			if (now >= nextSample) {
+				nextSample += std::chrono::milliseconds(SAMPLE_MILLIS);
+				int64_t most = 0, fewest = INT64_MAX, total = 0;
+				for (auto &node : nodes) {
+					auto before = Clock::now();
+					auto metrics = cluster::fetch(node, "/metrics", 1000);
+					results.pollMicros.push_back(
+							std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - before).count());
+					auto games = metrics ? cluster::liveGames(*metrics).value_or(0) : 0;
+					most = std::max(most, games);
+					fewest = std::min(fewest, games);
+					total += games;
+				}
+				// once the first games have had time to build up
+				if (elapsed >= LIFETIME_MILLIS && total > 0) {
+					double spread = double(most - fewest) * nodes.size() / total;
+					if (!restarted) {
+						results.spreadBefore += spread;
+						samplesBefore++;
+					} else {
+						results.spreadAfter += spread;
+						results.worstAfter = std::max(results.worstAfter, spread);
+						samplesAfter++;
+						if (spread >= 0.1) {
+							lastUneven = elapsed;
+						}
+					}
+				}
+			}
+			if (now >= nextCreate) {
+				nextCreate += std::chrono::microseconds(1000000 / rate);
+				size_t node;
+				if (policy == LEAST_LOADED) {
+					node = balancer.pick().value_or(0);
+				} else if (policy == ROUND_ROBIN) {
+					node = next++ % nodes.size();
+				} else {
+					node = rng() % nodes.size();
+				}
+				auto path = fmt::format("/create?ms={}", static_cast<uint32_t>(lifetime(rng)));
+				cluster::fetch(nodes[node], path, 1000);
+				continue;
+			}
+			std::this_thread::sleep_until(std::min(nextCreate, nextSample));
+		}
+		stop = true;
+		if (poller.joinable()) {
+			poller.join();
+		}
+		results.spreadBefore /= std::max(1, samplesBefore);
+		results.spreadAfter /= std::max(1, samplesAfter);
+		results.recoveryMillis = std::max(0, lastUneven - RUN_MILLIS / 2);
+		return results;
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4;
+	unsigned rate = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 500;
+	uint32_t pollMillis = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1000;
+
+	std::vector<cluster::Node> nodes;
+	std::vector<pid_t> servers;
+	for (unsigned i = 0; i < count; i++) {
+		int ready[2];
+		if (pipe(ready)) {
+			return 1;
+		}
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(ready[0]);
+			serve(BASE_PORT + i, ready[1]);
+		}
+		close(ready[1]);
+		char byte;
+		bool started = read(ready[0], &byte, 1) == 1;
+		close(ready[0]);
+		if (!started) {
+			return 1;
+		}
+		servers.push_back(pid);
+		nodes.push_back({ "127.0.0.1", static_cast<int>(BASE_PORT + i) });
+	}
+
+	fmt::print("{} nodes, {} creates/s lasting {} ms on average, polled every {} ms, node 0 restarts at {} ms\n\n",
+			count, rate, LIFETIME_MILLIS, pollMillis, RUN_MILLIS / 2);
+	fmt::print("{:<13} {:>13} {:>12} {:>12} {:>12} {:>12}\n", "", "spread before", "spread after", "worst after",
+			"recovery ms", "/metrics us");
+	for (auto [name, policy] : { std::pair("least loaded", LEAST_LOADED), std::pair("round robin", ROUND_ROBIN),
+			std::pair("random", RANDOM) }) {
+		auto r = run(nodes, policy, rate, pollMillis);
+		std::sort(r.pollMicros.begin(), r.pollMicros.end());
+		fmt::print("{:<13} {:>12.1f}% {:>11.1f}% {:>11.1f}% {:>12} {:>12}\n", name, 100 * r.spreadBefore,
+				100 * r.spreadAfter, 100 * r.worstAfter, r.recoveryMillis,
+				r.pollMicros.empty() ? 0 : r.pollMicros[r.pollMicros.size() / 2]);
+	}
+	for (pid_t pid : servers) {
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+	}
+	return 0;
+}
@@ -0,0 +1,206 @@
+/** Bytes on the wire and CPU per message for each compression policy
+ *
+ * A 10 player game is played with random legal moves, and every frame the server would send is recorded
+ * per recipient. Each policy then compresses the recorded frames the way uWS would: raw deflate with a
+ * sync flush, minus the 4 byte tail that permessage-deflate strips, plus a 2 byte frame header.
+ */
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include <zlib.h>
+#include "../manager.h"
+#include "../randomPlay.h"
+
+namespace {
+	constexpr int PLAYERS = 10;
+
+	struct Frame {
+		int recipient;
+		std::string data;
+	};
+
+	class RecordingComms {
+	public:
+		GenericGame<RecordingComms> game;
+		std::vector<Frame> frames;
+
+		RecordingComms() : game(*this) {}
+
+		int getClientCount() const {
+			return PLAYERS;
+		}
+
+		void broadcast(std::initializer_list<unsigned> bytes) {
+			std::string s;
+			for (auto b : bytes) {
+				s.push_back(static_cast<char>(b));
+			}
+			for (int i = 0; i < PLAYERS; i++) {
+				frames.push_back({ i, s });
+			}
+		}
+
+		void toPresident(int president, std::initializer_list<unsigned> publicBytes, std::initializer_list<unsigned> privateBytes) {
+			broadcast(publicBytes);
+			std::string s;
+			for (auto b : privateBytes) {
+				s.push_back(static_cast<char>(b));
+			}
+			frames[frames.size() - PLAYERS + president].data = s;
+		}
+
+		void roster() {
+			for (int i = 0; i < PLAYERS; i++) {
+				std::string s(1, static_cast<char>(i));
+				for (int j = 0; j < i; j++) {
+					auto name = fmt::format("player {}", j + 1);
+					s.push_back(static_cast<char>((j << 4) | Protocol::NAME));
+					s.push_back(static_cast<char>(name.size()));
+					s += name;
+				}
+				frames.push_back({ i, s });
+			}
+		}
+
+		unsigned mask(PlayerMask b) {
+			return b.to_ulong();
+		}
+
+		void successfulElection() { auto b = mask(game.getBallot()); broadcast({ Protocol::BALLOT | 16 | ((b & 3) << 6), (b >> 2) & 255 }); }
+		void failedElection() { auto b = mask(game.getBallot()); broadcast({ Protocol::BALLOT | ((b & 3) << 6), (b >> 2) & 255 }); }
+		void chaoticFascistPolicy() { broadcast({ Protocol::CHAOTIC_FASCIST_POLICY }); }
+		void chaoticLiberalPolicy() { broadcast({ Protocol::CHAOTIC_LIBERAL_POLICY }); }
+		void regularFascistPolicy() { broadcast({ Protocol::REGULAR_FASCIST_POLICY }); }
+		void regularLiberalPolicy() { broadcast({ Protocol::REGULAR_LIBERAL_POLICY }); }
+		void fascistPolicyWin() { broadcast({ Protocol::FASCIST_POLICY_WIN }); }
+		void liberalPolicyWin() { broadcast({ Protocol::LIBERAL_POLICY_WIN }); }
+		void fascistHitlerWin() { broadcast({ Protocol::FASCIST_HITLER_WIN }); }
+		void liberalHitlerWin() { broadcast({ Protocol::LIBERAL_HITLER_WIN }); }
+		void sendPresidentVetoOption() { broadcast({ Protocol::REQUEST_PRESIDENT_VETO }); }
+		void requestSpecialPresidentNomination() { broadcast({ Protocol::REQUEST_SPECIAL_NOMINATION }); }
+		void announceElection() { broadcast({ Protocol::ANNOUNCE_ELECTION | (unsigned(game.getChancellorId()) << 4) }); }
+		void announceDeath(int id) { broadcast({ Protocol::DEATH | (unsigned(id) << 4) }); }
+		void voteReceived(int id) { broadcast({ Protocol::VOTE_RECEIVED | (unsigned(id) << 4) }); }
+
+		void requestChancellorNomination() {
+			auto v = mask(game.getEligibleChancellors());
+			broadcast({ Protocol::REQUEST_CHANCELLOR_NOMINATION, unsigned(game.getPresidentId()) | ((v & 3) << 6), (v >> 2) & 255 });
+		}
+
+		void requestInvestigation() {
+			auto v = mask(game.eligibleForInvestigation());
+			broadcast({ Protocol::REQUEST_INVESTIGATION | ((v & 3) << 6), (v >> 2) & 255 });
+		}
+
+		void requestKill() {
+			auto v = mask(game.alive());
+			broadcast({ Protocol::REQUEST_KILL | ((v & 3) << 6), (v >> 2) & 255 });
+		}
+
+		void sendPresidentPolicyChoice() {
+			unsigned policies = (game.getFirstPolicy() << 5) | (game.getSecondPolicy() << 6) | (game.getThirdPolicy() << 7);
+			toPresident(game.getPresidentId(), { Protocol::REQUEST_PRESIDENT_POLICY_CHOICE }, { Protocol::REQUEST_PRESIDENT_POLICY_CHOICE | policies });
+		}
+
+		void sendChancellorPolicyChoice() {
+			broadcast({ Protocol::REQUEST_CHANCELLOR_POLICY_CHOICE });
+			unsigned policies = (game.getFirstPolicy() << 5) | (game.getSecondPolicy() << 6);
+			frames[frames.size() - PLAYERS + game.getChancellorId()].data[0] |= policies;
+		}
+
+		void sendLoyalty(int president, int id, Team team) {
+			toPresident(president, { Protocol::SEND_LOYALTY | (unsigned(id) << 4) }, { Protocol::SEND_LOYALTY | (unsigned(id) << 4), unsigned(team) });
+		}
+
+		void sendTopCards(int president) {
+			auto [a, b, c] = game.peekTopCards();
+			toPresident(president, { Protocol::TOP_CARDS }, { Protocol::TOP_CARDS | 16U | (a << 5) | (b << 6) | (c << 7) });
+		}
+	};
+
+	class Deflater {
+		z_stream stream{};
+		bool keepContext;
+
+	public:
+		explicit Deflater(bool keepContext) : keepContext(keepContext) {
+			deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+		}
+
+		~Deflater() {
+			deflateEnd(&stream);
+		}
+
+		size_t compress(const std::string &in) {
+			unsigned char out[1024];
+			if (!keepContext) {
+				deflateReset(&stream);
+			}
+			stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+			stream.avail_in = in.size();
+			stream.next_out = out;
+			stream.avail_out = sizeof(out);
+			deflate(&stream, Z_SYNC_FLUSH);
+			return sizeof(out) - stream.avail_out - 4;
+		}
+	};
+
+	enum Mode {
+		OFF,
+		SHARED,
+		DEDICATED,
+		SHARED_ABOVE_THRESHOLD,
+	};
+
+	void run(Mode mode, const char *name, const std::vector<Frame> &frames, unsigned threshold) {
+		using namespace std::chrono;
+		Deflater shared(false);
+		std::vector<Deflater> dedicated;
+		dedicated.reserve(PLAYERS);
+		for (int i = 0; i < PLAYERS; i++) {
+			dedicated.emplace_back(true);
+		}
+		size_t wire = 0;
+		size_t compressed = 0;
+		auto start = steady_clock::now();
+		for (auto &f : frames) {
+			size_t payload = f.data.size();
+			if (mode == SHARED || (mode == SHARED_ABOVE_THRESHOLD && f.data.size() >= threshold)) {
+				payload = shared.compress(f.data);
+				compressed++;
+			} else if (mode == DEDICATED) {
+				payload = dedicated[f.recipient].compress(f.data);
+				compressed++;
+			}
+			wire += 2 + payload;
+		}
+		auto ns = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+		fmt::print("{:<24} {:>10} {:>12} {:>14.1f}\n", name, compressed, wire, double(ns) / frames.size());
+	}
+}
+
+int main(int argc, char **argv) {
+	constexpr unsigned threshold = 64;
+	unsigned games = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100;
+	std::vector<Frame> frames;
+	for (unsigned seed = 1; seed <= games; seed++) {
+		RecordingComms comms;
+		comms.roster();
+		playRandomGame(comms, comms.game, seed);
+		frames.insert(frames.end(), comms.frames.begin(), comms.frames.end());
+	}
+	size_t raw = 0;
+	for (auto &f : frames) {
+		raw += f.data.size();
+	}
+	fmt::print("{} games, {} frames, {} payload bytes ({:.1f} bytes per game on the wire uncompressed)\n\n",
+			games, frames.size(), raw, double(raw + 2 * frames.size()) / games);
+	fmt::print("{:<24} {:>10} {:>12} {:>14}\n", "policy", "compressed", "wire bytes", "ns per frame");
+	run(OFF, "off", frames, threshold);
+	run(SHARED, "shared, every frame", frames, threshold);
+	run(DEDICATED, "dedicated, every frame", frames, threshold);
+	run(SHARED_ABOVE_THRESHOLD, "shared, >= 64 bytes", frames, threshold);
+	return 0;
+}
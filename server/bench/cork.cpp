@@ -0,0 +1,137 @@
+/** Write system calls per game, with every message's frames corked per socket or sent one by one
+ *
+ * usage: corkBench [games]
+ *
+ * Games of 10 go through Manager with random legal moves, as in allocationsBench. Each socket counts the
+ * writes uSockets would make for it: one per frame outside a cork, and one per cork that had anything in
+ * it. Sockets that ignore the cork stand in for the server before handleMessage corked, since the frames
+ * then reach them one send at a time in the same order.
+ */
+#include <algorithm>
+#include <random>
+#include <fmt/core.h>
+#include "../bot.h"
+#include "../slotMap.h"
+
+namespace {
+	constexpr int PLAYERS = 10;
+
+	struct alignas(8) CountingSocket {
+		UserData<CountingSocket> data;
+		bool inCork = false;
+		bool pending = false;
+		uint64_t frames = 0;
+		uint64_t writes = 0;
+		// since the message being handled arrived
+		unsigned writesThisMessage = 0;
+		static inline bool honourCork = true;
+
+		void *getUserData() {
+			return &data;
+		}
+
+		void write() {
+			writes++;
+			writesThisMessage++;
+		}
+
+		bool send(std::string_view, uWS::OpCode, bool) {
+			frames++;
+			if (inCork) {
+				pending = true;
+			} else {
+				write();
+			}
+			return true;
+		}
+
+		template <typename F>
+		void cork(F &&f) {
+			if (!honourCork) {
+				return f();
+			}
+			inCork = true;
+			f();
+			inCork = false;
+			if (pending) {
+				pending = false;
+				write();
+			}
+		}
+
+		void end(int) {
+		}
+	};
+
+	struct Counts {
+		uint64_t messages = 0;
+		uint64_t frames = 0;
+		uint64_t writes = 0;
+		// the most writes any one socket took for one message
+		unsigned mostWrites = 0;
+	};
+
+	Counts play(unsigned games, bool corked) {
+		CountingSocket::honourCork = corked;
+		SlotMap<CountingSocket> managers;
+		static CountingSocket sockets[PLAYERS];
+		Counts counts;
+		for (unsigned seed = 1; seed <= games; seed++) {
+			std::minstd_rand rng(seed);
+			auto key = *managers.getSlot();
+			Manager<CountingSocket> &m = managers[key].value();
+			for (int i = 0; i < PLAYERS; i++) {
+				new (&sockets[i].data) UserData<CountingSocket>;
+				sockets[i].data.socket = &sockets[i];
+				sockets[i].data.playerId = m.addClient(&sockets[i]);
+				sockets[i].data.manager = &m;
+				sockets[i].frames = 0;
+				sockets[i].writes = 0;
+			}
+			for (int i = 0; i < PLAYERS; i++) {
+				char ready = static_cast<char>(bots::move(bots::OTHER, 5));
+				m.handleMessage(i, std::string_view(&ready, 1));
+			}
+			auto &game = m.getGame();
+			std::vector<std::pair<int, uint8_t>> options;
+			while (game.getState() < GameState::LIBERAL_POLICY_WIN) {
+				options.clear();
+				for (int seat = 0; seat < PLAYERS; seat++) {
+					for (auto move : bots::legalMoves(game, seat)) {
+						options.emplace_back(seat, move);
+					}
+				}
+				auto [seat, move] = options[rng() % options.size()];
+				for (auto &s : sockets) {
+					s.writesThisMessage = 0;
+				}
+				char message = static_cast<char>(move);
+				m.handleMessage(seat, std::string_view(&message, 1));
+				counts.messages++;
+				for (auto &s : sockets) {
+					counts.mostWrites = std::max(counts.mostWrites, s.writesThisMessage);
+				}
+			}
+			for (int i = 0; i < PLAYERS; i++) {
+				counts.frames += sockets[i].frames;
+				counts.writes += sockets[i].writes;
+				sockets[i].data.~UserData();
+				m.onDisconnect(i, 1000);
+			}
+		}
+		return counts;
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned games = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+	fmt::print("{} games of {}\n\n", games, PLAYERS);
+	fmt::print("{:<10} {:>12} {:>12} {:>15} {:>15}\n", "", "writes/game", "frames/game", "writes/message",
+			"most per socket");
+	for (auto [name, corked] : { std::pair("one by one", false), std::pair("corked", true) }) {
+		auto c = play(games, corked);
+		fmt::print("{:<10} {:>12.1f} {:>12.1f} {:>15.2f} {:>15}\n", name, double(c.writes) / games,
+				double(c.frames) / games, double(c.writes) / c.messages, c.mostWrites);
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+/** Refused connections and accept latency across simulated rolling deploys
+ *
+ * usage: deployBench [port]
+ *
+ * Server processes listen the way uSockets does on Linux (SO_REUSEADDR and SO_REUSEPORT, a backlog of
+ * 512), take STARTUP_MILLIS to start, answer every connection with a byte, and on SIGTERM close their
+ * listening socket within a timer tick, like the server's drain. A client connects over and over while
+ * the servers are replaced DEPLOYS times, either
+ * - restart: SIGTERM the old process, then start the new one
+ * - handoff: start the new process on the same port, then SIGTERM the old one
+ * and counts connections refused, connections reset, and the longest time without a completed one.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fmt/core.h>
+
+namespace {
+	constexpr int STARTUP_MILLIS = 300;
+	constexpr int DEPLOYS = 3;
+	constexpr int BETWEEN_DEPLOYS_MILLIS = 700;
+	// the server's timer period, and so how long SIGTERM can take to be noticed
+	constexpr int TICK_MILLIS = 100;
+
+	using Clock = std::chrono::steady_clock;
+
+	volatile std::sig_atomic_t terminated = 0;
+
+	sockaddr_in loopback(int port) {
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return addr;
+	}
+
+	[[noreturn]] void serve(int port, int ready) {
+		struct sigaction action = {};
+		action.sa_handler = [](int) { terminated = 1; };
+		sigaction(SIGTERM, &action, nullptr);
+		usleep(STARTUP_MILLIS * 1000);
+
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+		auto addr = loopback(port);
+		if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) || listen(fd, 512)) {
+			_exit(2);
+		}
+		char byte = 'k';
+		if (write(ready, &byte, 1) != 1) {
+			_exit(2);
+		}
+		while (true) {
+			pollfd p = { fd, POLLIN, 0 };
+			if (poll(&p, 1, TICK_MILLIS) > 0) {
+				while (true) {
+					int c = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+					if (c < 0) {
+						break;
+					}
+					send(c, &byte, 1, MSG_NOSIGNAL);
+					close(c);
+				}
+			}
+			if (terminated) {
+				close(fd);
+				// a real server would keep serving its games here; none of them affect new connections
+				_exit(0);
+			}
+		}
+	}
+
+	pid_t start(int port) {
+		int ready[2];
+		if (pipe(ready)) {
+			return -1;
+		}
+		pid_t child = fork();
+		if (child == 0) {
+			close(ready[0]);
+			serve(port, ready[1]);
+		}
+		close(ready[1]);
+		char byte;
+		bool started = read(ready[0], &byte, 1) == 1;
+		close(ready[0]);
+		return started ? child : -1;
+	}
+
+	void stop(pid_t server) {
+		if (server <= 0) {
+			return;
+		}
+		kill(server, SIGTERM);
+		waitpid(server, nullptr, 0);
+	}
+
+	struct Results {
+		int attempts = 0;
+		int refused = 0;
+		int reset = 0;
+		std::vector<int64_t> latencies;
+		int64_t longestGap = 0;
+	};
+
+	void connectUntil(std::atomic<bool> &done, int port, Results &results) {
+		auto lastSuccess = Clock::now();
+		while (!done.load(std::memory_order_relaxed)) {
+			auto start = Clock::now();
+			int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			timeval timeout = { 1, 0 };
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			auto addr = loopback(port);
+			results.attempts++;
+			if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+				results.refused++;
+			} else {
+				char byte;
+				if (read(fd, &byte, 1) == 1) {
+					auto end = Clock::now();
+					results.latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+					results.longestGap = std::max<int64_t>(results.longestGap,
+							std::chrono::duration_cast<std::chrono::milliseconds>(end - lastSuccess).count());
+					lastSuccess = end;
+				} else {
+					// accepted by the kernel into a queue that closed before the server took it
+					results.reset++;
+				}
+			}
+			close(fd);
+			usleep(200);
+		}
+	}
+
+	Results deploy(int port, bool handoff) {
+		Results results;
+		pid_t server = start(port);
+		std::atomic<bool> done{false};
+		std::thread client(connectUntil, std::ref(done), port, std::ref(results));
+		usleep(BETWEEN_DEPLOYS_MILLIS * 1000);
+		for (int i = 0; i < DEPLOYS; i++) {
+			if (handoff) {
+				pid_t next = start(port);
+				stop(server);
+				server = next;
+			} else {
+				stop(server);
+				server = start(port);
+			}
+			usleep(BETWEEN_DEPLOYS_MILLIS * 1000);
+		}
+		done = true;
+		client.join();
+		stop(server);
+		return results;
+	}
+
+	int64_t percentile(std::vector<int64_t> &v, double p) {
+		if (v.empty()) {
+			return 0;
+		}
+		auto i = static_cast<size_t>(p * (v.size() - 1));
+		std::nth_element(v.begin(), v.begin() + i, v.end());
+		return v[i];
+	}
+}
+
+int main(int argc, char **argv) {
+	int port = argc > 1 ? std::atoi(argv[1]) : 45450;
+	std::ifstream migrate("/proc/sys/net/ipv4/tcp_migrate_req");
+	std::string migrateReq = "unavailable";
+	migrate >> migrateReq;
+	fmt::print("{} deploys on 127.0.0.1:{}, {} ms startup, net.ipv4.tcp_migrate_req = {}\n\n", DEPLOYS, port,
+			STARTUP_MILLIS, migrateReq);
+	fmt::print("{:<8} {:>9} {:>8} {:>6} {:>8} {:>8} {:>8} {:>14}\n", "", "attempts", "refused", "reset", "p50 us",
+			"p99 us", "max us", "longest gap ms");
+	for (bool handoff : { false, true }) {
+		auto r = deploy(port, handoff);
+		fmt::print("{:<8} {:>9} {:>8} {:>6} {:>8} {:>8} {:>8} {:>14}\n", handoff ? "handoff" : "restart", r.attempts,
+				r.refused, r.reset, percentile(r.latencies, 0.5), percentile(r.latencies, 0.99),
+				percentile(r.latencies, 1), r.longestGap);
+	}
+	return 0;
+}
@@ -0,0 +1,95 @@
+/** CPU and bytes on the wire per game, for the player count the server is built for
+ *
+ * Build once with the default SH_MAX_PLAYERS and once with SH_MAX_PLAYERS=16 to compare the packed and
+ * wide mask formats. Games are played with random legal moves; every frame is sized the way Manager
+ * writes it and counted once per recipient.
+ */
+#include <chrono>
+#include <fmt/core.h>
+#include "../manager.h"
+#include "../randomPlay.h"
+
+namespace {
+	class SizingComms : public Protocol {
+	public:
+		GenericGame<SizingComms> game;
+		int players;
+		size_t frames = 0;
+		size_t bytes = 0;
+		size_t maskFrames = 0;
+		size_t maskBytes = 0;
+		unsigned char buffer[4];
+
+		explicit SizingComms(int players) : game(*this), players(players) {}
+
+		int getClientCount() const {
+			return players;
+		}
+
+		void broadcast(size_t length) {
+			frames += players;
+			bytes += players * length;
+		}
+
+		void broadcastMask(unsigned first, PlayerMask mask, int offset = 0) {
+			buffer[offset] = first;
+			auto length = offset + writeMask(buffer + offset, mask.to_ulong());
+			maskFrames += players;
+			maskBytes += players * length;
+			broadcast(length);
+		}
+
+		void successfulElection() { broadcastMask(BALLOT | 16, game.getBallot()); }
+		void failedElection() { broadcastMask(BALLOT, game.getBallot()); }
+		void requestChancellorNomination() { broadcastMask(game.getPresidentId(), game.getEligibleChancellors(), 1); }
+		void requestInvestigation() { broadcastMask(REQUEST_INVESTIGATION, game.eligibleForInvestigation()); }
+		void requestKill() { broadcastMask(REQUEST_KILL, game.alive()); }
+		void chaoticFascistPolicy() { broadcast(1); }
+		void chaoticLiberalPolicy() { broadcast(1); }
+		void regularFascistPolicy() { broadcast(1); }
+		void regularLiberalPolicy() { broadcast(1); }
+		void fascistPolicyWin() { broadcast(1); }
+		void liberalPolicyWin() { broadcast(1); }
+		void fascistHitlerWin() { broadcast(1); }
+		void liberalHitlerWin() { broadcast(1); }
+		void sendPresidentVetoOption() { broadcast(1); }
+		void requestSpecialPresidentNomination() { broadcast(1); }
+		void announceElection() { broadcast(1); }
+		void announceDeath(int) { broadcast(1); }
+		void voteReceived(int) { broadcast(1); }
+		void sendPresidentPolicyChoice() { broadcast(1); }
+		void sendChancellorPolicyChoice() { broadcast(1); }
+		void sendTopCards(int) { broadcast(1); }
+		void sendLoyalty(int, int, Team) { broadcast(1); bytes++; }
+	};
+
+	void run(int players, unsigned games) {
+		using namespace std::chrono;
+		size_t frames = 0, bytes = 0, maskFrames = 0, maskBytes = 0;
+		auto start = steady_clock::now();
+		for (unsigned seed = 1; seed <= games; seed++) {
+			SizingComms comms(players);
+			playRandomGame(comms, comms.game, seed);
+			frames += comms.frames;
+			bytes += comms.bytes;
+			maskFrames += comms.maskFrames;
+			maskBytes += comms.maskBytes;
+		}
+		auto ns = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+		fmt::print("{:>7} {:>14.0f} {:>16.1f} {:>16.1f} {:>18.2f}\n", players, double(ns) / games,
+				double(frames) / games, double(bytes) / games, double(maskBytes) / maskFrames);
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned games = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	fmt::print("built for {} players ({} masks), {} games each\n\n", MAX_PLAYERS,
+			Protocol::WIDE_MASKS ? "wide" : "packed", games);
+	fmt::print("{:>7} {:>14} {:>16} {:>16} {:>18}\n", "players", "ns per game", "frames per game", "bytes per game",
+			"bytes per mask msg");
+	run(10, games);
+	if (MAX_PLAYERS != 10) {
+		run(MAX_PLAYERS, games);
+	}
+	return 0;
+}
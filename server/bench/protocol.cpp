@@ -0,0 +1,173 @@
+/** Bytes, frames and time per game in each version of the wire protocol
+ *
+ * usage: protocolBench [games]
+ *
+ * Games of FIVE to MAX_PLAYERS go through Manager with names, a game key and random legal moves, once with
+ * every socket on version 1 and once on version 2, with the same seeds so that the games are identical.
+ * Bytes count each frame's WebSocket header as a server writes it, and leave out compression and TCP.
+ * Server time is the whole game, messages and encoding both, since version 1 is encoded in place as each
+ * message is built. Decoding reads every frame a game sent into (Event, payload) pairs, through fromV1 for
+ * version 1 and decode for version 2, which is the work a client does before acting on an event.
+ */
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "../bot.h"
+#include "../protocolV2.h"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	struct alignas(8) WireSocket {
+		UserData<WireSocket> data;
+		uint64_t frames = 0;
+		uint64_t bytes = 0;
+		// every frame, when recording
+		std::vector<std::string> *recorded = nullptr;
+
+		void *getUserData() {
+			return &data;
+		}
+
+		bool send(std::string_view message, uWS::OpCode, bool) {
+			frames++;
+			bytes += message.size() + (message.size() < 126 ? 2 : 4);
+			if (recorded) {
+				recorded->emplace_back(message);
+			}
+			return true;
+		}
+
+		template <typename F>
+		void cork(F &&f) {
+			f();
+		}
+
+		void end(int) {
+		}
+	};
+
+	void play(WireSocket *sockets, int players, uint8_t version, unsigned seed) {
+		Manager<WireSocket> m;
+		m.setDeleter([](void *, uint32_t) {}, nullptr);
+		for (int i = 0; i < players; i++) {
+			new (&sockets[i].data) UserData<WireSocket>;
+			sockets[i].data.version = version;
+			sockets[i].data.socket = &sockets[i];
+			sockets[i].data.playerId = m.addClient(&sockets[i]);
+			sockets[i].data.manager = &m;
+			char name[] = { static_cast<char>(bots::SET_NAME), 'P', 'l', 'a', 'y', 'e', 'r', static_cast<char>('a' + i) };
+			m.handleMessage(i, std::string_view(name, sizeof(name)));
+		}
+		m.sendGameKey(0, seed * 2654435761u);
+		m.startMatchedGame(seed);
+		std::minstd_rand rng(seed);
+		auto &game = m.getGame();
+		std::vector<std::pair<int, uint8_t>> options;
+		while (game.getState() < GameState::LIBERAL_POLICY_WIN) {
+			options.clear();
+			for (int seat = 0; seat < players; seat++) {
+				for (auto move : bots::legalMoves(game, seat)) {
+					options.emplace_back(seat, move);
+				}
+			}
+			auto [seat, move] = options[rng() % options.size()];
+			char message = static_cast<char>(move);
+			m.handleMessage(seat, std::string_view(&message, 1));
+		}
+		for (int i = 0; i < players; i++) {
+			sockets[i].data.~UserData();
+		}
+	}
+
+	int playersFor(unsigned seed) {
+		return FIVE + seed % (MAX_PLAYERS - FIVE + 1);
+	}
+
+	struct Results {
+		uint64_t frames = 0;
+		uint64_t bytes = 0;
+		uint64_t events = 0;
+		double serverNanos = 0;
+		double decodeNanos = 0;
+	};
+
+	Results measure(unsigned games, uint8_t version) {
+		static WireSocket sockets[MAX_PLAYERS];
+		Results r;
+		for (auto &s : sockets) {
+			s.frames = s.bytes = 0;
+		}
+		auto start = Clock::now();
+		for (unsigned seed = 1; seed <= games; seed++) {
+			play(sockets, playersFor(seed), version, seed);
+		}
+		r.serverNanos = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / games;
+		for (auto &s : sockets) {
+			r.frames += s.frames;
+			r.bytes += s.bytes;
+		}
+
+		// recorded apart from the timed games, so that copying frames isn't counted against the server
+		std::vector<std::vector<std::string>> streams(MAX_PLAYERS);
+		std::vector<std::vector<std::string>> all;
+		for (unsigned seed = 1; seed <= games; seed++) {
+			for (int i = 0; i < MAX_PLAYERS; i++) {
+				sockets[i].recorded = &streams[i];
+			}
+			play(sockets, playersFor(seed), version, seed);
+			for (auto &stream : streams) {
+				if (!stream.empty()) {
+					all.push_back(std::move(stream));
+					stream.clear();
+				}
+			}
+		}
+		for (auto &s : sockets) {
+			s.recorded = nullptr;
+		}
+
+		uint64_t checksum = 0;
+		auto count = [&](protocolV2::Event e, std::string_view payload) {
+			r.events++;
+			checksum += e + payload.size();
+		};
+		start = Clock::now();
+		for (auto &stream : all) {
+			for (size_t f = 0; f < stream.size(); f++) {
+				if (version == protocolV2::VERSION) {
+					protocolV2::decode(stream[f], count);
+				} else {
+					protocolV2::fromV1(stream[f], f == 0, count);
+				}
+			}
+		}
+		r.decodeNanos = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / games;
+		if (checksum == 0) {
+			fmt::print("nothing was decoded\n");
+		}
+		return r;
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned games = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5000;
+	fmt::print("{} games of {} to {} players\n\n", games, int(FIVE), MAX_PLAYERS);
+	fmt::print("{:<8} {:>12} {:>12} {:>12} {:>15} {:>15} {:>16}\n", "", "frames/game", "bytes/game", "events/game",
+			"server ns/game", "decode ns/game", "decode ns/event");
+	// twice over, keeping the second, so both versions run warm
+	for (int round = 0; round < 2; round++) {
+		for (uint8_t version : { uint8_t(1), uint8_t(protocolV2::VERSION) }) {
+			auto r = measure(games, version);
+			if (round == 1) {
+				fmt::print("{:<8} {:>12.1f} {:>12.1f} {:>12.1f} {:>15.0f} {:>15.0f} {:>16.1f}\n", fmt::format("v{}", version),
+						double(r.frames) / games, double(r.bytes) / games, double(r.events) / games, r.serverNanos,
+						r.decodeNanos, r.decodeNanos * games / r.events);
+			}
+		}
+	}
+	return 0;
+}
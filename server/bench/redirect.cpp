@@ -0,0 +1,231 @@
+/** What a /join costs when it lands on the wrong worker and is redirected
+ *
+ * usage: redirectBench [workers] [joins]
+ *
+ * Workers are forked the way SH_PROCESSES does it, each listening on the shared port with SO_REUSEPORT and
+ * on its own port. A join sends a WebSocket upgrade for a random game key. The worker that holds the game
+ * answers with the upgrade and a roster frame. Any other worker answers with the upgrade and a close frame
+ * carrying REDIRECT and its owner's port, and the client connects again there, which is what the web app
+ * does. Workers use the server's own ownerOf and portOf, and answer one connection at a time, so the
+ * times are the protocol's round trips rather than anything the server does with a game.
+ */
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <random>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fmt/core.h>
+#include "../gameKey.h"
+#include "../processes.h"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr std::string_view UPGRADE_RESPONSE = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+			"Connection: Upgrade\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n";
+
+	sockaddr_in loopback(int port) {
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return addr;
+	}
+
+	int listenOn(int port) {
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+		auto addr = loopback(port);
+		if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) || listen(fd, 512)) {
+			_exit(2);
+		}
+		return fd;
+	}
+
+	// reads until `end` has arrived, which is enough for an HTTP head
+	bool readUntil(int fd, std::string &buffer, std::string_view end) {
+		char chunk[512];
+		while (buffer.find(end) == std::string::npos) {
+			auto n = read(fd, chunk, sizeof(chunk));
+			if (n <= 0) {
+				return false;
+			}
+			buffer.append(chunk, n);
+		}
+		return true;
+	}
+
+	[[noreturn]] void work(processes::Worker worker, int ready) {
+		int shared = listenOn(processes::PORT);
+		int own = listenOn(processes::portOf(worker.index));
+		char byte = 'k';
+		if (write(ready, &byte, 1) != 1) {
+			_exit(2);
+		}
+		std::string request;
+		while (true) {
+			pollfd p[2] = { { shared, POLLIN, 0 }, { own, POLLIN, 0 } };
+			poll(p, 2, -1);
+			for (auto &listener : p) {
+				if (!(listener.revents & POLLIN)) {
+					continue;
+				}
+				int c = accept4(listener.fd, nullptr, nullptr, SOCK_CLOEXEC);
+				if (c < 0) {
+					continue;
+				}
+				int one = 1;
+				setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				request.clear();
+				if (readUntil(c, request, "\r\n\r\n")) {
+					auto path = request.substr(4, request.find(' ', 4) - 4);
+					auto id = gameKey::decode(path.substr(path.rfind('/') + 1));
+					std::string response(UPGRADE_RESPONSE);
+					auto owner = id ? processes::ownerOf(*id, worker.count) : worker.index;
+					if (owner == worker.index) {
+						// a roster frame: our id and one name
+						response += std::string("\x82\x05\x00" "Alex", 7);
+					} else {
+						auto port = std::to_string(processes::portOf(owner));
+						response += static_cast<char>(0x88);
+						response += static_cast<char>(2 + port.size());
+						response += static_cast<char>(processes::REDIRECT >> 8);
+						response += static_cast<char>(processes::REDIRECT & 0xff);
+						response += port;
+					}
+					send(c, response.data(), response.size(), MSG_NOSIGNAL);
+				}
+				close(c);
+			}
+		}
+	}
+
+	// returns the port the server redirected to, or 0 once joined
+	int join(int port, const std::string &key) {
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		auto addr = loopback(port);
+		if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+			close(fd);
+			return -1;
+		}
+		auto request = fmt::format("GET /join/{} HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\n"
+				"Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n",
+				key);
+		send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+		std::string response;
+		readUntil(fd, response, "\r\n\r\n");
+		auto head = response.find("\r\n\r\n") + 4;
+		while (response.size() < head + 2 || response.size() < head + 2 + static_cast<unsigned char>(response[head + 1])) {
+			char chunk[64];
+			auto n = read(fd, chunk, sizeof(chunk));
+			if (n <= 0) {
+				break;
+			}
+			response.append(chunk, n);
+		}
+		close(fd);
+		if (response.size() < head + 4 || static_cast<unsigned char>(response[head]) != 0x88) {
+			return 0;
+		}
+		int code = (static_cast<unsigned char>(response[head + 2]) << 8) | static_cast<unsigned char>(response[head + 3]);
+		if (code != processes::REDIRECT) {
+			return -1;
+		}
+		return std::atoi(response.substr(head + 4).c_str());
+	}
+
+	struct Latencies {
+		std::vector<int64_t> micros;
+
+		int64_t percentile(double p) {
+			if (micros.empty()) {
+				return 0;
+			}
+			auto i = static_cast<size_t>(p * (micros.size() - 1));
+			std::nth_element(micros.begin(), micros.begin() + i, micros.end());
+			return micros[i];
+		}
+
+		double mean() const {
+			int64_t total = 0;
+			for (auto m : micros) {
+				total += m;
+			}
+			return micros.empty() ? 0 : double(total) / micros.size();
+		}
+	};
+}
+
+int main(int argc, char **argv) {
+	unsigned count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4;
+	int joins = argc > 2 ? std::atoi(argv[2]) : 20000;
+	std::vector<pid_t> workers;
+	for (unsigned i = 0; i < count; i++) {
+		int ready[2];
+		if (pipe(ready)) {
+			return 1;
+		}
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(ready[0]);
+			work({ i, count }, ready[1]);
+		}
+		close(ready[1]);
+		char byte;
+		bool started = read(ready[0], &byte, 1) == 1;
+		close(ready[0]);
+		if (!started) {
+			return 1;
+		}
+		workers.push_back(pid);
+	}
+
+	std::minstd_rand rng(1);
+	Latencies direct, redirected;
+	int failed = 0;
+	for (int i = 0; i < joins; i++) {
+		auto id = static_cast<uint32_t>(rng() % 256) << 24 | static_cast<uint32_t>(rng() % 0x1000000);
+		auto key = gameKey::encode(id);
+		auto start = Clock::now();
+		int port = join(processes::PORT, key);
+		bool wasRedirected = port > 0;
+		if (wasRedirected) {
+			port = join(port, key);
+		}
+		auto micros = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+		if (port != 0) {
+			failed++;
+			continue;
+		}
+		(wasRedirected ? redirected : direct).micros.push_back(micros);
+	}
+	for (pid_t pid : workers) {
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+	}
+
+	fmt::print("{} workers, {} joins, {} failed\n\n", count, joins, failed);
+	fmt::print("{:<11} {:>7} {:>9} {:>7} {:>7}\n", "", "joins", "mean us", "p50 us", "p99 us");
+	for (auto [name, l] : { std::pair("direct", &direct), std::pair("redirected", &redirected) }) {
+		fmt::print("{:<11} {:>7} {:>9.1f} {:>7} {:>7}\n", name, l->micros.size(), l->mean(), l->percentile(0.5),
+				l->percentile(0.99));
+	}
+	double all = (direct.mean() * direct.micros.size() + redirected.mean() * redirected.micros.size())
+			/ std::max<size_t>(1, direct.micros.size() + redirected.micros.size());
+	if (!redirected.micros.empty()) {
+		fmt::print("\nredirects add {:.1f} us to a join on average, {:.1f} us to each one redirected\n",
+				all - direct.mean(), redirected.mean() - direct.mean());
+	}
+	return 0;
+}
@@ -0,0 +1,77 @@
+/** Bot rollouts per second, on one thread and spread over the work pool
+ *
+ * usage: rolloutsBench [rollouts] [players]
+ *
+ * Each decision is the first nomination of a seeded game, scored the way BotPool does it: batches of
+ * BotPool::BATCH rollouts per move, submitted to a WorkPool and stolen by idle workers. The per-thread
+ * figure shows how well the batches scale once there are more threads than cores.
+ */
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <fmt/core.h>
+#include "../fuzz/mockSocket.h"
+#include "../bot.h"
+
+namespace {
+	constexpr int BATCH = BotPool<MockSocket>::BATCH;
+
+	std::shared_ptr<bots::Decision> firstNomination(int players, unsigned seed) {
+		GameState game;
+		game.init(seed, players);
+		game.start();
+		PlayerMask known;
+		known[game.getPresidentId()] = true;
+		return std::make_shared<bots::Decision>(game, game.getPresidentId(), known);
+	}
+
+	double single(int players, int rollouts) {
+		using namespace std::chrono;
+		auto decision = firstNomination(players, 1);
+		int batches = rollouts / BATCH;
+		auto start = steady_clock::now();
+		for (int b = 0; b < batches; b++) {
+			decision->playOut(b % decision->moves.size(), BATCH, b);
+		}
+		return batches * BATCH / duration_cast<duration<double>>(steady_clock::now() - start).count();
+	}
+
+	double pooled(int players, int rollouts, unsigned threads) {
+		using namespace std::chrono;
+		WorkPool pool(threads);
+		auto decision = firstNomination(players, 1);
+		int batches = rollouts / BATCH;
+		std::mutex mutex;
+		std::condition_variable done;
+		decision->remaining = batches;
+		auto start = steady_clock::now();
+		for (int b = 0; b < batches; b++) {
+			pool.submit([&, b] {
+				decision->playOut(b % decision->moves.size(), BATCH, b);
+				if (--decision->remaining == 0) {
+					std::lock_guard lock(mutex);
+					done.notify_one();
+				}
+			});
+		}
+		std::unique_lock lock(mutex);
+		done.wait(lock, [&] { return decision->remaining == 0; });
+		return batches * BATCH / duration_cast<duration<double>>(steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char **argv) {
+	int rollouts = argc > 1 ? std::atoi(argv[1]) : 200000;
+	int players = argc > 2 ? std::atoi(argv[2]) : 10;
+	unsigned cores = std::max(std::thread::hardware_concurrency(), 1U);
+	fmt::print("{} player games, {} rollouts, {} cores\n\n", players, rollouts, cores);
+	fmt::print("{:>8} {:>16} {:>20}\n", "threads", "rollouts/s", "rollouts/s/thread");
+	double base = single(players, rollouts);
+	fmt::print("{:>8} {:>16.0f} {:>20.0f}\n", "inline", base, base);
+	for (unsigned threads = 1; threads <= 2 * cores; threads *= 2) {
+		double rate = pooled(players, rollouts, threads);
+		fmt::print("{:>8} {:>16.0f} {:>20.0f}\n", threads, rate, rate / threads);
+	}
+	return 0;
+}
@@ -0,0 +1,137 @@
+/** Game states per second: how fast a GameState copies and moves through transitions
+ *
+ * usage: statesBench [games] [players]
+ *
+ * Copies are of a state part way through a game, into a buffer too big for L1, so they are what a bot or
+ * the explorer pays for each branch. Transitions are random games played to the end, once on the bare
+ * GameState and once through GenericGame with callbacks that do nothing, which is the cost of dispatching
+ * the events.
+ */
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <fmt/core.h>
+#include "../manager.h"
+#include "../randomPlay.h"
+
+namespace {
+	class QuietComms {
+	public:
+		int players;
+
+		int getClientCount() const {
+			return players;
+		}
+
+		void successfulElection() {}
+		void failedElection() {}
+		void chaoticFascistPolicy() {}
+		void chaoticLiberalPolicy() {}
+		void regularFascistPolicy() {}
+		void regularLiberalPolicy() {}
+		void fascistPolicyWin() {}
+		void liberalPolicyWin() {}
+		void fascistHitlerWin() {}
+		void liberalHitlerWin() {}
+		void sendPresidentVetoOption() {}
+		void requestSpecialPresidentNomination() {}
+		void announceElection() {}
+		void announceDeath(int) {}
+		void requestChancellorNomination() {}
+		void requestInvestigation() {}
+		void requestKill() {}
+		void sendPresidentPolicyChoice() {}
+		void sendChancellorPolicyChoice() {}
+		void sendLoyalty(int, int, Team) {}
+		void sendTopCards(int) {}
+	};
+
+	// counts every transition playOut makes
+	template <typename Game>
+	struct Counting : Game {
+		size_t transitions = 0;
+
+		using Game::Game;
+
+		void nominateChancellor(int id) { transitions++; Game::nominateChancellor(id); }
+		void addVote(int id, Vote v) { transitions++; Game::addVote(id, v); }
+		void removePresidentPolicy(GameState::PolicyChoice p) { transitions++; Game::removePresidentPolicy(p); }
+		void removeChancellorPolicy(GameState::PolicyChoice p) { transitions++; Game::removeChancellorPolicy(p); }
+		void presidentVeto(bool accept) { transitions++; Game::presidentVeto(accept); }
+		void revealLoyalty(int id) { transitions++; Game::revealLoyalty(id); }
+		void useSpecialPresident(int id) { transitions++; Game::useSpecialPresident(id); }
+		void killPlayer(int id) { transitions++; Game::killPlayer(id); }
+	};
+
+	double seconds(std::chrono::steady_clock::time_point start) {
+		using namespace std::chrono;
+		return duration_cast<duration<double>>(steady_clock::now() - start).count();
+	}
+
+	void copies(int players, unsigned games) {
+		GameState root;
+		root.init(1, players);
+		root.start();
+		std::minstd_rand rng(1);
+		// a few moves in, so the deck and the players aren't as init left them
+		for (int i = 0; i < 3 && root.getState() == GameState::AWAITING_CHANCELLOR_NOMINATION; i++) {
+			root.nominateChancellor(pick(root.getEligibleChancellors(), rng));
+			for (int p = 0; p < players && root.getState() == GameState::VOTING; p++) {
+				root.addVote(p, NEIN);
+			}
+		}
+		// 64 KiB of states, so the copies go past L1
+		std::vector<GameState> buffer(1024);
+		size_t count = size_t(games) * 64;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < count; i++) {
+			std::memcpy(&buffer[i % buffer.size()], &root, sizeof(GameState));
+			// stops the copies being folded into one
+			asm volatile("" : : "r"(buffer.data()) : "memory");
+		}
+		double s = seconds(start);
+		fmt::print("{:<24} {:>14.0f} {:>12.1f}\n", "copy", count / s, s * 1e9 / count);
+	}
+
+	template <typename Game, typename Make>
+	void transitions(const char *name, unsigned games, Make make) {
+		size_t total = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned seed = 1; seed <= games; seed++) {
+			Counting<Game> game = make(seed);
+			std::minstd_rand rng(seed);
+			playOut(game, rng);
+			total += game.transitions;
+		}
+		double s = seconds(start);
+		fmt::print("{:<24} {:>14.0f} {:>12.1f}   ({:.1f} per game)\n", name, total / s, s * 1e9 / total,
+				double(total) / games);
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned games = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+	int players = argc > 2 ? std::atoi(argv[2]) : 10;
+	if (players < FIVE || players > MAX_PLAYERS) {
+		fmt::print("players must be between {} and {}\n", int(FIVE), MAX_PLAYERS);
+		return 1;
+	}
+	fmt::print("{} player games, {} bytes per state, {} games\n\n", players, sizeof(GameState), games);
+	fmt::print("{:<24} {:>14} {:>12}\n", "", "states/s", "ns/state");
+	copies(players, games);
+
+	transitions<GameState>("GameState", games, [players](unsigned seed) {
+		Counting<GameState> game;
+		game.init(seed, players);
+		game.start();
+		return game;
+	});
+	QuietComms comms{ players };
+	transitions<GenericGame<QuietComms>>("GenericGame", games, [&comms](unsigned seed) {
+		Counting<GenericGame<QuietComms>> game(comms);
+		game.init(seed);
+		game.start();
+		return game;
+	});
+	return 0;
+}
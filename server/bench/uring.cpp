@@ -0,0 +1,321 @@
+/** System calls and latency per game event, writing the fan-out one send at a time or as one io_uring batch
+ *
+ * usage: uringBench [connections] [games]
+ *
+ * Games of 10 are played through Manager with random legal moves, and every frame each transition sends
+ * is recorded with its recipient and a WebSocket header. The transitions are then replayed onto real TCP
+ * connections over loopback, most of them idle, in two ways:
+ * - epoll: a send() per frame, which is what uSockets' default backend does for an uncorked socket
+ * - io_uring: a send SQE per frame and one io_uring_enter for the whole transition, which is what a
+ *   backend that submits once per loop iteration does, since a transition runs inside one message handler
+ * Latency is from a transition's first write to the kernel taking its last one. Receivers are drained
+ * between games, outside the timing.
+ *
+ * The server itself still sends through uSockets' epoll backend: the uSockets the uWebSockets submodule
+ * pins has no io_uring one. This measures what moving to a uSockets with that backend would save.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fmt/core.h>
+#include "../bot.h"
+#include "../slotMap.h"
+
+namespace {
+	constexpr int PLAYERS = 10;
+	constexpr unsigned RING_ENTRIES = 256;
+
+	struct Send {
+		int seat;
+		std::string frame;
+	};
+
+	using Transition = std::vector<Send>;
+
+	struct alignas(8) RecordingSocket {
+		UserData<RecordingSocket> data;
+		int seat = 0;
+		static inline Transition *current = nullptr;
+
+		void *getUserData() {
+			return &data;
+		}
+
+		bool send(std::string_view message, uWS::OpCode, bool) {
+			// unmasked binary frames, as a server writes them
+			std::string frame;
+			frame.push_back(static_cast<char>(0x82));
+			if (message.size() < 126) {
+				frame.push_back(static_cast<char>(message.size()));
+			} else {
+				frame.push_back(126);
+				frame.push_back(static_cast<char>(message.size() >> 8));
+				frame.push_back(static_cast<char>(message.size()));
+			}
+			frame.append(message);
+			current->push_back({ seat, std::move(frame) });
+			return true;
+		}
+
+		template <typename F>
+		void cork(F &&f) {
+			f();
+		}
+
+		void end(int) {
+		}
+	};
+
+	std::vector<std::vector<Transition>> record(unsigned games) {
+		SlotMap<RecordingSocket> managers;
+		static RecordingSocket sockets[PLAYERS];
+		std::vector<std::vector<Transition>> recorded;
+		Transition setup;
+		RecordingSocket::current = &setup;
+		for (unsigned seed = 1; seed <= games; seed++) {
+			std::minstd_rand rng(seed);
+			auto key = *managers.getSlot();
+			Manager<RecordingSocket> &m = managers[key].value();
+			for (int i = 0; i < PLAYERS; i++) {
+				new (&sockets[i].data) UserData<RecordingSocket>;
+				sockets[i].seat = i;
+				sockets[i].data.socket = &sockets[i];
+				sockets[i].data.playerId = m.addClient(&sockets[i]);
+				sockets[i].data.manager = &m;
+			}
+			for (int i = 0; i < PLAYERS; i++) {
+				char ready = static_cast<char>(bots::move(bots::OTHER, 5));
+				m.handleMessage(i, std::string_view(&ready, 1));
+			}
+			auto &game = m.getGame();
+			auto &transitions = recorded.emplace_back();
+			std::vector<std::pair<int, uint8_t>> options;
+			while (game.getState() < GameState::LIBERAL_POLICY_WIN) {
+				options.clear();
+				for (int seat = 0; seat < PLAYERS; seat++) {
+					for (auto move : bots::legalMoves(game, seat)) {
+						options.emplace_back(seat, move);
+					}
+				}
+				auto [seat, move] = options[rng() % options.size()];
+				RecordingSocket::current = &transitions.emplace_back();
+				char message = static_cast<char>(move);
+				m.handleMessage(seat, std::string_view(&message, 1));
+				if (transitions.back().empty()) {
+					transitions.pop_back();
+				}
+			}
+			RecordingSocket::current = &setup;
+			for (int i = 0; i < PLAYERS; i++) {
+				sockets[i].data.~UserData();
+				m.onDisconnect(i, 1000);
+			}
+			setup.clear();
+		}
+		return recorded;
+	}
+
+	// both ends of `count` loopback connections
+	void connectAll(size_t count, std::vector<int> &servers, std::vector<int> &clients) {
+		int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t length = sizeof(addr);
+		if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) || listen(listener, 4096)
+				|| getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &length)) {
+			throw std::runtime_error("can't listen on loopback");
+		}
+		for (size_t i = 0; i < count; i++) {
+			int c = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			if (c < 0 || connect(c, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+				throw std::runtime_error(fmt::format("connection {} failed: {}", i, strerror(errno)));
+			}
+			clients.push_back(c);
+			servers.push_back(accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK));
+		}
+		close(listener);
+	}
+
+	/** Just enough of io_uring for sends, through the raw system calls
+	 *
+	 * send() queues a SQE without entering the kernel, and submit() hands over everything queued and waits
+	 * for it in one io_uring_enter.
+	 */
+	class Ring {
+		int fd;
+		unsigned *sqTail;
+		unsigned sqMask;
+		unsigned *sqArray;
+		io_uring_sqe *sqes;
+		unsigned *cqHead;
+		unsigned *cqTail;
+		unsigned cqMask;
+		io_uring_cqe *cqes;
+		unsigned queued = 0;
+
+	public:
+		explicit Ring(unsigned entries) {
+			io_uring_params p = {};
+			fd = syscall(__NR_io_uring_setup, entries, &p);
+			if (fd < 0) {
+				throw std::runtime_error(fmt::format("io_uring_setup: {}", strerror(errno)));
+			}
+			size_t sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+			size_t cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+			bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+			if (single) {
+				sqSize = cqSize = std::max(sqSize, cqSize);
+			}
+			auto *sq = static_cast<char *>(mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+					IORING_OFF_SQ_RING));
+			auto *cq = single ? sq : static_cast<char *>(mmap(nullptr, cqSize, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING));
+			sqes = static_cast<io_uring_sqe *>(mmap(nullptr, p.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+			sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+			sqMask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+			sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+			cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+			cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+			cqMask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+			cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+		}
+
+		void send(int socket, const std::string &frame) {
+			unsigned tail = *sqTail;
+			unsigned i = tail & sqMask;
+			auto &sqe = sqes[i];
+			std::memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = IORING_OP_SEND;
+			sqe.fd = socket;
+			sqe.addr = reinterpret_cast<uint64_t>(frame.data());
+			sqe.len = frame.size();
+			sqe.msg_flags = MSG_NOSIGNAL;
+			sqArray[i] = i;
+			__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+			queued++;
+		}
+
+		// returns how many sends fell short
+		unsigned submit() {
+			syscall(__NR_io_uring_enter, fd, queued, queued, IORING_ENTER_GETEVENTS, nullptr, 0);
+			unsigned failed = 0;
+			unsigned head = *cqHead;
+			while (queued > 0 && head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+				auto &cqe = cqes[head & cqMask];
+				failed += cqe.res <= 0;
+				head++;
+				queued--;
+			}
+			__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+			return failed;
+		}
+	};
+
+	struct Results {
+		uint64_t events = 0;
+		uint64_t syscalls = 0;
+		uint64_t failed = 0;
+		std::vector<int64_t> nanos;
+	};
+
+	template <bool URING>
+	Results replay(const std::vector<std::vector<Transition>> &games, const std::vector<int> &servers,
+			const std::vector<int> &clients) {
+		using namespace std::chrono;
+		std::optional<Ring> ring;
+		if constexpr (URING) {
+			ring.emplace(RING_ENTRIES);
+		}
+		Results results;
+		char drain[65536];
+		size_t tables = servers.size() / PLAYERS;
+		for (size_t g = 0; g < games.size(); g++) {
+			// games are spread over the connections, so most sit idle
+			size_t first = (g * 7919 % tables) * PLAYERS;
+			for (auto &transition : games[g]) {
+				auto start = steady_clock::now();
+				if constexpr (URING) {
+					for (auto &send : transition) {
+						ring->send(servers[first + send.seat], send.frame);
+					}
+					results.failed += ring->submit();
+					results.syscalls++;
+				} else {
+					for (auto &send : transition) {
+						auto sent = ::send(servers[first + send.seat], send.frame.data(), send.frame.size(), MSG_NOSIGNAL);
+						results.failed += sent <= 0;
+						results.syscalls++;
+					}
+				}
+				results.nanos.push_back(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+				results.events++;
+			}
+			for (int seat = 0; seat < PLAYERS; seat++) {
+				while (recv(clients[first + seat], drain, sizeof(drain), MSG_DONTWAIT) > 0) {
+				}
+			}
+		}
+		return results;
+	}
+
+	int64_t percentile(std::vector<int64_t> &v, double p) {
+		auto i = static_cast<size_t>(p * (v.size() - 1));
+		std::nth_element(v.begin(), v.begin() + i, v.end());
+		return v[i];
+	}
+
+	void print(const char *name, Results r) {
+		double mean = 0;
+		for (auto n : r.nanos) {
+			mean += n;
+		}
+		mean /= r.nanos.size();
+		fmt::print("{:<9} {:>9} {:>16.2f} {:>9.0f} {:>8} {:>8} {:>7}\n", name, r.events, double(r.syscalls) / r.events,
+				mean, percentile(r.nanos, 0.5), percentile(r.nanos, 0.99), r.failed);
+	}
+}
+
+int main(int argc, char **argv) {
+	size_t connections = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5000;
+	unsigned games = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000;
+	connections = std::max<size_t>(PLAYERS, connections / PLAYERS * PLAYERS);
+
+	auto recorded = record(games);
+	size_t frames = 0, events = 0;
+	for (auto &game : recorded) {
+		for (auto &transition : game) {
+			frames += transition.size();
+			events++;
+		}
+	}
+	std::vector<int> servers, clients;
+	connectAll(connections, servers, clients);
+	fmt::print("{} games of {} on {} loopback connections, {:.1f} frames per event\n\n", games, PLAYERS, connections,
+			double(frames) / events);
+	fmt::print("{:<9} {:>9} {:>16} {:>9} {:>8} {:>8} {:>7}\n", "", "events", "syscalls/event", "mean ns", "p50 ns",
+			"p99 ns", "failed");
+	// twice each, alternating, so neither gets the cold caches
+	for (int round = 0; round < 2; round++) {
+		auto epoll = replay<false>(recorded, servers, clients);
+		auto uring = replay<true>(recorded, servers, clients);
+		if (round == 1) {
+			print("epoll", std::move(epoll));
+			print("io_uring", std::move(uring));
+		}
+	}
+	return 0;
+}
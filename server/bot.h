@@ -0,0 +1,354 @@
+#ifndef SERVER_BOT_H
+#define SERVER_BOT_H
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+#include "manager.h"
+#include "gameState.h"
+#include "randomPlay.h"
+#include "workPool.h"
+
+/** Monte Carlo play for bots: copies of a game's state, played out at random
+ *
+ * Moves are the first byte of the client message that makes them, so a bot answers exactly as a client would.
+ */
+namespace bots {
+	// the low 3 bits pick the action and the rest its argument, as in Manager::dispatch
+	constexpr uint8_t move(int action, int argument) {
+		return static_cast<uint8_t>(argument << 3 | action);
+	}
+
+	enum Action {
+		NOMINATE = 0,
+		DISCARD = 1,
+		INVESTIGATE = 2,
+		KILL = 3,
+		SPECIAL_ELECTION = 4,
+		OTHER = 7,
+	};
+
+	constexpr uint8_t VOTE_JA = move(OTHER, 0);
+	constexpr uint8_t VOTE_NEIN = move(OTHER, 1);
+	constexpr uint8_t ACCEPT_VETO = move(OTHER, 2);
+	constexpr uint8_t REJECT_VETO = move(OTHER, 3);
+	constexpr uint8_t SET_NAME = move(OTHER, 4);
+
+	// every move `seat` can make right now, which is none if it isn't their turn
+	inline std::vector<uint8_t> legalMoves(const GameState &game, int seat) {
+		std::vector<uint8_t> moves;
+		auto each = [&moves](PlayerMask targets, int action) {
+			for (size_t i = 0; i < targets.size(); i++) {
+				if (targets[i]) {
+					moves.push_back(move(action, i));
+				}
+			}
+		};
+		bool president = seat == game.getPresidentId();
+		bool chancellor = seat == game.getChancellorId();
+		auto others = game.alive();
+		others[seat] = false;
+		switch (game.getState()) {
+			case GameState::AWAITING_CHANCELLOR_NOMINATION:
+				if (president) {
+					each(game.getEligibleChancellors(), NOMINATE);
+				}
+				break;
+			case GameState::VOTING:
+				if (game.alive()[seat] && !game.hasVoted(seat)) {
+					moves = { VOTE_JA, VOTE_NEIN };
+				}
+				break;
+			case GameState::AWAITING_PRESIDENT_POLICY:
+				if (president) {
+					moves = { move(DISCARD, 0), move(DISCARD, 1), move(DISCARD, 2) };
+				}
+				break;
+			case GameState::AWAITING_CHANCELLOR_POLICY:
+			case GameState::AWAITING_CHANCELLOR_POLICY_NO_VETO:
+				if (chancellor) {
+					moves = { move(DISCARD, 0), move(DISCARD, 1) };
+					if (game.getState() == GameState::AWAITING_CHANCELLOR_POLICY && game.getFascistPolicies() == 5) {
+						moves.push_back(move(DISCARD, GameState::VETO));
+					}
+				}
+				break;
+			case GameState::AWAITING_VETO:
+				if (president) {
+					moves = { ACCEPT_VETO, REJECT_VETO };
+				}
+				break;
+			case GameState::AWAITING_ALLEGIENCE_PEEK_CHOICE:
+				if (president) {
+					each(game.eligibleForInvestigation(), INVESTIGATE);
+				}
+				break;
+			case GameState::AWAITING_SPECIAL_PRESIDENT_CHOICE:
+				if (president) {
+					each(others, SPECIAL_ELECTION);
+				}
+				break;
+			case GameState::AWAITING_KILL_CHOICE:
+				if (president) {
+					each(others, KILL);
+				}
+				break;
+			default:
+				break;
+		}
+		return moves;
+	}
+
+	inline Events applyMove(GameState &game, int seat, uint8_t m) {
+		int argument = m >> 3;
+		switch (m & 7) {
+			case NOMINATE:
+				return game.nominateChancellor(argument);
+			case DISCARD:
+				if (game.getState() == GameState::AWAITING_PRESIDENT_POLICY) {
+					return game.removePresidentPolicy(static_cast<GameState::PolicyChoice>(argument));
+				}
+				return game.removeChancellorPolicy(static_cast<GameState::PolicyChoice>(argument));
+			case INVESTIGATE:
+				return game.revealLoyalty(argument);
+			case KILL:
+				return game.killPlayer(argument);
+			case SPECIAL_ELECTION:
+				return game.useSpecialPresident(argument);
+			default:
+				break;
+		}
+		switch (m) {
+			case VOTE_JA:
+				return game.addVote(seat, JA);
+			case VOTE_NEIN:
+				return game.addVote(seat, NEIN);
+			case ACCEPT_VETO:
+			case REJECT_VETO:
+				return game.presidentVeto(m == ACCEPT_VETO);
+			default:
+				return {};
+		}
+	}
+
+	inline Team winner(GameState::State state) {
+		return state == GameState::LIBERAL_POLICY_WIN || state == GameState::LIBERAL_HITLER_WIN ? LIBERAL : FASCIST;
+	}
+
+	// changes whenever the game moves on to someone else's decision
+	inline uint64_t turnOf(const GameState &game) {
+		return static_cast<uint64_t>(game.getState()) | static_cast<uint64_t>(game.getPresidentId() & 31) << 4
+				| static_cast<uint64_t>(game.getChancellorId() & 31) << 9 | static_cast<uint64_t>(game.getLiberalPolicies()) << 14
+				| static_cast<uint64_t>(game.getFascistPolicies()) << 17 | static_cast<uint64_t>(game.getElectionTracker()) << 20;
+	}
+
+	/** One choice a bot has to make, shared by the batches of rollouts that score it
+	 *
+	 * The state is copied once on the loop, and every rollout copies it again and re-deals what the seat
+	 * can't see before playing a move and then random moves for everyone to the end.
+	 */
+	struct Decision {
+		GameState root;
+		int seat;
+		PlayerMask known;
+		uint64_t turn;
+		Team team;
+		std::vector<uint8_t> moves;
+		// games won by the seat's team after each move
+		std::unique_ptr<std::atomic<int>[]> wins;
+		std::atomic<size_t> remaining{0};
+
+		Decision(const GameState &game, int seat, PlayerMask known) : root(game), seat(seat), known(known),
+				turn(turnOf(game)), team(root.getTeams()[seat] ? LIBERAL : FASCIST), moves(legalMoves(root, seat)),
+				wins(new std::atomic<int>[moves.size()]()) {
+		}
+
+		void playOut(size_t m, int rollouts, unsigned seed) {
+			std::minstd_rand rng(seed);
+			int won = 0;
+			for (int i = 0; i < rollouts; i++) {
+				GameState game = root;
+				game.redeal(seat, known, rng);
+				applyMove(game, seat, moves[m]);
+				::playOut(game, rng);
+				won += winner(game.getState()) == team;
+			}
+			wins[m] += won;
+		}
+
+		uint8_t best() const {
+			size_t best = 0;
+			for (size_t m = 1; m < moves.size(); m++) {
+				if (wins[m] > wins[best]) {
+					best = m;
+				}
+			}
+			return moves[best];
+		}
+	};
+}
+
+template <typename Socket>
+class BotPool;
+
+/** A bot in one seat of a game
+ *
+ * Whenever a frame arrives, the bot looks at the game on the next turn of the loop. If it has a choice to
+ * make, the game is copied and scored on the pool's workers, and the best move is played back on the loop
+ * through Loop::defer, so the loop never waits on a bot. A move is dropped if the game has moved on by the
+ * time it is ready.
+ *
+ * Bots only use what their seat would know: their own team, the other fascists if they are told who those
+ * are, and the loyalty of players they investigated.
+ */
+template <typename Socket>
+class Bot final : public BotSeat, public std::enable_shared_from_this<Bot<Socket>> {
+	Manager<Socket> &manager;
+	BotPool<Socket> &pool;
+	// the seat's reference, dropped by end(); decisions in flight hold their own
+	std::shared_ptr<Bot> self;
+	int seat = -1;
+	PlayerMask investigated;
+	bool ended = false;
+	bool scheduled = false;
+	bool thinking = false;
+
+	PlayerMask known(const GameState &game) {
+		PlayerMask result = investigated;
+		result[seat] = true;
+		// fascists know each other, and Hitler is only told who the fascist is in games of five or six
+		bool fascist = !game.getTeams()[seat];
+		if (fascist && (seat != game.getHitler() || manager.getClientCount() <= SIX)) {
+			result.set();
+		}
+		return result;
+	}
+
+	void schedule() {
+		if (scheduled || ended) {
+			return;
+		}
+		scheduled = true;
+		pool.defer([bot = this->shared_from_this()] { bot->act(); });
+	}
+
+	void act() {
+		scheduled = false;
+		if (ended || thinking || seat < 0) {
+			return;
+		}
+		auto &game = manager.getGame();
+		auto decision = std::make_shared<bots::Decision>(game, seat, known(game));
+		if (decision->moves.empty()) {
+			return;
+		}
+		if (decision->moves.size() == 1) {
+			return play(decision->moves[0]);
+		}
+		thinking = true;
+		pool.think(decision, [bot = this->shared_from_this(), decision] { bot->decide(*decision); });
+	}
+
+	void decide(const bots::Decision &decision) {
+		thinking = false;
+		if (ended) {
+			return;
+		}
+		if (bots::turnOf(manager.getGame()) != decision.turn) {
+			return schedule();
+		}
+		play(decision.best());
+	}
+
+	void play(uint8_t move) {
+		char message = static_cast<char>(move);
+		manager.handleMessage(seat, std::string_view(&message, 1));
+	}
+
+public:
+	Bot(Manager<Socket> &manager, BotPool<Socket> &pool) : manager(manager), pool(pool) {
+	}
+
+	void sit(int id, std::shared_ptr<Bot> owner) {
+		seat = id;
+		self = std::move(owner);
+		schedule();
+	}
+
+	void receive(std::string_view message) override {
+		// the president alone is sent the loyalty they investigated, as a second byte
+		auto first = static_cast<unsigned char>(message[0]);
+		if (message.size() == 2 && (first & 15) == Protocol::SEND_LOYALTY) {
+			investigated[first >> 4] = true;
+		}
+		schedule();
+	}
+
+	void setId(int id) override {
+		seat = id;
+	}
+
+	void end(int) override {
+		ended = true;
+		// may destroy this bot, so nothing can follow it
+		auto released = std::move(self);
+	}
+};
+
+/** The workers that bots think on, and how hard they think
+ *
+ * Every move a bot has is scored with `rolloutsPerMove` random games, split into batches of BATCH so that
+ * idle workers can steal part of a decision.
+ */
+template <typename Socket>
+class BotPool {
+	uWS::Loop *loop;
+	int rolloutsPerMove;
+	// only used on the loop
+	std::minstd_rand seeds;
+	// last, so the workers are joined before anything they use is destroyed
+	WorkPool workers;
+
+public:
+	static constexpr int BATCH = 64;
+
+	BotPool(unsigned threads, int rolloutsPerMove) : loop(uWS::Loop::get()), rolloutsPerMove(rolloutsPerMove),
+			seeds(GameState::timeSeed()), workers(threads) {
+	}
+
+	// seats `count` bots in a game that hasn't started
+	void fill(Manager<Socket> &m, int count) {
+		for (int k = 0; k < count; k++) {
+			auto bot = std::make_shared<Bot<Socket>>(m, *this);
+			int id = m.addBot(bot.get());
+			if (id < 0) {
+				return;
+			}
+			bot->sit(id, bot);
+			char name[] = { static_cast<char>(bots::SET_NAME), 'B', 'o', 't', ' ', static_cast<char>('1' + k) };
+			m.handleMessage(id, std::string_view(name, sizeof(name)));
+		}
+	}
+
+	void think(const std::shared_ptr<bots::Decision> &decision, std::function<void()> done) {
+		int batches = (rolloutsPerMove + BATCH - 1) / BATCH;
+		decision->remaining = batches * decision->moves.size();
+		for (size_t m = 0; m < decision->moves.size(); m++) {
+			for (int b = 0; b < batches; b++) {
+				workers.submit([this, decision, m, seed = seeds(), done] {
+					decision->playOut(m, BATCH, seed);
+					if (--decision->remaining == 0) {
+						loop->defer(done);
+					}
+				});
+			}
+		}
+	}
+
+	void defer(std::function<void()> f) {
+		loop->defer(std::move(f));
+	}
+};
+
+#endif //SERVER_BOT_H
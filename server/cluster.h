@@ -0,0 +1,247 @@
+#ifndef SERVER_CLUSTER_H
+#define SERVER_CLUSTER_H
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cinttypes>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fmt/format.h>
+
+/** Servers on several machines behind one coordinator
+ *
+ * Each node is a server started with SH_NODE=i and SH_NODES=n, where i is its place in the coordinator's
+ * SH_CLUSTER list. Its keys carry i in their major index (see processes.h), so the coordinator can tell a
+ * game's node from its key alone and keeps no per-game state. The coordinator answers every upgrade by
+ * closing it with REDIRECT and "host:port" as the reason: a /join, /spectate or /delayed goes to the node
+ * that holds the game, a /create to the node with the fewest live games, and /quickplay always to the
+ * first node that is up, whose workers send it on to their first one, so waiting players share one queue.
+ *
+ * Live games come from each node's /metrics (created minus destroyed), polled every SH_POLL_MS. Between
+ * polls the coordinator adds the games it has sent each node, so a burst of creates doesn't all land on
+ * the node that was emptiest at the last poll. A node whose poll fails gets no new games until one works.
+ * The shared port reaches one worker at random, so on a node running several worker processes, every
+ * worker is scraped on its own port and their games are added up.
+ */
+namespace cluster {
+	struct Node {
+		std::string host;
+		int port;
+
+		std::string address() const {
+			return fmt::format("{}:{}", host, port);
+		}
+	};
+
+	// "host:port,host:port,..."
+	inline std::vector<Node> parseNodes(std::string_view list) {
+		std::vector<Node> nodes;
+		while (!list.empty()) {
+			auto end = std::min(list.find(','), list.size());
+			auto entry = list.substr(0, end);
+			auto colon = entry.rfind(':');
+			if (colon != std::string_view::npos && colon > 0) {
+				nodes.push_back({ std::string(entry.substr(0, colon)), std::atoi(std::string(entry.substr(colon + 1)).c_str()) });
+			}
+			list.remove_prefix(std::min(end + 1, list.size()));
+		}
+		return nodes;
+	}
+
+	inline std::optional<int64_t> counter(std::string_view metrics, std::string_view name) {
+		for (size_t start = 0; start < metrics.size();) {
+			auto end = std::min(metrics.find('\n', start), metrics.size());
+			auto line = metrics.substr(start, end - start);
+			if (line.size() > name.size() && line.substr(0, name.size()) == name && line[name.size()] == ' ') {
+				return std::strtoll(std::string(line.substr(name.size() + 1)).c_str(), nullptr, 10);
+			}
+			start = end + 1;
+		}
+		return {};
+	}
+
+	inline std::optional<int64_t> liveGames(std::string_view metrics) {
+		auto created = counter(metrics, "sh_games_created_total");
+		auto destroyed = counter(metrics, "sh_games_destroyed_total");
+		if (!created || !destroyed) {
+			return {};
+		}
+		return *created - *destroyed;
+	}
+
+	/** A blocking HTTP GET, for the poller thread; the body of a 200 response, or nothing
+	 *
+	 * uWS always sends a Content-Length, so the response ends there rather than at the connection's end.
+	 */
+	inline std::optional<std::string> fetch(const Node &node, std::string_view path, int timeoutMillis) {
+		addrinfo hints = {};
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		addrinfo *found;
+		if (getaddrinfo(node.host.c_str(), std::to_string(node.port).c_str(), &hints, &found)) {
+			return {};
+		}
+		int fd = socket(found->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		timeval timeout = { timeoutMillis / 1000, timeoutMillis % 1000 * 1000 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		bool connected = fd >= 0 && connect(fd, found->ai_addr, found->ai_addrlen) == 0;
+		freeaddrinfo(found);
+		if (!connected) {
+			if (fd >= 0) {
+				close(fd);
+			}
+			return {};
+		}
+		auto request = fmt::format("GET {} HTTP/1.1\r\nHost: {}\r\nConnection: close\r\n\r\n", path, node.host);
+		send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+
+		std::string response;
+		size_t bodyStart = std::string::npos;
+		size_t length = std::string::npos;
+		char chunk[4096];
+		while (bodyStart == std::string::npos || length == std::string::npos || response.size() < bodyStart + length) {
+			auto n = read(fd, chunk, sizeof(chunk));
+			if (n <= 0) {
+				break;
+			}
+			response.append(chunk, n);
+			if (bodyStart != std::string::npos) {
+				continue;
+			}
+			auto headEnd = response.find("\r\n\r\n");
+			if (headEnd == std::string::npos) {
+				continue;
+			}
+			bodyStart = headEnd + 4;
+			std::string head = response.substr(0, headEnd);
+			std::transform(head.begin(), head.end(), head.begin(), [](unsigned char c) { return std::tolower(c); });
+			auto header = head.find("\r\ncontent-length:");
+			if (header != std::string::npos) {
+				length = std::strtoul(head.c_str() + header + 17, nullptr, 10);
+			}
+		}
+		close(fd);
+		if (bodyStart == std::string::npos || response.compare(0, 12, "HTTP/1.1 200") != 0) {
+			return {};
+		}
+		return response.substr(bodyStart, length);
+	}
+
+	/** Picks the node for each new game
+	 *
+	 * The poller thread reports each node's live games, and the event loop thread picks. What the loop has
+	 * sent a node since that node's last report is the loop's alone, so the two threads share nothing but
+	 * a count and a report number per node.
+	 */
+	class Balancer {
+		struct alignas(64) Report {
+			// -1 while the node is down
+			std::atomic<int64_t> games{-1};
+			std::atomic<uint32_t> number{0};
+		};
+
+		size_t count;
+		std::unique_ptr<Report[]> reports;
+		std::vector<int64_t> sent;
+		std::vector<uint32_t> seen;
+
+	public:
+		explicit Balancer(size_t count) : count(count), reports(new Report[count]), sent(count), seen(count) {
+		}
+
+		size_t size() const {
+			return count;
+		}
+
+		// poller thread
+		void report(size_t node, std::optional<int64_t> games) {
+			reports[node].games.store(games.value_or(-1), std::memory_order_relaxed);
+			reports[node].number.fetch_add(1, std::memory_order_release);
+		}
+
+		int64_t reported(size_t node) const {
+			return reports[node].games.load(std::memory_order_relaxed);
+		}
+
+		// event loop thread: the node that is up with the fewest games, counting the ones sent since its last report
+		std::optional<size_t> pick() {
+			std::optional<size_t> best;
+			int64_t fewest = INT64_MAX;
+			for (size_t i = 0; i < count; i++) {
+				auto number = reports[i].number.load(std::memory_order_acquire);
+				if (number != seen[i]) {
+					seen[i] = number;
+					sent[i] = 0;
+				}
+				auto games = reported(i);
+				if (games < 0) {
+					continue;
+				}
+				if (games + sent[i] < fewest) {
+					fewest = games + sent[i];
+					best = i;
+				}
+			}
+			if (best) {
+				sent[*best]++;
+			}
+			return best;
+		}
+
+		// event loop thread: the first node that is up
+		std::optional<size_t> first() const {
+			for (size_t i = 0; i < count; i++) {
+				if (reported(i) >= 0) {
+					return i;
+				}
+			}
+			return {};
+		}
+	};
+
+	/** A node's live games, given the /metrics of whichever worker its shared port reached
+	 *
+	 * That worker names the others' own ports, and each of them is asked for its games. A worker that
+	 * doesn't answer, such as one being restarted, counts as empty; the node is down if none answer.
+	 */
+	inline std::optional<int64_t> nodeGames(const Node &node, std::string_view metrics, int timeoutMillis) {
+		auto workers = counter(metrics, "sh_workers");
+		auto firstPort = counter(metrics, "sh_first_worker_port");
+		if (!workers || *workers <= 1 || !firstPort) {
+			return liveGames(metrics);
+		}
+		std::optional<int64_t> total;
+		for (int64_t i = 0; i < *workers; i++) {
+			auto own = fetch({ node.host, static_cast<int>(*firstPort + i) }, "/metrics", timeoutMillis);
+			if (auto games = own ? liveGames(*own) : std::nullopt) {
+				total = total.value_or(0) + *games;
+			}
+		}
+		return total;
+	}
+
+	// polls every node until `stop` is set, with the timeout for each poll a quarter of the interval
+	inline void poll(const std::vector<Node> &nodes, Balancer &balancer, uint32_t intervalMillis,
+			const std::atomic<bool> &stop) {
+		while (!stop.load(std::memory_order_relaxed)) {
+			auto start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < nodes.size(); i++) {
+				int timeout = std::max(1U, intervalMillis / 4);
+				auto metrics = fetch(nodes[i], "/metrics", timeout);
+				balancer.report(i, metrics ? nodeGames(nodes[i], *metrics, timeout) : std::nullopt);
+			}
+			std::this_thread::sleep_until(start + std::chrono::milliseconds(intervalMillis));
+		}
+	}
+}
+
+#endif //SERVER_CLUSTER_H
@@ -1,5 +1,17 @@
 #ifndef SERVER_COMMON_H
 #define SERVER_COMMON_H
+#include <bitset>
+
+// the largest game the server is built for; player ids are sent as 4 bit nibbles, so it can be at most 16
+#ifndef SH_MAX_PLAYERS
+#define SH_MAX_PLAYERS 10
+#endif
+
+constexpr int MAX_PLAYERS = SH_MAX_PLAYERS;
+static_assert(MAX_PLAYERS >= 10 && MAX_PLAYERS <= 16, "SH_MAX_PLAYERS must be between 10 and 16");
+
+// one bit per seat
+using PlayerMask = std::bitset<MAX_PLAYERS>;
 
 enum GameType {
 	FIVE = 5,
@@ -7,7 +19,13 @@ enum GameType {
 	SEVEN,
 	EIGHT,
 	NINE,
-	TEN
+	TEN,
+	ELEVEN,
+	TWELVE,
+	THIRTEEN,
+	FOURTEEN,
+	FIFTEEN,
+	SIXTEEN
 };
 
 enum Vote {
@@ -35,6 +53,18 @@ inline constexpr int getPlayerCount() {
 			return 9;
 		case TEN:
 			return 10;
+		case ELEVEN:
+			return 11;
+		case TWELVE:
+			return 12;
+		case THIRTEEN:
+			return 13;
+		case FOURTEEN:
+			return 14;
+		case FIFTEEN:
+			return 15;
+		case SIXTEEN:
+			return 16;
 		default:
 			return -1;
 	}
@@ -0,0 +1,43 @@
+#ifndef SERVER_COMPRESSION_H
+#define SERVER_COMPRESSION_H
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <App.h> // uWebSockets
+
+/** When to use permessage-deflate
+ *
+ * Nearly every frame the server sends is 1 to 5 bytes, which deflate can only make bigger, so frames
+ * below the threshold are always sent uncompressed. Larger frames (rosters) are compressed with the
+ * compressor chosen by `options`, if any.
+ *
+ * SH_COMPRESSION: off (default), shared or dedicated
+ * SH_COMPRESSION_THRESHOLD: the smallest frame, in bytes, that is compressed
+ */
+struct CompressionPolicy {
+	uWS::CompressOptions options = uWS::DISABLED;
+	unsigned threshold = 64;
+
+	bool shouldCompress(std::string_view frame) const {
+		return options != uWS::DISABLED && frame.size() >= threshold;
+	}
+
+	static CompressionPolicy fromEnvironment() {
+		CompressionPolicy policy;
+		if (const char *mode = getenv("SH_COMPRESSION")) {
+			if (!strcmp(mode, "shared")) {
+				policy.options = uWS::SHARED_COMPRESSOR;
+			} else if (!strcmp(mode, "dedicated")) {
+				policy.options = uWS::DEDICATED_COMPRESSOR;
+			}
+		}
+		if (const char *threshold = getenv("SH_COMPRESSION_THRESHOLD")) {
+			policy.threshold = std::strtoul(threshold, nullptr, 10);
+		}
+		return policy;
+	}
+};
+
+inline CompressionPolicy compressionPolicy;
+
+#endif //SERVER_COMPRESSION_H
@@ -0,0 +1,99 @@
+#include <fmt/format.h>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <App.h> // uWebSockets
+#include <ignore.h>
+#include "cluster.h"
+#include "gameKey.h"
+#include "processes.h"
+
+/** Sends each client to the node of a cluster that should have it; see cluster.h
+ *
+ * SH_CLUSTER: the nodes, as host:port,host:port,... in the order of their SH_NODE
+ * SH_PORT: where clients connect, 4545 by default
+ * SH_POLL_MS: how often each node's /metrics is read, 1000 by default
+ */
+int main() {
+	const char *clusterKey = "SH_CLUSTER";
+	const char *list = getenv(clusterKey);
+	auto nodes = cluster::parseNodes(list ? list : "");
+	if (nodes.empty()) {
+		std::cerr << "SH_CLUSTER must list the nodes, as host:port,host:port,..." << std::endl;
+		return 1;
+	}
+	const char *portKey = "SH_PORT";
+	const char *port = getenv(portKey);
+	const char *pollKey = "SH_POLL_MS";
+	const char *poll = getenv(pollKey);
+	uint32_t pollMillis = poll ? std::max(1UL, std::strtoul(poll, nullptr, 10)) : 1000;
+
+	cluster::Balancer balancer(nodes.size());
+	std::atomic<bool> stop{false};
+	std::thread poller(cluster::poll, std::cref(nodes), std::ref(balancer), pollMillis, std::cref(stop));
+
+	std::vector<std::string> addresses;
+	for (auto &node : nodes) {
+		addresses.push_back(node.address());
+	}
+	uint64_t redirects = 0;
+	uint64_t refused = 0;
+
+	using WebSocket = uWS::WebSocket<false, true>;
+	struct Empty {
+	};
+	auto redirect = [&](WebSocket *ws, std::optional<size_t> node) {
+		if (!node) {
+			refused++;
+			ws->end(4503);
+			return;
+		}
+		redirects++;
+		ws->end(processes::REDIRECT, addresses[*node]);
+	};
+	// keys that decode to a game go to its node, whether or not the game is still there
+	auto toOwner = [&](WebSocket *ws, uWS::HttpRequest *req) {
+		auto id = gameKey::decode(req->getParameter(0));
+		if (!id) {
+			ws->end(4500);
+			return;
+		}
+		redirect(ws, processes::nodeOf(*id, nodes.size()));
+	};
+
+	uWS::App().ws<Empty>("/create", {
+		.open = [&](WebSocket *ws, uWS::HttpRequest *req) {
+			ignoreUnused(req);
+			redirect(ws, balancer.pick());
+		}
+	}).ws<Empty>("/quickplay", {
+		.open = [&](WebSocket *ws, uWS::HttpRequest *req) {
+			ignoreUnused(req);
+			redirect(ws, balancer.first());
+		}
+	}).ws<Empty>("/join/:game", {
+		.open = toOwner
+	}).ws<Empty>("/spectate/:game", {
+		.open = toOwner
+	}).ws<Empty>("/delayed/:game", {
+		.open = toOwner
+	}).get("/metrics", [&](auto *res, uWS::HttpRequest *req) {
+		ignoreUnused(req);
+		std::string out;
+		auto it = std::back_inserter(out);
+		fmt::format_to(it, "# TYPE sh_cluster_node_games gauge\n");
+		for (size_t i = 0; i < nodes.size(); i++) {
+			fmt::format_to(it, "sh_cluster_node_games{{node=\"{}\"}} {}\n", addresses[i], balancer.reported(i));
+		}
+		fmt::format_to(it, "# TYPE sh_cluster_redirects_total counter\nsh_cluster_redirects_total {}\n", redirects);
+		fmt::format_to(it, "# TYPE sh_cluster_refused_total counter\nsh_cluster_refused_total {}\n", refused);
+		res->writeHeader("Content-Type", "text/plain; version=0.0.4")->end(out);
+	}).listen("0.0.0.0", port ? std::atoi(port) : processes::PORT, [&](auto *listenSocket) {
+		if (listenSocket) {
+			std::cout << "Coordinating " << nodes.size() << " nodes..." << std::endl;
+		}
+	}).run();
+	stop = true;
+	poller.join();
+	return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef SERVER_DELAYED_STREAM_H
+#define SERVER_DELAYED_STREAM_H
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "eventRing.h"
+#include "rateLimit.h"
+#include "slab.h"
+#include "slotMap.h"
+
+/** Replays games to delayed spectators, including hidden information, once it is `delayMillis` old
+ *
+ * Each watched game records into an EventRing owned here, so a game that ends keeps being replayed until
+ * its ring is empty. drain() is run from a timer on the event loop, and publishes everything that has
+ * come due to each game's delayed topic.
+ */
+template <typename Socket>
+class DelayedStream {
+	struct Entry {
+		uint32_t gameId;
+		std::unique_ptr<EventRing, slab::Delete> ring;
+	};
+
+	std::vector<Entry> entries;
+	uint32_t delayMillis;
+
+public:
+	explicit DelayedStream(uint32_t delayMillis) : delayMillis(delayMillis) {
+	}
+
+	EventRing *ringFor(uint32_t gameId) {
+		auto it = std::find_if(entries.begin(), entries.end(), [gameId](auto &e) { return e.gameId == gameId; });
+		if (it != entries.end()) {
+			return it->ring.get();
+		}
+		return entries.emplace_back(Entry{ gameId, std::unique_ptr<EventRing, slab::Delete>(slab::make<EventRing>()) }).ring.get();
+	}
+
+	template <typename Publish>
+	void drain(SlotMap<Socket> &managers, Publish publish) {
+		auto cutoff = currentMillis() - delayMillis;
+		for (size_t i = 0; i < entries.size();) {
+			auto &e = entries[i];
+			e.ring->drain(cutoff, [&](std::string_view message) { publish(e.gameId, message); });
+			if (e.ring->empty() && !managers[typename SlotMap<Socket>::Key(e.gameId)]) {
+				std::swap(e, entries.back());
+				entries.pop_back();
+				continue;
+			}
+			i++;
+		}
+	}
+};
+
+#endif //SERVER_DELAYED_STREAM_H
@@ -0,0 +1,47 @@
+#ifndef SERVER_DRAIN_H
+#define SERVER_DRAIN_H
+#include <csignal>
+#include <cstdlib>
+
+/** Graceful shutdown for rolling deploys
+ *
+ * SIGTERM only sets a flag; the event loop's timer notices it and closes the listening sockets. Games
+ * that haven't started, and players waiting in the quickplay queue, are closed with LOBBY_CLOSED, and
+ * clients create them again, which takes them to the new process. Games already running play on to
+ * their end, but nobody can join them. Once the last one ends, or after SH_DRAIN_TIMEOUT_S seconds
+ * (an hour by default), the games left are ended, every remaining connection is closed and the event
+ * loop returns. A second SIGTERM exits straight away.
+ *
+ * The listening socket is bound with SO_REUSEPORT (uSockets sets it on Linux), so a deploy starts the
+ * new process on the same port first and only then signals the old one, and there is never a moment
+ * without a listener. With SH_PROCESSES, the new process also needs an SH_WORKER_PORT of its own (see
+ * processes.h). Connections still in the old socket's accept queue when it closes are reset unless
+ * net.ipv4.tcp_migrate_req=1 (Linux 5.14+), which hands them to the new process instead.
+ */
+namespace drain {
+	// a WebSocket close code, after HTTP's 410 Gone: the game hadn't started, so create it again
+	constexpr int LOBBY_CLOSED = 4410;
+
+	namespace detail {
+		inline volatile std::sig_atomic_t signals = 0;
+
+		inline void onSignal(int) {
+			if (signals++) {
+				std::_Exit(1);
+			}
+		}
+	}
+
+	inline void install() {
+		struct sigaction action = {};
+		action.sa_handler = detail::onSignal;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGTERM, &action, nullptr);
+	}
+
+	inline bool requested() {
+		return detail::signals != 0;
+	}
+}
+
+#endif //SERVER_DRAIN_H
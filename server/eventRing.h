@@ -0,0 +1,54 @@
+#ifndef SERVER_EVENT_RING_H
+#define SERVER_EVENT_RING_H
+#include <array>
+#include <cinttypes>
+#include <string_view>
+
+/** A fixed-size queue of timestamped game messages, used for the delayed spectator stream
+ *
+ * Messages are copied in as they are sent and read back once they are old enough.
+ * If more than SIZE messages are waiting, the oldest are overwritten.
+ */
+class EventRing {
+public:
+	static constexpr unsigned SIZE = 256;
+	static constexpr unsigned MAX_MESSAGE_SIZE = 11;
+
+private:
+	struct Event {
+		uint32_t time;
+		uint8_t length;
+		char data[MAX_MESSAGE_SIZE];
+	};
+
+	std::array<Event, SIZE> events;
+	uint32_t head = 0;
+	uint32_t tail = 0;
+
+public:
+	void push(uint32_t time, std::string_view message) {
+		auto &e = events[head % SIZE];
+		e.time = time;
+		e.length = message.copy(e.data, MAX_MESSAGE_SIZE);
+		head++;
+		if (head - tail > SIZE) {
+			tail = head - SIZE;
+		}
+	}
+
+	/** Calls f on every message recorded at or before `cutoff`, oldest first, and removes them */
+	template <typename F>
+	void drain(uint32_t cutoff, F f) {
+		while (tail != head && static_cast<int32_t>(cutoff - events[tail % SIZE].time) >= 0) {
+			auto &e = events[tail % SIZE];
+			f(std::string_view(e.data, e.length));
+			tail++;
+		}
+	}
+
+	bool empty() const {
+		return head == tail;
+	}
+};
+
+#endif //SERVER_EVENT_RING_H
@@ -0,0 +1,41 @@
+/** Feeds byte streams into Manager::handleMessage and checks the rules after every message
+ *
+ * Input layout: byte 0 picks the player count, bytes 1-4 seed the game, and every following pair of bytes
+ * is a message: the id of the player sending it, then the message itself. Sockets are mocks that accept
+ * every frame, so the only work per message is the manager's own.
+ *
+ * With clang, configure with -DSH_FUZZ=ON and run `handleMessageFuzzer fuzz/corpus/handleMessage`.
+ * New crashes are worth adding to the corpus, which ctest replays on every build.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include "mockSocket.h"
+#include "../test/invariants.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *input, size_t size) {
+	if (size < 5) {
+		return 0;
+	}
+	static MockSocket sockets[MAX_PLAYERS];
+	int players = FIVE + input[0] % (MAX_PLAYERS - FIVE + 1);
+	uint32_t seed = (input[1] << 24) | (input[2] << 16) | (input[3] << 8) | input[4];
+
+	bool destroyed = false;
+	Manager<MockSocket> manager;
+	manager.setDeleter([](void *context, uint32_t) { *static_cast<bool *>(context) = true; }, &destroyed);
+	for (int i = 0; i < players; i++) {
+		sockets[i].data.playerId = manager.addClient(&sockets[i]);
+		sockets[i].data.manager = &manager;
+	}
+	manager.startMatchedGame(seed);
+
+	for (size_t i = 5; i + 1 < size && !destroyed; i += 2) {
+		char message = static_cast<char>(input[i + 1]);
+		manager.handleMessage(input[i] % players, std::string_view(&message, 1));
+		if (auto broken = brokenInvariant(manager.getGame(), players)) {
+			fprintf(stderr, "%s after message %zu\n", broken, (i - 5) / 2);
+			abort();
+		}
+	}
+	return 0;
+}
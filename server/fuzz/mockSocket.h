@@ -0,0 +1,37 @@
+#ifndef SERVER_FUZZ_MOCK_SOCKET_H
+#define SERVER_FUZZ_MOCK_SOCKET_H
+#include <cstdlib>
+#include <string_view>
+#include "../manager.h"
+
+/** A socket that accepts every frame, for driving managers without a network
+ *
+ * `open` is cleared when the server ends the connection, as a real socket would be closed. Frames to a
+ * socket that asked for protocol version 2 must decode.
+ */
+struct alignas(8) MockSocket {
+	UserData<MockSocket> data;
+	bool open = false;
+
+	void *getUserData() {
+		return &data;
+	}
+
+	bool send(std::string_view message, uWS::OpCode, bool) {
+		if (data.version == protocolV2::VERSION && !protocolV2::decode(message, [](auto, auto) {})) {
+			abort();
+		}
+		return true;
+	}
+
+	template <typename F>
+	void cork(F &&f) {
+		f();
+	}
+
+	void end(int) {
+		open = false;
+	}
+};
+
+#endif //SERVER_FUZZ_MOCK_SOCKET_H
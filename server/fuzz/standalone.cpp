@@ -0,0 +1,61 @@
+/** A driver for the fuzz targets on compilers without libFuzzer
+ *
+ * With file or directory arguments, runs every input once, which is how the corpus is replayed in ctest.
+ * With none, runs random inputs for a few seconds and reports executions per second.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *input, size_t size);
+
+namespace {
+	void runFile(const std::filesystem::path &path) {
+		std::ifstream file(path, std::ios::binary);
+		std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		LLVMFuzzerTestOneInput(input.data(), input.size());
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1) {
+		size_t runs = 0;
+		for (int i = 1; i < argc; i++) {
+			if (std::filesystem::is_directory(argv[i])) {
+				for (auto &entry : std::filesystem::directory_iterator(argv[i])) {
+					runFile(entry.path());
+					runs++;
+				}
+			} else {
+				runFile(argv[i]);
+				runs++;
+			}
+		}
+		printf("ran %zu inputs\n", runs);
+		return 0;
+	}
+
+	using namespace std::chrono;
+	std::minstd_rand rng(1);
+	std::vector<uint8_t> input;
+	size_t runs = 0;
+	auto start = steady_clock::now();
+	while (steady_clock::now() - start < seconds(5)) {
+		for (int batch = 0; batch < 1000; batch++) {
+			input.resize(5 + rng() % 256);
+			for (auto &b : input) {
+				b = rng();
+			}
+			LLVMFuzzerTestOneInput(input.data(), input.size());
+			runs++;
+		}
+	}
+	auto elapsed = duration_cast<duration<double>>(steady_clock::now() - start).count();
+	printf("%zu inputs in %.1f s, %.0f execs/s\n", runs, elapsed, runs / elapsed);
+	return 0;
+}
@@ -0,0 +1,243 @@
+/** Feeds malformed traffic into everything a client controls: game keys, slot lookups, and messages
+ *
+ * The input is a sequence of operations, each a byte followed by its arguments:
+ * KEY: decodes a key of up to 15 bytes, and looks the result up
+ * LOOKUP: looks up a raw 32 bit key
+ * CREATE: creates a game with up to MAX_PLAYERS players, every other one speaking protocol version 2
+ * MESSAGE: sends a message of up to 63 bytes from a player, which covers setName with any name
+ * START: starts a game the way the matchmaker does
+ * DISCONNECT: closes a player's socket
+ * JOIN: seats one more socket in a game this input created, as /join does, whether it is full or started
+ *
+ * Lookups must only ever find games this input created, and the rules must hold after every message.
+ * The slot map is shared between inputs, as it is far too large to build for each one, but every game is
+ * destroyed before an input returns. Run with -DSH_FUZZ=ON under clang, from the corpus in fuzz/corpus/wire.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "mockSocket.h"
+#include "../gameKey.h"
+#include "../slotMap.h"
+#include "../test/invariants.h"
+
+namespace {
+	enum Operation {
+		KEY,
+		LOOKUP,
+		CREATE,
+		MESSAGE,
+		START,
+		DISCONNECT,
+		JOIN,
+		OPERATION_COUNT
+	};
+
+	constexpr size_t MAX_GAMES = 4;
+
+	struct Game {
+		SlotMap<MockSocket>::Key key;
+		std::vector<MockSocket *> sockets;
+	};
+
+	class Reader {
+		const uint8_t *input;
+		size_t size;
+		size_t position = 0;
+
+	public:
+		Reader(const uint8_t *input, size_t size) : input(input), size(size) {}
+
+		bool done() const {
+			return position >= size;
+		}
+
+		uint8_t next() {
+			return done() ? 0 : input[position++];
+		}
+
+		std::string_view take(size_t n) {
+			n = std::min(n, size - std::min(position, size));
+			std::string_view s(reinterpret_cast<const char *>(input) + position, n);
+			position += n;
+			return s;
+		}
+	};
+
+	[[noreturn]] void fail(const char *message) {
+		fprintf(stderr, "%s\n", message);
+		abort();
+	}
+
+	SlotMap<MockSocket> &slots() {
+		static SlotMap<MockSocket> managers;
+		return managers;
+	}
+
+	std::vector<MockSocket> &socketPool() {
+		static std::vector<MockSocket> sockets(MAX_GAMES * MAX_PLAYERS);
+		return sockets;
+	}
+
+	class Session {
+		std::vector<Game> games;
+
+		bool ours(uint32_t gameId) {
+			return std::any_of(games.begin(), games.end(), [gameId](Game &g) { return g.key.gameId() == gameId; });
+		}
+
+		void lookup(uint32_t gameId) {
+			if (slots()[SlotMap<MockSocket>::Key(gameId)] && !ours(gameId)) {
+				fail("a lookup found a game that doesn't exist");
+			}
+		}
+
+		MockSocket *freeSocket() {
+			auto &pool = socketPool();
+			auto it = std::find_if(pool.begin(), pool.end(), [](MockSocket &s) { return !s.open; });
+			return it == pool.end() ? nullptr : &*it;
+		}
+
+		// as the server does on upgrade, which a refused join closes again
+		bool join(Game &g, MockSocket *s, uint8_t version) {
+			new (&s->data) UserData<MockSocket>;
+			s->data.socket = s;
+			s->data.version = version;
+			s->open = true;
+			if (!slots()[g.key].value().get().join(s)) {
+				if (s->open || s->data.manager) {
+					fail("a refused join left its socket bound to the game");
+				}
+				return false;
+			}
+			g.sockets.push_back(s);
+			return true;
+		}
+
+		MockSocket *openSocket(Game &g, uint8_t choice) {
+			std::vector<MockSocket *> open;
+			for (auto *s : g.sockets) {
+				if (s->open) {
+					open.push_back(s);
+				}
+			}
+			return open.empty() ? nullptr : open[choice % open.size()];
+		}
+
+		// forgets games whose last player left, or which were destroyed by a disconnect
+		void sweep() {
+			games.erase(std::remove_if(games.begin(), games.end(), [](Game &g) { return !slots()[g.key]; }), games.end());
+		}
+
+		void check(Game &g) {
+			auto &m = slots()[g.key].value().get();
+			if (m.getState() >= GenericGame<Manager<MockSocket>>::LIBERAL_POLICY_WIN) {
+				return;
+			}
+			if (auto broken = brokenInvariant(m.getGame(), m.getClientCount())) {
+				fail(broken);
+			}
+		}
+
+	public:
+		void run(Reader &in) {
+			while (!in.done()) {
+				switch (in.next() % OPERATION_COUNT) {
+					case KEY: {
+						auto s = in.take(in.next() % 16);
+						if (auto id = gameKey::decode(s)) {
+							if (gameKey::encode(*id) != s) {
+								fail("a key didn't survive a round trip");
+							}
+							lookup(*id);
+						}
+						break;
+					}
+					case LOOKUP: {
+						uint32_t id = (in.next() << 24) | (in.next() << 16) | (in.next() << 8) | in.next();
+						lookup(id);
+						break;
+					}
+					case CREATE: {
+						if (games.size() >= MAX_GAMES) {
+							break;
+						}
+						int players = 1 + in.next() % MAX_PLAYERS;
+						auto key = slots().getSlot();
+						if (!key) {
+							fail("the slot map ran out of keys");
+						}
+						auto &g = games.emplace_back(Game{ *key, {} });
+						for (int i = 0; i < players; i++) {
+							join(g, freeSocket(), i % 2 ? protocolV2::VERSION : 1);
+						}
+						break;
+					}
+					case MESSAGE: {
+						if (games.empty()) {
+							break;
+						}
+						auto &g = games[in.next() % games.size()];
+						auto *s = openSocket(g, in.next());
+						auto message = in.take(in.next() % 64);
+						if (s) {
+							// the message may end the game, and sweep() then moves g
+							auto id = g.key.gameId();
+							s->data.manager->handleMessage(s->data.playerId, message);
+							sweep();
+							if (ours(id)) {
+								check(*std::find_if(games.begin(), games.end(), [id](Game &x) { return x.key.gameId() == id; }));
+							}
+						}
+						break;
+					}
+					case START: {
+						if (games.empty()) {
+							break;
+						}
+						auto &m = slots()[games[in.next() % games.size()].key].value().get();
+						if (m.getState() == 0 && m.getClientCount() >= FIVE) {
+							m.startMatchedGame(in.next());
+						}
+						break;
+					}
+					case JOIN: {
+						if (games.empty()) {
+							break;
+						}
+						auto &g = games[in.next() % games.size()];
+						auto version = in.next() % 2 ? protocolV2::VERSION : 1;
+						if (auto *s = freeSocket()) {
+							join(g, s, version);
+						}
+						break;
+					}
+					case DISCONNECT: {
+						if (games.empty()) {
+							break;
+						}
+						auto &g = games[in.next() % games.size()];
+						if (auto *s = openSocket(g, in.next())) {
+							s->open = false;
+							s->data.manager->onDisconnect(s->data.playerId, 1006);
+							sweep();
+						}
+						break;
+					}
+				}
+			}
+			for (auto &g : games) {
+				slots()[g.key].value().get().destroyGame();
+			}
+			for (auto &s : socketPool()) {
+				s.open = false;
+			}
+		}
+	};
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *input, size_t size) {
+	Reader in(input, size);
+	Session().run(in);
+	return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef SERVER_GAME_KEY_H
+#define SERVER_GAME_KEY_H
+#include <cinttypes>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/** Game keys are the game id written in base 16 with the letters a-p, least significant digit first
+ *
+ * Shorter keys come first: every 1 letter key, then every 2 letter key, and so on, so the key for an id is
+ * as short as it can be. `residue(n)` is the number of keys shorter than n letters.
+ */
+namespace gameKey {
+	constexpr size_t MAX_LENGTH = 8;
+
+	constexpr uint64_t residue(size_t chars) {
+		return 16 * ((1ULL << ((chars - 1) * 4)) - 1) / 15;
+	}
+
+	// keys come straight from the URL, so anything that isn't a key for some 32 bit id is rejected
+	inline std::optional<uint32_t> decode(std::string_view s) {
+		if (s.empty() || s.size() > MAX_LENGTH) {
+			return {};
+		}
+		uint64_t main = 0;
+		for (auto i = s.size(); i-- > 0;) {
+			if (s[i] < 'a' || s[i] > 'p') {
+				return {};
+			}
+			main = main * 16 + (s[i] - 'a');
+		}
+		uint64_t key = main + residue(s.size());
+		if (key > UINT32_MAX) {
+			return {};
+		}
+		return static_cast<uint32_t>(key);
+	}
+
+	inline std::string encode(uint32_t key) {
+		size_t chars = 1;
+		while (key >= residue(chars + 1)) {
+			chars++;
+		}
+		auto t = key - residue(chars);
+		std::string s;
+		for (size_t i = 0; i < chars; i++) {
+			s.push_back('a' + t % 16);
+			t /= 16;
+		}
+		return s;
+	}
+}
+
+#endif //SERVER_GAME_KEY_H
@@ -0,0 +1,135 @@
+#ifndef SERVER_GAME_LOG_H
+#define SERVER_GAME_LOG_H
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+
+/** A binary log of finished games, for offline analysis with tools/analyze
+ *
+ * Every game that reaches an ending is appended as one 8-byte Record. Records wait in memory until the
+ * server's timer calls flush(), so finishing a game costs the event loop no system call. Each batch goes
+ * out in a single O_APPEND write, so several servers can share a file. A crash loses the batch that
+ * hadn't been flushed yet. The server never rotates the file.
+ *
+ * Counters saturate instead of wrapping, which only a game running for hours could reach.
+ */
+namespace gameLog {
+	struct Record {
+		uint8_t players;
+		// the ending, counted from LIBERAL_POLICY_WIN, in the low 2 bits, and BOTS if a bot was seated
+		uint8_t flags;
+		// liberal in the low nibble, fascist in the high one
+		uint8_t policies;
+		// proposed in the low nibble, accepted in the high one
+		uint8_t vetoes;
+		// chaotic policies, after which the tracker starts again at zero
+		uint8_t trackerResets;
+		uint8_t failedElections;
+		// little-endian seconds from the start to the end of the game
+		uint8_t seconds[2];
+
+		static constexpr uint8_t BOTS = 4;
+
+		int ending() const {
+			return flags & 3;
+		}
+
+		bool bots() const {
+			return flags & BOTS;
+		}
+
+		int liberalPolicies() const {
+			return policies & 15;
+		}
+
+		int fascistPolicies() const {
+			return policies >> 4;
+		}
+
+		int vetoesProposed() const {
+			return vetoes & 15;
+		}
+
+		int vetoesAccepted() const {
+			return vetoes >> 4;
+		}
+
+		unsigned duration() const {
+			return seconds[0] | seconds[1] << 8;
+		}
+	};
+
+	static_assert(sizeof(Record) == 8);
+
+	/** What a game has done so far, kept by its Manager */
+	struct Tally {
+		uint8_t vetoesProposed = 0;
+		uint8_t vetoesAccepted = 0;
+		uint8_t trackerResets = 0;
+		uint8_t failedElections = 0;
+
+		static void increment(uint8_t &counter, uint8_t limit = 255) {
+			counter += counter < limit;
+		}
+
+		Record finish(int players, int ending, bool bots, int liberal, int fascist, unsigned long seconds) const {
+			auto clamped = static_cast<unsigned>(std::min(seconds, 65535UL));
+			return {
+				static_cast<uint8_t>(players),
+				static_cast<uint8_t>((ending & 3) | (bots ? Record::BOTS : 0)),
+				static_cast<uint8_t>(liberal | fascist << 4),
+				static_cast<uint8_t>(std::min<int>(vetoesProposed, 15) | std::min<int>(vetoesAccepted, 15) << 4),
+				trackerResets,
+				failedElections,
+				{ static_cast<uint8_t>(clamped & 255), static_cast<uint8_t>(clamped >> 8) },
+			};
+		}
+	};
+
+	namespace detail {
+		inline const char *path = nullptr;
+		inline int fd = -1;
+		// records waiting for the next flush; a full buffer is flushed right away
+		inline std::array<Record, 512> pending;
+		inline size_t pendingCount = 0;
+	}
+
+	/** Logs finished games to `file`, created if it doesn't exist */
+	inline void configure(const char *file) {
+		detail::path = file;
+	}
+
+	/** Writes out the records appended since the last flush */
+	inline void flush() {
+		if (!detail::pendingCount) {
+			return;
+		}
+		auto bytes = detail::pendingCount * sizeof(Record);
+		detail::pendingCount = 0;
+		if (detail::fd < 0) {
+			detail::fd = open(detail::path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+			if (detail::fd < 0) {
+				return;
+			}
+		}
+		if (write(detail::fd, detail::pending.data(), bytes) != static_cast<ssize_t>(bytes)) {
+			// the file may have been removed or the disk filled up; try again with the next batch
+			close(detail::fd);
+			detail::fd = -1;
+		}
+	}
+
+	inline void append(const Record &record) {
+		if (!detail::path) {
+			return;
+		}
+		detail::pending[detail::pendingCount++] = record;
+		if (detail::pendingCount == detail::pending.size()) {
+			flush();
+		}
+	}
+}
+
+#endif //SERVER_GAME_LOG_H
@@ -0,0 +1,858 @@
+#ifndef SERVER_GAME_STATE_H
+#define SERVER_GAME_STATE_H
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <tuple>
+#include <type_traits>
+
+#include "common.h"
+#include "player.h"
+
+/** The minimal standard generator, which is what std::minstd_rand0 is, kept in 4 bytes so it copies with the state */
+struct MinimalStandard {
+	using result_type = uint32_t;
+	static constexpr uint32_t modulus = 2147483647;
+
+	uint32_t x = 1;
+
+	static constexpr result_type min() {
+		return 1;
+	}
+
+	static constexpr result_type max() {
+		return modulus - 1;
+	}
+
+	void seed(unsigned long long s) {
+		x = s % modulus;
+		if (x == 0) {
+			x = 1;
+		}
+	}
+
+	result_type operator()() {
+		x = static_cast<uint64_t>(x) * 16807 % modulus;
+		return x;
+	}
+
+	bool operator==(const MinimalStandard &other) const {
+		return x == other.x;
+	}
+};
+
+/** Something a transition did that players should hear about */
+struct Event {
+	enum Type : uint8_t {
+		SUCCESSFUL_ELECTION,
+		FAILED_ELECTION,
+		CHAOTIC_FASCIST_POLICY,
+		CHAOTIC_LIBERAL_POLICY,
+		REGULAR_FASCIST_POLICY,
+		REGULAR_LIBERAL_POLICY,
+		FASCIST_POLICY_WIN,
+		LIBERAL_POLICY_WIN,
+		FASCIST_HITLER_WIN,
+		LIBERAL_HITLER_WIN,
+		PRESIDENT_VETO_OPTION,
+		SPECIAL_PRESIDENT_NOMINATION,
+		ANNOUNCE_ELECTION,
+		ANNOUNCE_DEATH,
+		CHANCELLOR_NOMINATION,
+		INVESTIGATION,
+		KILL,
+		PRESIDENT_POLICY_CHOICE,
+		CHANCELLOR_POLICY_CHOICE,
+		LOYALTY,
+		TOP_CARDS,
+	};
+
+	Type type;
+	// who died, or who was investigated
+	int8_t player;
+	// who saw a loyalty or the top cards; the presidency has moved on by the time the events are read
+	int8_t president;
+	uint8_t team;
+};
+
+/** The events of one transition, in the order they happened */
+struct Events {
+	static constexpr int CAPACITY = 4;
+
+	uint8_t count = 0;
+	Event list[CAPACITY];
+
+	void push(Event::Type type, int player = -1, int president = -1, Team team = FASCIST) {
+		list[count++] = { type, static_cast<int8_t>(player), static_cast<int8_t>(president), static_cast<uint8_t>(team) };
+	}
+
+	const Event *begin() const {
+		return list;
+	}
+
+	const Event *end() const {
+		return list + count;
+	}
+};
+
+/** Everything about a game but who is playing it
+ *
+ * The state is trivially copyable and fits in a cache line, so a copy is a single memcpy. That is what
+ * bots and the explorer do to try a move without touching the real game. Transitions only change the
+ * state itself, and return what happened as Events; GenericGame sends those to its CommunicationManager.
+ *
+ * Invalid arguments are ignored, with no transition and no events. Otherwise, nothing is checked: it is
+ * up to the caller to make sure the game is in the right state and the input comes from the right player.
+ *
+ * The deck is a bitset. Cards are accessed by bitshifting.
+ * The end of the deck is marked with a set bit, and all bits above it are zero.
+ * Therefore, if we shift down and have no set bits, we must reshuffle.
+ */
+class GameState {
+public:
+	enum State : uint8_t {
+		NOT_STARTED = 0,
+		VOTING,
+		AWAITING_CHANCELLOR_NOMINATION,
+		AWAITING_PRESIDENT_POLICY,
+		AWAITING_CHANCELLOR_POLICY,
+		AWAITING_CHANCELLOR_POLICY_NO_VETO,
+		AWAITING_ALLEGIENCE_PEEK_CHOICE,
+		AWAITING_SPECIAL_PRESIDENT_CHOICE,
+		AWAITING_KILL_CHOICE,
+		AWAITING_VETO,
+		LIBERAL_POLICY_WIN,
+		LIBERAL_HITLER_WIN,
+		FASCIST_POLICY_WIN,
+		FASCIST_HITLER_WIN,
+	};
+
+	enum PolicyChoice {
+		FIRST = 0,
+		SECOND = 1,
+		THIRD = 2,
+		VETO = 2,
+	};
+
+static constexpr int totalLiberalPolicies = 6;
+static constexpr int totalFascistPolicies = 11;
+static constexpr int policyCount = totalFascistPolicies + totalLiberalPolicies;
+
+private:
+	std::array<Player, MAX_PLAYERS> players;
+	MinimalStandard rng;
+	std::bitset<policyCount + 1> deck;
+
+	State state = NOT_STARTED;
+	int8_t playerCount = 0;
+	int8_t liberalPolicies = 0;
+	int8_t fascistPolicies = 0;
+
+	int8_t hitler = -1;
+	int8_t presidentCounter = -1;
+	int8_t presidentId = -1;
+	int8_t chancellorId = -1;
+
+	int8_t electionTracker = 0;
+
+	int8_t previousPresidentId = -1;
+	int8_t previousChancellorId = -1;
+
+	// the cards in hand, as Teams
+	uint8_t firstPolicy = FASCIST;
+	uint8_t secondPolicy = FASCIST;
+	uint8_t thirdPolicy = FASCIST;
+
+	void assignRoles() {
+		auto playerSelector = std::uniform_int_distribution(0, playerCount - 1);
+		hitler = playerSelector(rng);
+		players[hitler].team(FASCIST);
+		int remainingFascists; // not including Hitler
+		switch(playerCount) {
+			case FIVE:
+			case SIX:
+				remainingFascists = 1;
+				break;
+			case SEVEN:
+			case EIGHT:
+				remainingFascists = 2;
+				break;
+			case NINE:
+			case TEN:
+				remainingFascists = 3;
+				break;
+			// house rules for larger games keep roughly the same share of fascists
+			case ELEVEN:
+			case TWELVE:
+				remainingFascists = 4;
+				break;
+			case THIRTEEN:
+			case FOURTEEN:
+				remainingFascists = 5;
+				break;
+			case FIFTEEN:
+			case SIXTEEN:
+				remainingFascists = 6;
+				break;
+			default:
+				return;
+		}
+		for (auto i = 0; i < hitler; i++) {
+			if (std::uniform_int_distribution(0, playerCount - i - 1)(rng) < remainingFascists) {
+				remainingFascists--;
+				players[i].team(FASCIST);
+			} else {
+				players[i].team(LIBERAL);
+			}
+		}
+		for (auto i = hitler + 1; i < playerCount; i++) {
+			if (std::uniform_int_distribution(0, playerCount - i - 1)(rng) < remainingFascists) {
+				remainingFascists--;
+				players[i].team(FASCIST);
+			} else {
+				players[i].team(LIBERAL);
+			}
+		}
+	}
+
+public:
+	void init(unsigned long long seed, int count) {
+		playerCount = count;
+		rng.seed(seed);
+		shuffleDeck();
+		auto playerSelector = std::uniform_int_distribution(0, playerCount - 1);
+		presidentId = playerSelector(rng);
+		presidentCounter = presidentId;
+		assignRoles();
+		for (auto i = 0; i < playerCount; i++) {
+			players[i].alive(true);
+		}
+	}
+
+	Events start() {
+		Events out;
+		moveToNextPresident(out);
+		return out;
+	}
+
+	static unsigned long long timeSeed() {
+		using namespace std::chrono;
+		auto t = high_resolution_clock::now().time_since_epoch();
+		return duration_cast<duration<unsigned long long>>(t).count();
+	}
+
+private:
+	void shuffleDeck() {
+		deck.reset();
+		const int remainingPolicies = policyCount - liberalPolicies - fascistPolicies;
+		int i;
+		int j = totalLiberalPolicies - liberalPolicies;
+		for (i = 0; j && i < remainingPolicies; i++) {
+			if (std::uniform_int_distribution(0, remainingPolicies - i - 1)(rng) < j) {
+				j--;
+				deck[i] = LIBERAL;
+			} else {
+				deck[i] = FASCIST;
+			}
+		}
+		for (; i < remainingPolicies; i++) {
+			deck[i] = FASCIST;
+		}
+		deck[remainingPolicies] = 1;
+	}
+
+	[[nodiscard]] Team servePolicy() {
+		bool isSet = deck[0];
+		deck >>= 1;
+		Team p = static_cast<Team>(static_cast<int>(isSet));
+		return p;
+	}
+
+	void reshuffleIfNecessary() {
+		if (!(deck >> 3).any()) {
+			shuffleDeck();
+		}
+	}
+
+public:
+	std::tuple<Team, Team, Team> peekTopCards() const {
+		return { Team(bool(deck[0])), Team(bool(deck[1])), Team(bool(deck[2])) };
+	}
+
+	Events addVote(int playerId, Vote v) {
+		Events out;
+		Player &player = players[playerId];
+		if (player.voted() || !player.alive()) {
+			return out;
+		}
+		if (v == JA) {
+			player.lastVote(JA);
+		} else if (v == NEIN) {
+			player.lastVote(NEIN);
+		} else {
+			return out;
+		}
+		player.voted(true);
+		runElectionIfAllHaveVoted(out);
+		return out;
+	}
+
+private:
+	void runElectionIfAllHaveVoted(Events &out) {
+		int jaVotes = 0;
+		int neinVotes = 0;
+		for (int i = 0; i < playerCount; i++) {
+			auto &p = players[i];
+			if (!p.alive()) {
+				continue;
+			}
+			if (!p.voted()) {
+				return;
+			}
+			if (p.lastVote() == JA) {
+				jaVotes++;
+			} else {
+				neinVotes++;
+			}
+		}
+		runElection(jaVotes, neinVotes, out);
+	}
+
+	[[nodiscard]] bool checkForFascistHitlerWin() const {
+		return fascistPolicies >= 3 && chancellorId == hitler;
+	}
+
+	void runElection(int jaVotes, int neinVotes, Events &out) {
+		if (jaVotes > neinVotes) {
+			out.push(Event::SUCCESSFUL_ELECTION);
+			successfulElection(out);
+		} else {
+			out.push(Event::FAILED_ELECTION);
+			incrementElectionTracker(out);
+		}
+	}
+
+	void successfulElection(Events &out) {
+		if (checkForFascistHitlerWin()) {
+			return finish(FASCIST_HITLER_WIN, out);
+		}
+		previousPresidentId = presidentId;
+		previousChancellorId = chancellorId;
+		sendPresidentPolicy(out);
+	}
+
+	void incrementElectionTracker(Events &out) {
+		electionTracker++;
+		if (electionTracker == 3) {
+			auto p = servePolicy();
+			if (p == FASCIST) {
+				fascistPolicies++;
+				out.push(Event::CHAOTIC_FASCIST_POLICY);
+				if (fascistPolicies == 6) {
+					return finish(FASCIST_POLICY_WIN, out);
+				}
+			} else {
+				liberalPolicies++;
+				out.push(Event::CHAOTIC_LIBERAL_POLICY);
+				if (liberalPolicies == 5) {
+					return finish(LIBERAL_POLICY_WIN, out);
+				}
+			}
+			electionTracker = 0;
+			reshuffleIfNecessary();
+			previousPresidentId = -1;
+			previousChancellorId = -1;
+		}
+		moveToNextPresident(out);
+	}
+
+	void sendPresidentPolicy(Events &out) {
+		firstPolicy = servePolicy();
+		secondPolicy = servePolicy();
+		thirdPolicy = servePolicy();
+		state = AWAITING_PRESIDENT_POLICY;
+		out.push(Event::PRESIDENT_POLICY_CHOICE);
+	}
+
+public:
+	Events removePresidentPolicy(PolicyChoice removedPolicy) {
+		using std::swap;
+		Events out;
+		switch (removedPolicy) {
+			case FIRST:
+				swap(firstPolicy, thirdPolicy);
+				break;
+			case SECOND:
+				swap(secondPolicy, thirdPolicy);
+				break;
+			case THIRD:
+				break;
+			default:
+				break;
+		}
+		sendChancellorPolicy(out);
+		return out;
+	}
+
+private:
+	void sendChancellorPolicy(Events &out) {
+		state = AWAITING_CHANCELLOR_POLICY;
+		out.push(Event::CHANCELLOR_POLICY_CHOICE);
+	}
+
+public:
+	Events removeChancellorPolicy(PolicyChoice p) {
+		Events out;
+		switch(p) {
+			case FIRST:
+				enactPolicy(getSecondPolicy(), out);
+				break;
+			case SECOND:
+				enactPolicy(getFirstPolicy(), out);
+				break;
+			case VETO:
+				if (fascistPolicies == 5 && state == AWAITING_CHANCELLOR_POLICY)
+					requestVeto(out);
+				break;
+			default:
+				break;
+		}
+		return out;
+	}
+
+private:
+	void enactPolicy(Team p, Events &out) {
+		electionTracker = 0;
+		if (p == FASCIST) {
+			fascistPolicies++;
+			reshuffleIfNecessary();
+			out.push(Event::REGULAR_FASCIST_POLICY);
+			switch (fascistPolicies) {
+				case 1:
+					return power0(out);
+				case 2:
+					return power1(out);
+				case 3:
+					return power2(out);
+				case 4:
+					return power3(out);
+				case 5:
+					return power4(out);
+				case 6:
+					return finish(FASCIST_POLICY_WIN, out);
+				default:
+					return;
+			}
+		} else {
+			liberalPolicies++;
+			reshuffleIfNecessary();
+			out.push(Event::REGULAR_LIBERAL_POLICY);
+			if (liberalPolicies == 5) {
+				return finish(LIBERAL_POLICY_WIN, out);
+			}
+			moveToNextPresident(out);
+		}
+	}
+
+	void requestVeto(Events &out) {
+		if (fascistPolicies != 5) {
+			return;
+		}
+		state = AWAITING_VETO;
+		out.push(Event::PRESIDENT_VETO_OPTION);
+	}
+
+public:
+	Events presidentVeto(bool accept) {
+		Events out;
+		if (!accept) {
+			state = AWAITING_CHANCELLOR_POLICY_NO_VETO;
+			out.push(Event::CHANCELLOR_POLICY_CHOICE);
+			return out;
+		}
+		reshuffleIfNecessary();
+		incrementElectionTracker(out);
+		return out;
+	}
+
+private:
+	void finish(State end, Events &out) {
+		state = end;
+		switch (end) {
+			case LIBERAL_POLICY_WIN:
+				return out.push(Event::LIBERAL_POLICY_WIN);
+			case LIBERAL_HITLER_WIN:
+				return out.push(Event::LIBERAL_HITLER_WIN);
+			case FASCIST_POLICY_WIN:
+				return out.push(Event::FASCIST_POLICY_WIN);
+			default:
+				return out.push(Event::FASCIST_HITLER_WIN);
+		}
+	}
+
+	void moveToNextPresident(Events &out) {
+		do {
+			presidentCounter = (presidentCounter + 1) % playerCount;
+		} while (!players[presidentCounter].alive());
+		presidentId = presidentCounter;
+		state = AWAITING_CHANCELLOR_NOMINATION;
+		out.push(Event::CHANCELLOR_NOMINATION);
+	}
+
+	[[nodiscard]] bool chancellorIsValid(int id) const {
+		if ((!players[id].alive()) || previousChancellorId == id || id == presidentId) {
+			return false;
+		}
+		if (id != previousPresidentId) {
+			return true;
+		}
+		int alivePlayers = std::count_if(players.begin(), players.begin() + playerCount, [](Player p) { return p.alive(); });
+		return alivePlayers <= 5;
+	}
+
+public:
+	Events nominateChancellor(int id) {
+		Events out;
+		if (!chancellorIsValid(id)) {
+			return out;
+		}
+		chancellorId = id;
+		startVoting(out);
+		return out;
+	}
+
+private:
+	void startVoting(Events &out) {
+		for (auto i = 0; i < playerCount; i++) {
+			players[i].voted(false);
+		}
+		state = VOTING;
+		out.push(Event::ANNOUNCE_ELECTION);
+	}
+
+	void nullPower(Events &out) {
+		moveToNextPresident(out);
+	}
+
+	void investigateLoyalty(Events &out) {
+		state = AWAITING_ALLEGIENCE_PEEK_CHOICE;
+		out.push(Event::INVESTIGATION);
+	}
+
+	bool canBeInvestigated(int playerId) const {
+		return !players[playerId].investigated() && playerId != presidentId && players[playerId].alive();
+	}
+
+public:
+	Events revealLoyalty(int playerId) {
+		Events out;
+		if (!canBeInvestigated(playerId)) {
+			return out;
+		}
+		players[playerId].investigated(true);
+		out.push(Event::LOYALTY, playerId, presidentId, players[playerId].team());
+		moveToNextPresident(out);
+		return out;
+	}
+
+private:
+	void showPresidentTopCards(Events &out) {
+		out.push(Event::TOP_CARDS, -1, presidentId);
+		moveToNextPresident(out);
+	}
+
+	void runSpecialElection(Events &out) {
+		state = AWAITING_SPECIAL_PRESIDENT_CHOICE;
+		out.push(Event::SPECIAL_PRESIDENT_NOMINATION);
+	}
+
+public:
+	Events useSpecialPresident(int id) {
+		Events out;
+		if (id == presidentId || !players[id].alive()) {
+			return out;
+		}
+		presidentId = id;
+		state = AWAITING_CHANCELLOR_NOMINATION;
+		out.push(Event::CHANCELLOR_NOMINATION);
+		return out;
+	}
+
+private:
+	void makePresidentKillPlayer(Events &out) {
+		state = AWAITING_KILL_CHOICE;
+		out.push(Event::KILL);
+	}
+
+public:
+	Events killPlayer(int id) {
+		Events out;
+		if (!players[id].alive()) {
+			return out;
+		}
+		players[id].alive(false);
+		out.push(Event::ANNOUNCE_DEATH, id);
+		if (hitler == id) {
+			finish(LIBERAL_HITLER_WIN, out);
+			return out;
+		}
+		moveToNextPresident(out);
+		return out;
+	}
+
+private:
+	void power0(Events &out) {
+		switch(playerCount) {
+			case FIVE:
+			case SIX:
+			case SEVEN:
+			case EIGHT:
+				nullPower(out);
+				break;
+			default:
+				// nine players and up
+				investigateLoyalty(out);
+				break;
+		}
+	}
+
+	void power1(Events &out) {
+		switch(playerCount) {
+			case FIVE:
+			case SIX:
+				nullPower(out);
+				break;
+			default:
+				investigateLoyalty(out);
+				break;
+		}
+	}
+
+	void power2(Events &out) {
+		switch(playerCount) {
+			case FIVE:
+			case SIX:
+				showPresidentTopCards(out);
+				break;
+			default:
+				runSpecialElection(out);
+				break;
+		}
+	}
+
+	void power3(Events &out) {
+		makePresidentKillPlayer(out);
+	}
+
+	void power4(Events &out) {
+		makePresidentKillPlayer(out);
+	}
+
+public:
+	State getState() const {
+		return state;
+	}
+
+	int getPlayerCount() const {
+		return playerCount;
+	}
+
+	int getLiberalPolicies() const {
+		return liberalPolicies;
+	}
+
+	int getFascistPolicies() const {
+		return fascistPolicies;
+	}
+
+	int getPresidentCounter() const {
+		return presidentCounter;
+	}
+
+	int getPresidentId() const {
+		return presidentId;
+	}
+
+	int getChancellorId() const {
+		return chancellorId;
+	}
+
+	int getElectionTracker() const {
+		return electionTracker;
+	}
+
+	int getPreviousPresidentId() const {
+		return previousPresidentId;
+	}
+
+	int getPreviousChancellorId() const {
+		return previousChancellorId;
+	}
+
+	int getHitler() const {
+		return hitler;
+	}
+
+	Team getFirstPolicy() const {
+		return static_cast<Team>(firstPolicy);
+	}
+
+	Team getSecondPolicy() const {
+		return static_cast<Team>(secondPolicy);
+	}
+
+	Team getThirdPolicy() const {
+		return static_cast<Team>(thirdPolicy);
+	}
+
+	// the number of policies left to draw; the end of the deck is marked by its highest set bit
+	int getDeckSize() const {
+		int size = policyCount;
+		while (size > 0 && !deck[size]) {
+			size--;
+		}
+		return size;
+	}
+
+	int getDeckLiberals() const {
+		return deck.count() - 1;
+	}
+
+	/** Whether two games play out the same from here, for tools that search the game tree
+	 *
+	 * How players voted is left out, since it is cleared before every election and only ever reported.
+	 * The random number generator is compared too, as it decides every later shuffle.
+	 */
+	bool samePosition(const GameState &other) const {
+		for (int i = 0; i < playerCount; i++) {
+			if (players[i].position() != other.players[i].position()) {
+				return false;
+			}
+		}
+		return rng == other.rng && playerCount == other.playerCount && deck == other.deck && state == other.state
+				&& liberalPolicies == other.liberalPolicies && fascistPolicies == other.fascistPolicies
+				&& hitler == other.hitler && presidentCounter == other.presidentCounter
+				&& presidentId == other.presidentId && chancellorId == other.chancellorId
+				&& electionTracker == other.electionTracker && previousPresidentId == other.previousPresidentId
+				&& previousChancellorId == other.previousChancellorId && firstPolicy == other.firstPolicy
+				&& secondPolicy == other.secondPolicy && thirdPolicy == other.thirdPolicy;
+	}
+
+	size_t positionHash() const {
+		auto next = rng;
+		uint64_t h = next();
+		auto mix = [&h](uint64_t v) {
+			h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+		};
+		for (int i = 0; i < playerCount; i++) {
+			mix(players[i].position());
+		}
+		mix(deck.to_ulong());
+		mix(state | liberalPolicies << 4 | fascistPolicies << 8 | electionTracker << 12 | firstPolicy << 16
+				| secondPolicy << 17 | thirdPolicy << 18);
+		mix((presidentCounter & 31) | (presidentId & 31) << 5 | (chancellorId & 31) << 10
+				| (previousPresidentId & 31) << 15 | (previousChancellorId & 31) << 20 | (hitler & 31) << 25);
+		return h;
+	}
+
+	/** Re-deals everything `seat` can't see, for searches that mustn't peek at hidden information
+	 *
+	 * The teams of living players outside `known` are shuffled among themselves, so Hitler may move too.
+	 * The order of the deck, the votes other players have cast but not revealed, and the seed of later
+	 * shuffles are all drawn again from `r`. Dead players keep their teams, since they were never Hitler.
+	 */
+	template <typename Rng>
+	void redeal(int seat, PlayerMask known, Rng &r) {
+		std::array<int, MAX_PLAYERS> seats;
+		std::array<int, MAX_PLAYERS> roles;
+		enum { LIBERAL_ROLE, FASCIST_ROLE, HITLER_ROLE };
+		int unknown = 0;
+		for (int i = 0; i < playerCount; i++) {
+			if (known[i] || !players[i].alive()) {
+				continue;
+			}
+			seats[unknown] = i;
+			roles[unknown] = i == hitler ? HITLER_ROLE : players[i].team() == FASCIST ? FASCIST_ROLE : LIBERAL_ROLE;
+			unknown++;
+		}
+		std::shuffle(roles.begin(), roles.begin() + unknown, r);
+		for (int k = 0; k < unknown; k++) {
+			players[seats[k]].team(roles[k] == LIBERAL_ROLE ? LIBERAL : FASCIST);
+			if (roles[k] == HITLER_ROLE) {
+				hitler = seats[k];
+			}
+		}
+
+		for (int i = 0; i < playerCount; i++) {
+			if (i != seat) {
+				players[i].voted(false);
+			}
+		}
+
+		int size = getDeckSize();
+		int liberals = getDeckLiberals();
+		deck.reset();
+		for (int i = 0; i < size; i++) {
+			if (std::uniform_int_distribution(0, size - i - 1)(r) < liberals) {
+				liberals--;
+				deck[i] = LIBERAL;
+			}
+		}
+		deck[size] = 1;
+		rng.seed(r());
+	}
+
+	bool hasVoted(int id) const {
+		return players[id].voted();
+	}
+
+	// TODO: rename this
+	PlayerMask getEligibleChancellors() const {
+		PlayerMask result(0);
+		for (auto i = 0; i < playerCount; i++) {
+			result[i] = chancellorIsValid(i);
+		}
+		return result;
+	}
+
+	PlayerMask eligibleForInvestigation() const {
+		PlayerMask result(0);
+		for (auto i = 0; i < playerCount; i++) {
+			result[i] = canBeInvestigated(i);
+		}
+		return result;
+	}
+
+	PlayerMask alive() const {
+		PlayerMask result(0);
+		for (auto i = 0; i < playerCount; i++) {
+			result[i] = players[i].alive();
+		}
+		return result;
+	}
+
+	PlayerMask getBallot() const {
+		PlayerMask result(0);
+		for (auto i = 0; i < playerCount; i++) {
+			result[i] = players[i].lastVote();
+		}
+		return result;
+	}
+
+	PlayerMask getTeams() const {
+		PlayerMask result(0);
+		for (auto i = 0; i < playerCount; i++) {
+			result[i] = players[i].team() == LIBERAL;
+		}
+		return result;
+	}
+};
+
+static_assert(std::is_trivially_copyable_v<GameState>, "game states are copied with memcpy");
+static_assert(sizeof(GameState) <= 64, "a game state should fit in a cache line");
+
+#endif //SERVER_GAME_STATE_H
@@ -0,0 +1,88 @@
+#ifndef SERVER_LOBBY_INDEX_H
+#define SERVER_LOBBY_INDEX_H
+#include <cinttypes>
+#include <string_view>
+#include <vector>
+
+/** The games that haven't started yet, kept up to date by their managers
+ *
+ * Entries are packed into a vector, and each manager remembers where its entry is, so adding, updating and
+ * removing are all O(1) and a page of the listing is a slice of the vector. Removal moves the last entry
+ * into the hole and tells its manager the new position.
+ *
+ * Every change is also sent to `onChange` as a delta:
+ * byte 0: UPSERT or REMOVE, bytes 1-4: the game id (big endian), byte 5: player count,
+ * bytes 6-7: a bitmask of ready players (big endian)
+ */
+class LobbyIndex {
+public:
+	struct Entry {
+		uint32_t gameId;
+		uint8_t players;
+		uint16_t ready;
+		int *position;
+	};
+
+	enum Delta {
+		UPSERT = 0,
+		REMOVE = 1,
+	};
+
+	using Listener = void (*)(void *context, std::string_view delta);
+	Listener onChange = nullptr;
+	void *listenerContext = nullptr;
+
+private:
+	std::vector<Entry> entries;
+
+	void notify(Delta type, const Entry &e) {
+		if (!onChange) {
+			return;
+		}
+		char delta[8] = {
+			static_cast<char>(type),
+			static_cast<char>(e.gameId >> 24), static_cast<char>(e.gameId >> 16),
+			static_cast<char>(e.gameId >> 8), static_cast<char>(e.gameId),
+			static_cast<char>(e.players),
+			static_cast<char>(e.ready >> 8), static_cast<char>(e.ready)
+		};
+		onChange(listenerContext, std::string_view(delta, sizeof(delta)));
+	}
+
+public:
+	/** Adds or updates the entry whose position is stored in *position (-1 if it isn't listed) */
+	void upsert(int *position, uint32_t gameId, int players, uint16_t ready) {
+		if (*position < 0) {
+			*position = entries.size();
+			entries.push_back({ gameId, 0, 0, position });
+		}
+		auto &e = entries[*position];
+		e.players = players;
+		e.ready = ready;
+		notify(UPSERT, e);
+	}
+
+	void remove(int *position) {
+		if (*position < 0) {
+			return;
+		}
+		notify(REMOVE, entries[*position]);
+		entries[*position] = entries.back();
+		*entries[*position].position = *position;
+		entries.pop_back();
+		*position = -1;
+	}
+
+	template <typename F>
+	void forEach(size_t offset, size_t count, F f) const {
+		for (auto i = offset; i < entries.size() && i < offset + count; i++) {
+			f(entries[i]);
+		}
+	}
+
+	size_t size() const {
+		return entries.size();
+	}
+};
+
+#endif //SERVER_LOBBY_INDEX_H
@@ -1,111 +1,570 @@
-#include <fmt/core.h>
+#include <fmt/format.h>
 #include <cstdlib>
+#include <optional>
+#include <thread>
+#include <unordered_set>
 #include <ignore.h>
+#include "allocationCounter.h"
+#include "bot.h"
+#include "compression.h"
+#include "delayedStream.h"
+#include "drain.h"
+#include "gameKey.h"
+#include "gameLog.h"
+#include "lobbyIndex.h"
 #include "manager.h"
+#include "matchmaker.h"
+#include "metrics.h"
+#include "processes.h"
+#include "rateLimit.h"
+#include "slab.h"
 #include "slotMap.h"
+#include "tls.h"
+#include "trace.h"
 
-uint32_t decodeKey(std::string_view s) {
-    uint32_t residue = 16 * ((1U << ((s.size() - 1) * 4)) - 1) / 15;
+// the pub/sub topic that spectators of a game subscribe to
+std::string_view spectatorTopic(uint32_t gameId, char (&buffer)[16]) {
+	auto end = fmt::format_to_n(buffer, sizeof(buffer), "g{:x}", gameId).out;
+	return std::string_view(buffer, end - buffer);
+}
 
-    uint32_t main = s.back() - 'a';
-    for (int i = s.size() - 2; i >= 0; --i) {
-        main *= 16;
-        main += s[i] - 'a';
-    }
-    return main + residue;
+std::string_view delayedTopic(uint32_t gameId, char (&buffer)[16]) {
+	auto end = fmt::format_to_n(buffer, sizeof(buffer), "d{:x}", gameId).out;
+	return std::string_view(buffer, end - buffer);
 }
 
-int main() {
-	/*
-	const char *key_file_key = "SSL_KEY";
-	const char *key_file_name = getenv(key_file_key);
-	const char *cert_file_key = "SSL_CERT";
-	const char *cert_file_name = getenv(cert_file_key);
-	if (!(cert_file_name && key_file_name)) {
-		fmt::print("Couldn't find cert_file and key_file. Please ensure "
-			 "environment variables, {} and {} are set.\n", cert_file_key, key_file_key);
-		return 1;
+template <bool SSL>
+void serve(uWS::TemplatedApp<SSL> &&app, processes::Worker worker) {
+	using WebSocket = uWS::WebSocket<SSL, true>;
+	using UserData = ::UserData<WebSocket>;
+	using Manager = ::Manager<WebSocket>;
+	using SlotMap = ::SlotMap<WebSocket>;
+
+	SlotMap managers(worker.shard(), worker.shards());
+	const AdmissionLimits limits = AdmissionLimits::fromEnvironment();
+	RateLimitTable createLimiter;
+
+	// closes the upgrade with REDIRECT, naming the own port of this node's worker `index`
+	auto sendTo = [worker](WebSocket *ws, unsigned index) {
+		char port[8];
+		auto end = fmt::format_to_n(port, sizeof(port), "{}", processes::portOf(index, worker.firstPort)).out;
+		metrics::local().redirects.inc();
+		ws->end(processes::REDIRECT, std::string_view(port, end - port));
+	};
+
+	// a game another worker holds, which the client reconnects to on that worker's own port
+	auto redirect = [worker, &sendTo](WebSocket *ws, uint32_t gameId) {
+		auto owner = processes::ownerOf(gameId, worker.shards());
+		if (owner == worker.shard()) {
+			return false;
+		}
+		// every worker of a draining process has closed its own port
+		if (drain::requested()) {
+			ws->end(4503);
+			return true;
+		}
+		// the coordinator sends joins to the right node, so this key was never handed out here
+		if (owner % worker.nodes != worker.node) {
+			ws->end(4500);
+			return true;
+		}
+		sendTo(ws, owner / worker.nodes);
+		return true;
+	};
+
+	// checked before a manager is placed into a slot, so a refused upgrade costs no game state
+	// quickplay counts as a create, since every table it fills is a game
+	auto admitCreate = [&](WebSocket *ws) {
+		return createLimiter.take(ws->getRemoteAddress(), limits.createPerAddress, currentMillis())
+				&& limits.roomForGame(managers);
+	};
+
+	const char *delayKey = "SH_SPECTATOR_DELAY";
+	const char *delay = getenv(delayKey);
+	DelayedStream<WebSocket> delayedStream(1000 * (delay ? std::strtoul(delay, nullptr, 10) : 60));
+
+	// how long the oldest quickplay player waits for a full table before a smaller game starts
+	const char *matchWaitKey = "SH_MATCH_WAIT_MS";
+	const char *matchWait = getenv(matchWaitKey);
+	uint32_t matchWaitMillis = matchWait ? std::strtoul(matchWait, nullptr, 10) : 10000;
+
+	// how long before a quickplay table short of five is filled with bots; 0 turns bots off
+	const char *botFillKey = "SH_BOT_FILL_MS";
+	const char *botFill = getenv(botFillKey);
+	uint32_t botFillMillis = botFill ? std::strtoul(botFill, nullptr, 10) : 30000;
+	// rollout threads in each worker process
+	const char *botThreadsKey = "SH_BOT_THREADS";
+	const char *botThreads = getenv(botThreadsKey);
+	const char *botRolloutsKey = "SH_BOT_ROLLOUTS";
+	const char *botRollouts = getenv(botRolloutsKey);
+	std::optional<BotPool<WebSocket>> bots;
+	if (botFillMillis) {
+		// by default every worker gets an equal share of the cores, so together they never oversubscribe them
+		unsigned share = std::max(std::thread::hardware_concurrency() / worker.count, 1U);
+		bots.emplace(botThreads ? std::strtoul(botThreads, nullptr, 10) : share,
+				botRollouts ? std::strtoul(botRollouts, nullptr, 10) : 512);
 	}
-	*/
+	Matchmaker<WebSocket> matchmaker(matchWaitMillis, limits, bots ? &*bots : nullptr, botFillMillis);
 
-	SlotMap managers;
+	// after SIGTERM, how long to wait for games to end before ending them anyway; 0 waits as long as they last
+	const char *drainTimeoutKey = "SH_DRAIN_TIMEOUT_S";
+	const char *drainTimeout = getenv(drainTimeoutKey);
+	struct Draining {
+		// the shared port, and the worker's own
+		std::array<us_listen_socket_t *, 2> listenSockets = {};
+		uint32_t timeoutMillis;
+		bool active = false;
+		uint32_t since = 0;
+	};
+	Draining draining{ {}, 1000 * static_cast<uint32_t>(drainTimeout ? std::strtoul(drainTimeout, nullptr, 10) : 3600) };
+	// spectators and lobby watchers, which no game holds on to, so the drain can close them at the end
+	std::unordered_set<WebSocket *> watchers;
 
-	// uWS::App({
-		// .key_file_name = key_file_name,
-		// .cert_file_name = cert_file_name
-	// }).ws<UserData>("/joinGame/:game", {
-	uWS::App().ws<UserData>("/join/:game", {
+	struct TimerContext {
+		uWS::TemplatedApp<SSL> *app;
+		SlotMap *managers;
+		DelayedStream<WebSocket> *delayedStream;
+		Matchmaker<WebSocket> *matchmaker;
+		Draining *draining;
+		std::unordered_set<WebSocket *> *watchers;
+	};
+	TimerContext timerContext{ &app, &managers, &delayedStream, &matchmaker, &draining, &watchers };
+	auto *timer = us_create_timer(reinterpret_cast<us_loop_t *>(uWS::Loop::get()), 0, sizeof(TimerContext *));
+	*static_cast<TimerContext **>(us_timer_ext(timer)) = &timerContext;
+	us_timer_set(timer, [](us_timer_t *t) {
+		auto *context = *static_cast<TimerContext **>(us_timer_ext(t));
+		context->delayedStream->drain(*context->managers, [context](uint32_t gameId, std::string_view message) {
+			char buffer[16];
+			context->app->publish(delayedTopic(gameId, buffer), message, uWS::OpCode::BINARY, false);
+		});
+		context->matchmaker->tick(*context->managers, currentMillis());
+		// at most one write every tick, however many games ended since the last one
+		gameLog::flush();
+
+		auto &draining = *context->draining;
+		if (drain::requested() && !draining.active) {
+			// the new process is already listening on the same port, so new connections go there
+			for (auto *&listenSocket : draining.listenSockets) {
+				if (listenSocket) {
+					us_listen_socket_close(SSL, listenSocket);
+					listenSocket = nullptr;
+				}
+			}
+			// a lobby here would only be cut off later, so its players create it again on the new process
+			context->managers->forEach([](Manager &m) {
+				m.closeLobby(drain::LOBBY_CLOSED);
+			});
+			context->matchmaker->closeAll(drain::LOBBY_CLOSED);
+			draining.active = true;
+			draining.since = currentMillis();
+			metrics::local().draining.inc();
+			std::cout << "Draining " << context->managers->size() << " games..." << std::endl;
+		}
+		if (!draining.active) {
+			return;
+		}
+		bool timedOut = draining.timeoutMillis && currentMillis() - draining.since >= draining.timeoutMillis;
+		if (context->managers->size() > 0 && !timedOut) {
+			return;
+		}
+		std::cout << "Drained, " << context->managers->size() << " games left" << std::endl;
+		// with every game, connection and listener closed, app.run() returns
+		context->managers->forEach([](Manager &m) {
+			m.destroyGame();
+		});
+		auto watchers = std::move(*context->watchers);
+		context->watchers->clear();
+		for (auto *ws : watchers) {
+			ws->end(1001);
+		}
+		us_timer_close(t);
+	}, 100, 100);
+
+	LobbyIndex lobbies;
+	lobbies.listenerContext = &app;
+	lobbies.onChange = [](void *context, std::string_view delta) {
+		static_cast<uWS::TemplatedApp<SSL> *>(context)->publish("lobbies", delta, uWS::OpCode::BINARY, false);
+	};
+	Manager::lobbies = &lobbies;
+
+	Manager::publisherContext = &app;
+	Manager::publisher = [](void *context, uint32_t gameId, std::string_view message) {
+		char buffer[16];
+		static_cast<uWS::TemplatedApp<SSL> *>(context)->publish(spectatorTopic(gameId, buffer), message,
+				uWS::OpCode::BINARY, compressionPolicy.shouldCompress(message));
+	};
+
+	app.template ws<UserData>("/join/:game", {
+        .compression = compressionPolicy.options,
         .idleTimeout = 60 * 60,
-		.open = [&managers](WebSocket *ws, uWS::HttpRequest *req) {
+		.open = [&managers, &redirect](WebSocket *ws, uWS::HttpRequest *req) {
 			auto *data = static_cast<UserData *>(ws->getUserData());
 			new (data) UserData;
 			data->socket = ws;
-			SlotMap::Key key(decodeKey(req->getParameter(0)));
+			metrics::local().connectedClients.inc();
+			data->version = protocolV2::requested(req->getQuery());
+			if (!data->version) {
+				ws->end(protocolV2::UNSUPPORTED);
+				return;
+			}
+			auto id = gameKey::decode(req->getParameter(0));
+			if (!id) {
+				ws->end(4500);
+				return;
+			}
+			if (redirect(ws, *id)) {
+				return;
+			}
+			typename SlotMap::Key key(*id);
 			auto manager = managers[key];
 			if (!manager) {
 				ws->end(4500);
 				return;
 			}
-			Manager &m = manager.value();
-			data->playerId = m.addClient(ws);
-			data->manager = &m;
+			manager.value().get().join(ws);
 		},
-		.message = [](WebSocket *ws, std::string_view message, uWS::OpCode opCode) {
+		.message = [&limits](WebSocket *ws, std::string_view message, uWS::OpCode opCode) {
 			if (opCode != uWS::OpCode::BINARY) {
 				return;
 			}
 
 			auto *data = static_cast<UserData *>(ws->getUserData());
+			if (!data->messageBucket.take(limits.messagesPerSocket, currentMillis())) {
+				metrics::local().droppedMessages.inc();
+				return;
+			}
+			trace::begin();
+			trace::record(trace::RECEIVE, message.empty() ? 0 : static_cast<unsigned char>(message[0]), data->playerId);
 			data->manager->handleMessage(data->playerId, message);
+			trace::end();
 		},
 		.close = [](WebSocket *ws, int code, std::string_view message) {
             ignoreUnused(message);
             auto *data = static_cast<UserData *>(ws->getUserData());
             data->~UserData();
-            if (code == 4500) {
+            metrics::local().connectedClients.dec();
+            if (code == 4500 || code == 4503 || code == processes::REDIRECT || code == protocolV2::UNSUPPORTED) {
                 return;
             }
 			data->manager->onDisconnect(data->playerId, code);
 		}
-	}).ws<UserData>("/create", {
+	}).template ws<UserData>("/create", {
+        .compression = compressionPolicy.options,
         .idleTimeout = 60 * 60,
-		.open = [&managers](WebSocket *ws, uWS::HttpRequest *req) {
-			ignoreUnused(req);
+		.open = [&managers, &admitCreate, &draining](WebSocket *ws, uWS::HttpRequest *req) {
 			auto *data = static_cast<UserData *>(ws->getUserData());
             new (data) UserData;
 			data->socket = ws;
-			SlotMap::Key key = managers.getSlot();
-			auto manager = managers[key];
+			metrics::local().connectedClients.inc();
+			data->version = protocolV2::requested(req->getQuery());
+			if (!data->version) {
+				ws->end(protocolV2::UNSUPPORTED);
+				return;
+			}
+			// upgrades that were already on their way in when the listening socket closed
+			if (draining.active || !admitCreate(ws)) {
+				metrics::local().refusedUpgrades.inc();
+				ws->end(4503);
+				return;
+			}
+			// every key this worker can hand out may be taken, however much memory is left
+			auto key = managers.getSlot();
+			if (!key) {
+				metrics::local().refusedUpgrades.inc();
+				ws->end(4503);
+				return;
+			}
+			auto manager = managers[*key];
 			if (!manager) {
 				ws->end(100);
 				return;
 			}
 			Manager &m = manager.value();
-			data->playerId = m.addClient(ws);
-			data->manager = &m;
-			m.sendGameKey(data->playerId, key.gameId());
+			m.join(ws);
+			m.sendGameKey(data->playerId, key->gameId());
 		},
-		.message = [](WebSocket *ws, std::string_view message, uWS::OpCode opCode) {
+		.message = [&limits](WebSocket *ws, std::string_view message, uWS::OpCode opCode) {
 			if (opCode != uWS::OpCode::BINARY) {
 				return;
 			}
 
 			auto *data = static_cast<UserData *>(ws->getUserData());
+			if (!data->messageBucket.take(limits.messagesPerSocket, currentMillis())) {
+				metrics::local().droppedMessages.inc();
+				return;
+			}
+			trace::begin();
+			trace::record(trace::RECEIVE, message.empty() ? 0 : static_cast<unsigned char>(message[0]), data->playerId);
 			data->manager->handleMessage(data->playerId, message);
+			trace::end();
 		},
 		.close = [](WebSocket *ws, int code, std::string_view message) {
 			ignoreUnused(message);
             auto *data = static_cast<UserData *>(ws->getUserData());
             data->~UserData();
-            if (code == 4500) {
+            metrics::local().connectedClients.dec();
+            if (code == 4500 || code == 4503 || code == processes::REDIRECT || code == protocolV2::UNSUPPORTED) {
                 return;
             }
 			data->manager->onDisconnect(data->playerId, code);
 		}
-	}).listen("0.0.0.0", 4545, [](auto *listenSocket) {
+	}).template ws<UserData>("/quickplay", {
+        .compression = compressionPolicy.options,
+        .idleTimeout = 60 * 60,
+		.open = [&matchmaker, &admitCreate, &draining, &sendTo, worker](WebSocket *ws, uWS::HttpRequest *req) {
+			auto *data = static_cast<UserData *>(ws->getUserData());
+			new (data) UserData;
+			data->socket = ws;
+			metrics::local().connectedClients.inc();
+			data->version = protocolV2::requested(req->getQuery());
+			if (!data->version) {
+				ws->end(protocolV2::UNSUPPORTED);
+				return;
+			}
+			// one queue per node, on its first worker, so waiting players aren't split between workers
+			if (worker.index != 0 && !draining.active) {
+				sendTo(ws, 0);
+				return;
+			}
+			if (draining.active || !admitCreate(ws)) {
+				metrics::local().refusedUpgrades.inc();
+				ws->end(4503);
+				return;
+			}
+			matchmaker.enqueue(ws, currentMillis());
+		},
+		.message = [&limits](WebSocket *ws, std::string_view message, uWS::OpCode opCode) {
+			if (opCode != uWS::OpCode::BINARY) {
+				return;
+			}
+
+			auto *data = static_cast<UserData *>(ws->getUserData());
+			// still waiting for a game
+			if (!data->manager) {
+				return;
+			}
+			if (!data->messageBucket.take(limits.messagesPerSocket, currentMillis())) {
+				metrics::local().droppedMessages.inc();
+				return;
+			}
+			trace::begin();
+			trace::record(trace::RECEIVE, message.empty() ? 0 : static_cast<unsigned char>(message[0]), data->playerId);
+			data->manager->handleMessage(data->playerId, message);
+			trace::end();
+		},
+		.close = [&matchmaker](WebSocket *ws, int code, std::string_view message) {
+			ignoreUnused(message);
+			auto *data = static_cast<UserData *>(ws->getUserData());
+			data->~UserData();
+			metrics::local().connectedClients.dec();
+			if (!data->manager) {
+				matchmaker.remove(ws);
+				return;
+			}
+			data->manager->onDisconnect(data->playerId, code);
+		}
+	}).template ws<UserData>("/spectate/:game", {
+        .compression = compressionPolicy.options,
+        .idleTimeout = 60 * 60,
+		.open = [&managers, &redirect, &watchers](WebSocket *ws, uWS::HttpRequest *req) {
+			auto *data = static_cast<UserData *>(ws->getUserData());
+			new (data) UserData;
+			data->socket = ws;
+			data->playerId = Manager::SPECTATOR;
+			auto id = gameKey::decode(req->getParameter(0));
+			if (!id) {
+				ws->end(4500);
+				return;
+			}
+			if (redirect(ws, *id)) {
+				return;
+			}
+			typename SlotMap::Key key(*id);
+			auto manager = managers[key];
+			if (!manager) {
+				ws->end(4500);
+				return;
+			}
+			char buffer[16];
+			ws->subscribe(spectatorTopic(key.gameId(), buffer));
+			manager.value().get().addSpectator(ws);
+			data->gameId = key.gameId();
+			watchers.insert(ws);
+		},
+		.close = [&managers, &watchers](WebSocket *ws, int code, std::string_view message) {
+			ignoreUnused(message);
+			auto *data = static_cast<UserData *>(ws->getUserData());
+			data->~UserData();
+			if (code == 4500 || code == processes::REDIRECT) {
+				return;
+			}
+			watchers.erase(ws);
+			// the game may have ended and its slot been reused while we were watching
+			auto manager = managers[typename SlotMap::Key(data->gameId)];
+			if (manager) {
+				manager.value().get().removeSpectator();
+			}
+		}
+	}).template ws<UserData>("/delayed/:game", {
+        .compression = compressionPolicy.options,
+        .idleTimeout = 60 * 60,
+		.open = [&managers, &delayedStream, &redirect, &watchers](WebSocket *ws, uWS::HttpRequest *req) {
+			auto *data = static_cast<UserData *>(ws->getUserData());
+			new (data) UserData;
+			data->socket = ws;
+			data->playerId = Manager::SPECTATOR;
+			auto id = gameKey::decode(req->getParameter(0));
+			if (!id) {
+				ws->end(4500);
+				return;
+			}
+			if (redirect(ws, *id)) {
+				return;
+			}
+			typename SlotMap::Key key(*id);
+			auto manager = managers[key];
+			if (!manager) {
+				ws->end(4500);
+				return;
+			}
+			char buffer[16];
+			ws->subscribe(delayedTopic(key.gameId(), buffer));
+			manager.value().get().addDelayedSpectator(ws, delayedStream.ringFor(key.gameId()));
+			watchers.insert(ws);
+		},
+		.close = [&watchers](WebSocket *ws, int code, std::string_view message) {
+			ignoreUnused(code, message);
+			static_cast<UserData *>(ws->getUserData())->~UserData();
+			watchers.erase(ws);
+		}
+	}).template ws<UserData>("/lobbies/watch", {
+        .compression = compressionPolicy.options,
+        .idleTimeout = 60 * 60,
+		.open = [&watchers](WebSocket *ws, uWS::HttpRequest *req) {
+			ignoreUnused(req);
+			ws->subscribe("lobbies");
+			watchers.insert(ws);
+		},
+		.close = [&watchers](WebSocket *ws, int code, std::string_view message) {
+			ignoreUnused(code, message);
+			watchers.erase(ws);
+		}
+	}).get("/lobbies", [&lobbies](auto *res, uWS::HttpRequest *req) {
+		constexpr size_t pageSize = 50;
+		auto query = req->getQuery();
+		auto pageStart = query.find("page=");
+		size_t page = pageStart == std::string_view::npos ? 0 : std::strtoul(query.data() + pageStart + 5, nullptr, 10);
+		std::string out = fmt::format("{{\"total\":{},\"lobbies\":[", lobbies.size());
+		bool first = true;
+		lobbies.forEach(page * pageSize, pageSize, [&](const LobbyIndex::Entry &e) {
+			fmt::format_to(std::back_inserter(out), "{}{{\"id\":{},\"key\":\"{}\",\"players\":{},\"ready\":{}}}",
+					first ? "" : ",", e.gameId, gameKey::encode(e.gameId), e.players, e.ready);
+			first = false;
+		});
+		out += "]}";
+		res->writeHeader("Content-Type", "application/json")->end(out);
+	}).get("/metrics", [worker](auto *res, uWS::HttpRequest *req) {
+		ignoreUnused(req);
+		auto out = metrics::render();
+		slab::render(out);
+		// the shared port reaches any one worker, so scrapers find the others' own ports here
+		fmt::format_to(std::back_inserter(out), "# TYPE sh_workers gauge\nsh_workers {}\n"
+				"# TYPE sh_first_worker_port gauge\nsh_first_worker_port {}\n", worker.count, worker.firstPort);
+		if constexpr (allocations::counting()) {
+			fmt::format_to(std::back_inserter(out), "# TYPE sh_heap_allocations_total counter\nsh_heap_allocations_total {}\n",
+					allocations::total());
+		}
+		res->writeHeader("Content-Type", "text/plain; version=0.0.4")->end(out);
+	}).get("/trace", [](auto *res, uWS::HttpRequest *req) {
+		ignoreUnused(req);
+		res->writeHeader("Content-Type", "application/json")->end(trace::renderChromeTrace());
+	}).listen("0.0.0.0", worker.port, [&draining](auto *listenSocket) {
         if (listenSocket) {
+            draining.listenSockets[0] = listenSocket;
             std::cout << "Listening for connections..." << std::endl;
         }
-    }).run();
+    });
+	if (worker.count > 1) {
+		auto own = processes::portOf(worker.index, worker.firstPort);
+		// only this worker may hold its port, or redirects could reach another process
+		app.listen("0.0.0.0", own, LIBUS_LISTEN_EXCLUSIVE_PORT, [&draining, worker, own](auto *listenSocket) {
+			if (listenSocket) {
+				draining.listenSockets[1] = listenSocket;
+				std::cout << "Worker " << worker.index << " also listening on " << own << std::endl;
+			} else {
+				std::cerr << "Worker " << worker.index << " can't listen on " << own
+						<< ", which another process holds; give each deploy its own SH_WORKER_PORT" << std::endl;
+				raise(SIGTERM);
+			}
+		});
+	}
+	app.run();
+	gameLog::flush();
+}
+
+int main() {
+	const char *processesKey = "SH_PROCESSES";
+	const char *processCount = getenv(processesKey);
+	unsigned count = processCount ? std::max(1UL, std::strtoul(processCount, nullptr, 10)) : 1;
+	// this server's index in the coordinator's SH_CLUSTER list, and the length of the list
+	const char *nodeKey = "SH_NODE";
+	const char *nodeCountKey = "SH_NODES";
+	const char *node = getenv(nodeKey);
+	const char *nodeCount = getenv(nodeCountKey);
+	unsigned nodes = nodeCount ? std::max(1UL, std::strtoul(nodeCount, nullptr, 10)) : 1;
+	if (count * nodes > processes::MAX) {
+		std::cerr << "SH_PROCESSES times SH_NODES can be at most " << processes::MAX << std::endl;
+		return 1;
+	}
+	// every set of games a shard holds takes one of the key's major indexes, which the shards share
+	auto capacity = SlotMap<uWS::WebSocket<false, true>>::capacity(count * nodes);
+	auto maxGames = AdmissionLimits::fromEnvironment().maxGames;
+	if (maxGames > capacity) {
+		std::cerr << "With SH_PROCESSES times SH_NODES at " << count * nodes << ", SH_MAX_GAMES can be at most "
+				<< capacity << std::endl;
+		return 1;
+	}
+	if (!maxGames && count * nodes > 1) {
+		std::cout << "Each worker can hold " << capacity << " games" << std::endl;
+	}
+
+	// before anything else, so every worker starts from a clean process
+	auto worker = processes::supervise(count);
+	worker.nodes = nodes;
+	worker.node = node ? std::strtoul(node, nullptr, 10) % nodes : 0;
+	const char *portKey = "SH_PORT";
+	if (const char *port = getenv(portKey)) {
+		worker.port = std::atoi(port);
+	}
+	const char *workerPortKey = "SH_WORKER_PORT";
+	const char *workerPort = getenv(workerPortKey);
+	worker.firstPort = workerPort ? std::atoi(workerPort) : worker.port + 1;
+
+	const char *traceSampleKey = "SH_TRACE_SAMPLE";
+	if (const char *rate = getenv(traceSampleKey)) {
+		trace::configure(std::strtoul(rate, nullptr, 10));
+	}
+	const char *gameLogKey = "SH_GAME_LOG";
+	if (const char *file = getenv(gameLogKey)) {
+		gameLog::configure(file);
+	}
+
+	compressionPolicy = CompressionPolicy::fromEnvironment();
+	drain::install();
+
+	auto tls = TlsConfig::fromEnvironment();
+	if (!tls) {
+		serve(uWS::App(), worker);
+		return 0;
+	}
+	uWS::SSLApp app({
+		.key_file_name = tls->keyFile,
+		.cert_file_name = tls->certFile,
+		.passphrase = tls->passphrase
+	});
+	if (!configureTls(static_cast<SSL_CTX *>(app.getNativeHandle()), *tls)) {
+		return 1;
+	}
+	serve(std::move(app), worker);
 	return 0;
 }
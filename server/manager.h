@@ -1,70 +1,126 @@
 #ifndef SERVER_COMMUNICATION_MANAGER_H
 #define SERVER_COMMUNICATION_MANAGER_H
 #include <cinttypes>
-#include <list>
 #include <algorithm>
+#include <chrono>
 #include <App.h> // uWebSockets
 #include "common.h"
+#include "compression.h"
+#include "eventRing.h"
 #include "game.h"
+#include "gameLog.h"
+#include "lobbyIndex.h"
+#include "messageQueue.h"
+#include "metrics.h"
+#include "protocol.h"
+#include "protocolV2.h"
+#include "rateLimit.h"
+#include "trace.h"
+
+template <typename Socket>
+class Manager;
 
-// using WebSocket = uWS::WebSocket<true, true>;
-using WebSocket = uWS::WebSocket<false, true>;
+template <typename Socket>
+struct UserData {
+	Socket *socket;
+	Manager<Socket> *manager = nullptr;
+	MessageQueue queue;
+	int playerId;
+	uint32_t gameId;
+	TokenBucket messageBucket;
+	// how many frames at the back of the queue are held by a cork rather than by backpressure
+	uint16_t corked = 0;
+	// of the protocol sent to this socket; see protocolV2.h
+	uint8_t version = 1;
 
-struct Message {
-	int length;
-	char data[256];
-	Message() = default;
+	~UserData() {
+		metrics::local().queuedMessages.add(-static_cast<int64_t>(queue.size() - corked));
+	}
 };
 
-class Manager;
-struct UserData {
-	WebSocket *socket;
-	Manager *manager;
-	std::list<Message> queue;
-	int playerId;
+/** A seat played by the server instead of a WebSocket; see bot.h
+ *
+ * A bot gets every frame its seat would be sent, and answers through Manager::handleMessage like a client.
+ * end() is called when the seat is given up, after which the bot must not touch the game again.
+ */
+class alignas(8) BotSeat {
+public:
+	virtual void receive(std::string_view message) = 0;
+	virtual void setId(int id) = 0;
+	virtual void end(int code) = 0;
+
+protected:
+	~BotSeat() = default;
 };
 
+/** A seat in a game
+ * @tparam Socket: the WebSocket type, which differs between plain and TLS connections
+ */
+template <typename Socket>
 class Client {
+public:
+	static constexpr int MAX_NAME_SIZE = 32;
+
 private:
-	WebSocket *socket = nullptr;
-	std::string name;
+	// the lower 2 bits of socket are flags, and the third marks a BotSeat rather than a Socket
+	static constexpr uintptr_t BOT = 4;
+	static constexpr uintptr_t TAGS = 7;
+
+	Socket *socket = nullptr;
+	// names are stored inline so that renaming never allocates
+	uint8_t nameLength = 0;
+	char name[MAX_NAME_SIZE];
 
-	WebSocket *getSocket() {
-		// we are using the lower 2 bits of socket for flags
-		return reinterpret_cast<WebSocket *>(reinterpret_cast<uintptr_t>(socket) & ~static_cast<uintptr_t>(3));
+	uintptr_t target() const {
+		return reinterpret_cast<uintptr_t>(socket) & ~TAGS;
+	}
+
+	bool isBot() const {
+		return (reinterpret_cast<uintptr_t>(socket) & BOT) == BOT;
+	}
+
+	Socket *getSocket() {
+		return isBot() ? nullptr : reinterpret_cast<Socket *>(target());
+	}
+
+	BotSeat *getBot() {
+		return isBot() ? reinterpret_cast<BotSeat *>(target()) : nullptr;
+	}
+
+	void end(int code) {
+		if (auto *bot = getBot()) {
+			bot->end(code);
+		} else if (auto *s = getSocket()) {
+			s->end(code);
+		}
 	}
 
 public:
 	Client() = default;
 
-	explicit Client(WebSocket *ws) : socket(ws) {}
+	explicit Client(Socket *ws) : socket(ws) {}
 
-	Client(Client &&other) : name(std::move(other.name)) {
-		auto s = getSocket();
-		if (s) {
-			s->end(4000);
-		}
+	explicit Client(BotSeat *bot) : socket(reinterpret_cast<Socket *>(reinterpret_cast<uintptr_t>(bot) | BOT)) {}
+
+	Client(Client &&other) : nameLength(other.nameLength) {
+		std::copy_n(other.name, nameLength, name);
+		end(4000);
 		socket = other.socket;
 		other.socket = nullptr;
 	}
 
 	Client &operator=(Client &&other) {
-		name = std::move(other.name);
-		auto s = getSocket();
-		if (s) {
-			s->end(4000);
-		}
+		nameLength = other.nameLength;
+		std::copy_n(other.name, nameLength, name);
+		end(4000);
 		socket = other.socket;
 		other.socket = nullptr;
 		return *this;
 	}
 
 	~Client() {
-		auto s = getSocket();
-		if (s) {
-			s->end(4000);
-			socket = nullptr;
-		}
+		end(4000);
+		socket = nullptr;
 	}
 
 	bool ready() {
@@ -72,24 +128,23 @@ public:
 	}
 
 	void ready(bool value) {
-		socket = reinterpret_cast<WebSocket *>(reinterpret_cast<uintptr_t>(socket) | value);
+		socket = reinterpret_cast<Socket *>((reinterpret_cast<uintptr_t>(socket) & ~1) | value);
 	}
 
 	bool voted() {
-		return (reinterpret_cast<uintptr_t>(socket) & 1) == 1;
+		return (reinterpret_cast<uintptr_t>(socket) & 2) == 2;
 	}
 
 	void voted(bool value) {
-		socket = reinterpret_cast<WebSocket *>((reinterpret_cast<uintptr_t>(socket) & ~1) | value);
+		socket = reinterpret_cast<Socket *>((reinterpret_cast<uintptr_t>(socket) & ~2) | (value << 1));
 	}
 
 	bool connected() {
-		return getSocket() != nullptr;
+		return target() != 0;
 	}
 
 	void safeSend(std::string_view view) {
-		auto s = getSocket();
-		if (s) {
+		if (connected()) {
 			send(view);
 		}
 	}
@@ -100,45 +155,123 @@ public:
 	}
 
 	void send(std::string_view view) {
+		if (auto *bot = getBot()) {
+			return bot->receive(view);
+		}
+		auto &counters = metrics::local();
+		counters.messagesOut[metrics::outCode(static_cast<unsigned char>(view[0]))].inc();
+		auto *s = getSocket();
+		auto data = reinterpret_cast<UserData<Socket> *>(s->getUserData());
+		if (corked) {
+			hold(data->queue, view);
+			data->corked++;
+			return;
+		}
+		if (drain(s, *data) && write(s, *data, view)) {
+			trace::record(trace::SEND, static_cast<unsigned char>(view[0]), data->playerId);
+			return;
+		}
+		hold(data->queue, view);
+		counters.queuedMessages.inc();
+	}
+
+	/** While set, frames for sockets wait in their queues until uncork(); see Manager::handleMessage
+	 *
+	 * One per thread, as each event loop runs one transition at a time.
+	 */
+	static inline thread_local bool corked = false;
+
+	/** Writes the frames held since corked was set, under one uWS cork so that they leave in a single write */
+	void uncork() {
+		if (isBot() || !connected()) {
+			return;
+		}
 		auto *s = getSocket();
-		auto data = reinterpret_cast<UserData *>(s->getUserData());
-		auto &q = data->queue;
+		auto data = reinterpret_cast<UserData<Socket> *>(s->getUserData());
+		if (data->corked) {
+			s->cork([&] {
+				drain(s, *data);
+			});
+		}
+	}
+
+private:
+	static void hold(MessageQueue &q, std::string_view view) {
+		q.emplace_back();
+		auto &x = q.back();
+		x.length = view.copy(x.data, 256);
+		x.traceId = trace::current();
+	}
+
+	static bool write(Socket *s, UserData<Socket> &data, std::string_view message) {
+		if (data.version == protocolV2::VERSION) {
+			protocolV2::Frame frame;
+			protocolV2::append(frame, message);
+			return s->send(frame.view(), uWS::OpCode::BINARY, compressionPolicy.shouldCompress(frame.view()));
+		}
+		return s->send(message, uWS::OpCode::BINARY, compressionPolicy.shouldCompress(message));
+	}
+
+	/** Sends from the front of the queue until the socket refuses a frame, and returns whether it emptied
+	 *
+	 * Version 2 sockets are sent as many messages per frame as fit, so what one transition held goes out whole.
+	 */
+	static bool drain(Socket *s, UserData<Socket> &data) {
+		auto &q = data.queue;
+		auto &counters = metrics::local();
 		while (!q.empty()) {
-			if (s->send(std::string_view(q.front().data, q.front().length))) {
-				q.pop_front();
-			} else {
-				break;
+			size_t count = 1;
+			std::string_view frame(q.front().data, q.front().length);
+			protocolV2::Frame events;
+			if (data.version == protocolV2::VERSION) {
+				count = 0;
+				q.forEach([&](Message &m) {
+					bool fits = protocolV2::append(events, std::string_view(m.data, m.length));
+					count += fits;
+					return fits;
+				});
+				frame = events.view();
 			}
-		}
-		if (q.empty()) {
-			if (s->send(view, uWS::OpCode::BINARY, true)) {
-			} else {
-				q.emplace_back();
-				auto &x = q.back();
-				x.length = view.copy(x.data, 256);
+			if (count && !s->send(frame, uWS::OpCode::BINARY, compressionPolicy.shouldCompress(frame))) {
+				// what the cork held now waits on backpressure like the rest
+				counters.queuedMessages.add(data.corked);
+				data.corked = 0;
+				return false;
+			}
+			// a message that can't be put in a frame of its own is dropped rather than blocking the queue
+			for (size_t i = 0; i < std::max<size_t>(count, 1); i++) {
+				bool held = q.size() <= data.corked;
+				trace::record(q.front().traceId, held ? trace::SEND : trace::SEND_DRAINED,
+						static_cast<unsigned char>(q.front().data[0]), data.playerId);
+				q.pop_front();
+				if (held) {
+					data.corked--;
+				} else {
+					counters.queuedMessages.dec();
+				}
 			}
-		} else {
-			q.emplace_back();
-			auto &x = q.back();
-			x.length = view.copy(x.data, 256);
 		}
+		return true;
 	}
 
+public:
 	void send(char *buf, int i) {
-		std::string_view view(buf, i);
-		socket->send(view, uWS::OpCode::BINARY, true);
+		send(std::string_view(buf, i));
 	}
 
 	void setName(const std::string_view newName) {
-		name = newName;
+		nameLength = newName.copy(name, MAX_NAME_SIZE);
 	}
 
 	void setId(int id) {
-		static_cast<UserData *>(getSocket()->getUserData())->playerId = id;
+		if (auto *bot = getBot()) {
+			return bot->setId(id);
+		}
+		static_cast<UserData<Socket> *>(getSocket()->getUserData())->playerId = id;
 	}
 
-	const auto &getName() const {
-		return name;
+	std::string_view getName() const {
+		return std::string_view(name, nameLength);
 	}
 
 	void onDisconnect() {
@@ -146,58 +279,212 @@ public:
 	}
 
 	void safeUncleanEnd() {
-		auto s = getSocket();
-		if (s) {
-			s->end(4001);
-			socket = nullptr;
-		}
+		end(4001);
+		socket = nullptr;
+	}
+
+	// closes the connection from our side, so its close handler leaves the seat to the manager
+	void refuse(int code) {
+		end(code);
+		socket = nullptr;
 	}
 };
 
-class Manager {
+template <typename Socket>
+class Manager : public Protocol {
+public:
+	/** Gives the game's slot back once it is over; a plain function, so setting one never allocates */
+	using Deleter = void (*)(void *context, uint32_t gameId);
+
 private:
 	using Game = GenericGame<Manager>;
 
 	Game game;
-	std::array<Client, 10> clients;
-	std::function<void()> deleter;
+	std::array<Client<Socket>, MAX_PLAYERS> clients;
+	Deleter deleter = nullptr;
+	void *deleterContext = nullptr;
 	int clientCount = 0;
-	char sendBuffer[256];
-
-	static constexpr int MAX_NAME_SIZE = sizeof(sendBuffer) - 1;
+	// bots count towards clientCount, but can't keep a game alive on their own
+	int botCount = 0;
+	uint32_t gameId = 0;
+	int spectatorCount = 0;
+	// owned by the delayed stream, which keeps draining it after the game is destroyed
+	EventRing *delayed = nullptr;
+	// where this game is in the lobby index, or -1 if it isn't listed
+	int lobbyPosition = -1;
+	// a seat that sent a name too long to store, closed once its message has been handled
+	int refusedName = -1;
+	std::chrono::steady_clock::time_point startTime;
+	gameLog::Tally tally;
+	// large enough for a roster of every other player
+	char sendBuffer[1 + MAX_PLAYERS * (2 + Client<Socket>::MAX_NAME_SIZE)];
+
+	static constexpr int MAX_NAME_SIZE = Client<Socket>::MAX_NAME_SIZE;
 
 public:
+	/** Sends a public message to everyone spectating a game */
+	using Publisher = void (*)(void *context, uint32_t gameId, std::string_view message);
+	static inline Publisher publisher = nullptr;
+	static inline void *publisherContext = nullptr;
+
+	static inline LobbyIndex *lobbies = nullptr;
+
 	Manager() : game(*this) {
 	}
 
-	void setDeleter(std::function<void()> f) {
+	void setDeleter(Deleter f, void *context) {
 		deleter = f;
+		deleterContext = context;
+	}
+
+	void setGameId(uint32_t id) {
+		gameId = id;
 	}
 
-	int addClient(WebSocket *ws) {
-		if (clientCount >= 10) {
+	/** Seats a new client and sends it a single roster frame
+	 *
+	 * The frame starts with the new client's id, followed by a record for each connected player:
+	 * (id << 4) | NAME, then the length of the name, then the name itself.
+	 */
+	int addClient(Socket *ws) {
+		// the players were dealt in when the game started, so a later seat would be outside it
+		if (clientCount >= MAX_PLAYERS || game.getState() != Game::NOT_STARTED) {
+			return -1;
+		}
+		int i;
+		for (i = 0; i < MAX_PLAYERS && clients[i].connected(); i++) {}
+		sendRoster(ws, i);
+		clientCount++;
+		clients[i] = Client<Socket>(ws);
+		updateLobby();
+		return i;
+	}
+
+	/** Seats the socket that asked to play, or closes it with 4500 if every seat is taken
+	 *
+	 * Returns false if the socket was closed, in which case its UserData is left unbound, so that nothing
+	 * it sends before the close completes reaches the game.
+	 */
+	bool join(Socket *ws) {
+		int id = addClient(ws);
+		if (id < 0) {
+			ws->end(4500);
+			return false;
+		}
+		auto *data = static_cast<UserData<Socket> *>(ws->getUserData());
+		data->playerId = id;
+		data->manager = this;
+		return true;
+	}
+
+	/** Seats a bot, which is sent the roster like any other client */
+	int addBot(BotSeat *bot) {
+		if (clientCount >= MAX_PLAYERS) {
 			return -1;
 		}
-		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
 		int i;
-		for (i = 0; i < 10 && clients[i].connected(); i++) {}
-		ptr[0] = i;
-		ws->send(std::string_view(sendBuffer, 1));
-		for (int j = 0; j < 10; j++) {
+		for (i = 0; i < MAX_PLAYERS && clients[i].connected(); i++) {}
+		bot->receive(rosterMessage(i));
+		clientCount++;
+		botCount++;
+		clients[i] = Client<Socket>(bot);
+		updateLobby();
+		return i;
+	}
+
+	/** Sends a spectator the roster, with an id of SPECTATOR, and counts it towards publishing */
+	void addSpectator(Socket *ws) {
+		sendRoster(ws, SPECTATOR);
+		spectatorCount++;
+	}
+
+	void removeSpectator() {
+		spectatorCount--;
+	}
+
+	/** Starts recording into `ring` for the delayed stream, beginning with the teams if they are already known */
+	void addDelayedSpectator(Socket *ws, EventRing *ring) {
+		sendRoster(ws, SPECTATOR);
+		if (delayed) {
+			return;
+		}
+		delayed = ring;
+		if (game.getState() != Game::NOT_STARTED) {
+			recordDelayed(teamsMessage());
+		}
+	}
+
+	static constexpr int SPECTATOR = 255;
+	// a WebSocket close code, after HTTP's 413 Content Too Large
+	static constexpr int NAME_TOO_LONG = 4413;
+
+private:
+	void sendRoster(Socket *ws, int id) {
+		auto roster = rosterMessage(id);
+		protocolV2::Frame events;
+		if (static_cast<UserData<Socket> *>(ws->getUserData())->version == protocolV2::VERSION) {
+			protocolV2::append(events, roster, true);
+			roster = events.view();
+		}
+		ws->send(roster, uWS::OpCode::BINARY, compressionPolicy.shouldCompress(roster));
+	}
+
+	std::string_view rosterMessage(int id) {
+		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
+		ptr[0] = id;
+		int length = 1;
+		for (int j = 0; j < MAX_PLAYERS; j++) {
 			auto &c = clients[j];
 			if (c.connected()) {
-				ptr[0] = (j << 4) | NAME;
-				c.getName().copy(sendBuffer + 1, sizeof(sendBuffer) - 1);
-				ws->send(std::string_view(sendBuffer, c.getName().length() + 1));
+				auto name = c.getName();
+				ptr[length] = (j << 4) | NAME;
+				ptr[length + 1] = name.size();
+				name.copy(sendBuffer + length + 2, MAX_NAME_SIZE);
+				length += 2 + name.size();
 			}
 		}
-		clientCount++;
-		clients[i] = Client(ws);
-		return i;
+		return std::string_view(sendBuffer, length);
 	}
 
+public:
 	void onDisconnect(int id, int code) {
 		if (code >= 4000) return;
+		leave(id);
+	}
+
+	void announceDisconnect(int id) {
+		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
+		ptr[0] = DISCONNECT | (id << 4);
+		safeBroadcast(std::string_view(sendBuffer, 1));
+	}
+
+	void destroyGame() {
+		for (auto &c : clients) {
+			c.safeUncleanEnd();
+		}
+		leaveLobby();
+		deleter(deleterContext, gameId);
+	}
+
+	void destroyGameClean() {
+		leaveLobby();
+		deleter(deleterContext, gameId);
+	}
+
+	/** Ends a game that hasn't started, closing every seat with `code`; a started game carries on */
+	void closeLobby(int code) {
+		if (game.getState() != Game::NOT_STARTED) {
+			return;
+		}
+		for (auto &c : clients) {
+			c.refuse(code);
+		}
+		destroyGameClean();
+	}
+
+private:
+	// what a seat's disconnecting does to the game, whoever closed it
+	void leave(int id) {
 		clients[id].onDisconnect();
 		switch(game.getState()) {
 			case Game::NOT_STARTED:
@@ -213,26 +500,46 @@ public:
 				return destroyGame();
 		}
 		clientCount--;
-		if (clientCount == 0) {
+		if (clientCount == botCount) {
 			return destroyGameClean();
 		}
+		updateLobby();
 	}
 
-	void announceDisconnect(int id) {
-		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
-		ptr[0] = DISCONNECT | (id << 4);
-		safeBroadcast(std::string_view(sendBuffer, 1));
+	void updateLobby() {
+		if (!lobbies) {
+			return;
+		}
+		if (game.getState() != Game::NOT_STARTED) {
+			return leaveLobby();
+		}
+		uint16_t ready = 0;
+		for (int i = 0; i < MAX_PLAYERS; i++) {
+			ready |= (clients[i].connected() && clients[i].ready()) << i;
+		}
+		lobbies->upsert(&lobbyPosition, gameId, clientCount, ready);
 	}
 
-	void destroyGame() {
-		for (auto &c : clients) {
-			c.safeUncleanEnd();
+	void leaveLobby() {
+		if (lobbies) {
+			lobbies->remove(&lobbyPosition);
 		}
-		deleter();
 	}
 
-	void destroyGameClean() {
-		deleter();
+public:
+	/** Starts the game for a matchmade lobby, whose players never sent ready */
+	void startMatchedGame(unsigned long long seed = Game::timeSeed()) {
+		for (auto &client : clients) {
+			client.ready(true);
+		}
+		auto before = game.getState();
+		startGame(seed);
+		recordTransition(before, game.getState());
+	}
+
+	// for tests and tools that check the rules from outside
+	Game &getGame() {
+		return game;
 	}
 
 private:
@@ -245,34 +552,44 @@ private:
 				return;
 			}
 		}
-		startGame();
+		startGame(Game::timeSeed());
 	}
 
-	void startGame() {
+	void startGame(unsigned long long seed) {
 		removeNulls();
 		for (auto &c : clients) {
 			c.voted(false);
 		}
-		game.init();
+		startTime = std::chrono::steady_clock::now();
+		tally = {};
+		game.init(seed);
+		leaveLobby();
 		sendTeams();
 		game.start();
 	}
 
-	void sendTeams() {
-		std::string_view libMessage(sendBuffer, 1);
-		std::string_view fascMessage(sendBuffer + 1, 2);
+	// the message fascists get, which reveals every team and Hitler, written to sendBuffer + 1
+	std::string_view teamsMessage() {
 		auto hitler = game.getHitler();
 		auto teams = game.getTeams();
 		auto teamFlags = teams.to_ulong();
 		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
+		teams.flip();
+		// which fascist is Hitler; wide masks leave room for a third bit
+		unsigned hitlerNumber = (teams.count() - (teams >> hitler).count()) & (WIDE_MASKS ? 7 : 3);
+		ptr[1] = TEAM | (hitlerNumber << 4);
+		return std::string_view(sendBuffer + 1, writeMask(ptr + 1, teamFlags));
+	}
+
+	void sendTeams() {
+		std::string_view libMessage(sendBuffer, 1);
+		std::string_view fascMessage = teamsMessage();
+		auto hitler = game.getHitler();
+		auto teams = game.getTeams().flip();
+		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
 		ptr[0] = TEAM;
 		int fasc = -1;
-
-		std::bitset<10> mask(0x3ff);
-		teams.flip();
-		unsigned hitlerNumber = (teams.count() - (teams >> hitler).count()) & 3;
-		ptr[1] = TEAM | (hitlerNumber << 4) | ((teamFlags & 3) << 6);
-		ptr[2] = (teamFlags >> 2) & 255;
+		recordDelayed(fascMessage);
 
 		for (auto i = 0; i < hitler; i++) {
 			if (teams[i]) {
@@ -296,10 +613,7 @@ private:
 				ptr[0] = TEAM | ((fasc + 1) << 4);
 				clients[hitler].send(std::string_view(sendBuffer, 1));
 				break;
-			case SEVEN:
-			case EIGHT:
-			case NINE:
-			case TEN:
+			default:
 				ptr[0] = TEAM | (15 << 4);
 				clients[hitler].send(std::string_view(sendBuffer, 1));
 				break;
@@ -336,10 +650,8 @@ private:
 	public:
 	void successfulElection() {
 		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
-		auto ballot = game.getBallot().to_ulong();
-		ptr[0] = BALLOT | 16 | ((ballot & 3) << 6);
-		ptr[1] = (ballot >> 2) & 255;
-		std::string_view message(sendBuffer, 2);
+		ptr[0] = BALLOT | 16;
+		std::string_view message(sendBuffer, writeMask(ptr, game.getBallot().to_ulong()));
 		broadcast(message);
 	}
 
@@ -352,11 +664,10 @@ private:
 
 	void failedElection() {
 		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
-		auto ballot = game.getBallot().to_ulong();
-		ptr[0] = BALLOT | ((ballot & 3) << 6);
-		ptr[1] = (ballot >> 2) & 255;
-		std::string_view message(sendBuffer, 2);
+		ptr[0] = BALLOT;
+		std::string_view message(sendBuffer, writeMask(ptr, game.getBallot().to_ulong()));
 		broadcast(message);
+		gameLog::Tally::increment(tally.failedElections);
 	}
 
 	private:
@@ -364,20 +675,22 @@ private:
 		auto &c = clients[id];
 		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
 		ptr[0] = (id << 4) | NAME;
-		c.getName().copy(sendBuffer + 1, sizeof(sendBuffer) - 1);
+		c.getName().copy(sendBuffer + 1, MAX_NAME_SIZE);
 		std::string_view message(sendBuffer, c.getName().size() + 1);
 		for (auto i = 0; i < id; i++) {
 			auto &k = clients[i];
 			k.safeSend(message);
 		}
-		for (auto i = id + 1; i < 10; i++) {
+		for (auto i = id + 1; i < MAX_PLAYERS; i++) {
 			auto &k = clients[i];
 			k.safeSend(message);
 		}
+		publish(message);
 	}
 
 	void setName(int id, std::string_view name) {
 		if (name.size() > MAX_NAME_SIZE) {
+			refusedName = id;
 			return;
 		}
 		clients[id].setName(name);
@@ -392,6 +705,7 @@ private:
 		if (value) {
 			tryToStartGame();
 		}
+		updateLobby();
 	}
 
 	void announceReadyState(int id, bool value) {
@@ -399,10 +713,15 @@ private:
 		ptr[0] = value ? READY_TO_START : NOT_READY;
 		ptr[0] |= id << 4;
 		std::string_view message(sendBuffer, 1);
-		broadcast(message);
+		// the lobby can have gaps left by players who disconnected
+		safeBroadcast(message);
 	}
 
 	void eliminatePolicy(int id, int choice) {
+		// choices come from the top 5 bits of the message, but only the first three name a policy
+		if (choice > game.THIRD) {
+			return;
+		}
 		if (game.getState() == game.AWAITING_PRESIDENT_POLICY && id == game.getPresidentId()) {
 			game.removePresidentPolicy(static_cast<typename Game::PolicyChoice>(choice));
 		} else if (game.getState() == game.AWAITING_CHANCELLOR_POLICY && id == game.getChancellorId()) {
@@ -453,16 +772,19 @@ private:
 	}
 
 	void castVote(int id, Vote vote) {
-		if (clients[id].voted()) return;
+		if (game.getState() != game.VOTING || clients[id].voted()) return;
 		clients[id].voted(true);
 		announceVoteReceived(id);
 		game.addVote(id, vote);
 	}
 
 	void respondToVeto(int id, bool accept) {
-		if (id != game.getPresidentId()) {
+		if (game.getState() != game.AWAITING_VETO || id != game.getPresidentId()) {
 			return;
 		}
+		if (accept) {
+			gameLog::Tally::increment(tally.vetoesAccepted);
+		}
 		game.presidentVeto(accept);
 	}
 
@@ -470,12 +792,30 @@ private:
 		for (auto &c : clients) {
 			c.safeSend(msg);
 		}
+		publish(msg);
+		recordDelayed(msg);
 	}
 
 	void broadcast(std::string_view msg) {
 		for (auto i = 0; i < clientCount; i++) {
 			clients[i].send(msg);
 		}
+		publish(msg);
+		recordDelayed(msg);
+	}
+
+	// delayed spectators see private messages too, so the most revealing version of each is recorded
+	void recordDelayed(std::string_view msg) {
+		if (delayed) {
+			delayed->push(currentMillis(), msg);
+		}
+	}
+
+	// spectators share one topic per game, so the cost here doesn't grow with the number watching
+	void publish(std::string_view msg) {
+		if (spectatorCount) {
+			publisher(publisherContext, gameId, msg);
+		}
 	}
 
 	void announceVoteReceived(int id) {
@@ -497,42 +837,7 @@ public:
 		clients[id].send(message);
 	}
 
-	enum MessageCode {
-		ANNOUNCE_ELECTION = 0,
-		REQUEST_PRESIDENT_POLICY_CHOICE,
-		REQUEST_CHANCELLOR_POLICY_CHOICE,
-		REQUEST_INVESTIGATION,
-		REQUEST_KILL,
-		SEND_LOYALTY,
-		TOP_CARDS,
-		VOTE_RECEIVED,
-		BALLOT,
-		DISCONNECT,
-		READY_TO_START,
-		NOT_READY,
-		TEAM,
-		NAME,
-		DEATH,
-		EXTENDED
-	};
-
-	static_assert(EXTENDED < 16);
-
-	enum ExtendedMessageCodes {
-		REQUEST_PRESIDENT_VETO = 0 * 16 | EXTENDED,
-		LIBERAL_POLICY_WIN = 1 * 16 | EXTENDED,
-		LIBERAL_HITLER_WIN = 2 * 16 | EXTENDED,
-		FASCIST_POLICY_WIN = 3 * 16 | EXTENDED,
-		FASCIST_HITLER_WIN = 4 * 16 | EXTENDED,
-		REQUEST_SPECIAL_NOMINATION = 5 * 16 | EXTENDED,
-		REASSIGN = 6 * 16 | EXTENDED,
-		REGULAR_FASCIST_POLICY = 7 * 16 | EXTENDED,
-		CHAOTIC_FASCIST_POLICY = 8 * 16 | EXTENDED,
-		REGULAR_LIBERAL_POLICY = 9 * 16 | EXTENDED,
-		CHAOTIC_LIBERAL_POLICY = 10 * 16 | EXTENDED,
-		REQUEST_CHANCELLOR_NOMINATION = 11 * 16 | EXTENDED,
-		GAME_KEY = 12 * 16 | EXTENDED
-	};
+	static_assert(Game::FASCIST_HITLER_WIN + 1 == metrics::STATE_COUNT);
 
 	void announceElection() {
 		for (auto &c : clients) {
@@ -548,6 +853,7 @@ public:
 		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
 		ptr[0] = CHAOTIC_FASCIST_POLICY;
 		broadcast(std::string_view(sendBuffer, 1));
+		gameLog::Tally::increment(tally.trackerResets);
 	}
 
 	void regularFascistPolicy() {
@@ -560,6 +866,7 @@ public:
 		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
 		ptr[0] = CHAOTIC_LIBERAL_POLICY;
 		broadcast(std::string_view(sendBuffer, 1));
+		gameLog::Tally::increment(tally.trackerResets);
 	}
 
 	void regularLiberalPolicy() {
@@ -595,10 +902,8 @@ public:
 	void requestChancellorNomination() {
 		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
 		ptr[0] = REQUEST_CHANCELLOR_NOMINATION;
-		auto v = game.getEligibleChancellors().to_ulong();
-		ptr[1] = game.getPresidentId() | ((v & 3) << 6);
-		ptr[2] = (v >> 2) & 255;
-		broadcast(std::string_view(sendBuffer, 3));
+		ptr[1] = game.getPresidentId();
+		broadcast(std::string_view(sendBuffer, 1 + writeMask(ptr + 1, game.getEligibleChancellors().to_ulong())));
 	}
 
 	void sendPresidentPolicyChoice() {
@@ -611,8 +916,10 @@ public:
 		for (int i = game.getPresidentId() + 1; i < clientCount; i++) {
 			clients[i].send(message);
 		}
+		publish(message);
 		ptr[0] |= (game.getFirstPolicy() << 5) | (game.getSecondPolicy() << 6) | (game.getThirdPolicy() << 7);
 		clients[game.getPresidentId()].send(message);
+		recordDelayed(message);
 	}
 
 	void sendChancellorPolicyChoice() {
@@ -625,9 +932,11 @@ public:
 		for (int i = game.getChancellorId() + 1; i < clientCount; i++) {
 			clients[i].send(message);
 		}
+		publish(message);
 		bool canVeto = game.getState() == game.AWAITING_CHANCELLOR_POLICY && game.getFascistPolicies() == 5;
 		ptr[0] |= (game.getFirstPolicy() << 5) | (game.getSecondPolicy() << 6) | (canVeto << 7);
 		clients[game.getChancellorId()].send(message);
+		recordDelayed(message);
 	}
 
 	void sendPresidentVetoOption() {
@@ -635,44 +944,48 @@ public:
 		ptr[0] = REQUEST_PRESIDENT_VETO;
 		std::string_view message(sendBuffer, 1);
 		broadcast(message);
+		gameLog::Tally::increment(tally.vetoesProposed);
 	}
 
 	void requestInvestigation() {
 		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
-		auto eligible = game.eligibleForInvestigation().to_ulong();
-		ptr[0] = REQUEST_INVESTIGATION | ((eligible & 3) << 6);
-		ptr[1] = (eligible >> 2) & 255;
-		std::string_view message(sendBuffer, 2);
+		ptr[0] = REQUEST_INVESTIGATION;
+		std::string_view message(sendBuffer, writeMask(ptr, game.eligibleForInvestigation().to_ulong()));
 		broadcast(message);
 	}
 
-	void sendLoyalty(int id, Team team) {
+	// `president` is who investigated, since the presidency has moved on
+	void sendLoyalty(int president, int id, Team team) {
 		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
 		ptr[0] = SEND_LOYALTY | (id << 4);
 		std::string_view message(sendBuffer, 1);
-		for (int i = 0; i < game.getPresidentId(); i++) {
+		for (int i = 0; i < president; i++) {
 			clients[i].send(message);
 		}
-		for (int i = game.getPresidentId() + 1; i < clientCount; i++) {
+		for (int i = president + 1; i < clientCount; i++) {
 			clients[i].send(message);
 		}
+		publish(message);
 		ptr[1] = team;
-		clients[game.getPresidentId()].send(std::string_view(sendBuffer, 2));
+		clients[president].send(std::string_view(sendBuffer, 2));
+		recordDelayed(std::string_view(sendBuffer, 2));
 	}
 
-	void sendTopCards() {
+	void sendTopCards(int president) {
 		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
 		ptr[0] = TOP_CARDS;
 		std::string_view message(sendBuffer, 1);
-		for (int i = 0; i < game.getPresidentId(); i++) {
+		for (int i = 0; i < president; i++) {
 			clients[i].send(message);
 		}
-		for (int i = game.getPresidentId() + 1; i < clientCount; i++) {
+		for (int i = president + 1; i < clientCount; i++) {
 			clients[i].send(message);
 		}
+		publish(message);
 		auto [a, b, c] = game.peekTopCards();
 		ptr[0] |= 16 | (a << 5) | (b << 6) | (c << 7);
-		clients[game.getPresidentId()].send(message);
+		clients[president].send(message);
+		recordDelayed(message);
 	}
 
 	void requestSpecialPresidentNomination() {
@@ -684,18 +997,26 @@ public:
 
 	void requestKill() {
 		auto *ptr = reinterpret_cast<unsigned char *>(sendBuffer);
-		auto alive = game.alive().to_ulong();
-		ptr[0] = REQUEST_KILL | ((alive & 3) << 6);
-		ptr[1] = (alive >> 2) & 255;
-		std::string_view message(sendBuffer, 2);
+		ptr[0] = REQUEST_KILL;
+		std::string_view message(sendBuffer, writeMask(ptr, game.alive().to_ulong()));
 		broadcast(message);
 	}
 
-public:
-	void handleMessage(int id, std::string_view message) {
-		if (message.size() < 1) {
-			return;
+private:
+	void recordTransition(typename Game::State before, typename Game::State after) {
+		using namespace std::chrono;
+		auto &counters = metrics::local();
+		counters.gamesByState[before].dec();
+		counters.gamesByState[after].inc();
+		if (after >= Game::LIBERAL_POLICY_WIN && before < Game::LIBERAL_POLICY_WIN) {
+			auto elapsed = duration_cast<seconds>(steady_clock::now() - startTime).count();
+			metrics::observeGameDuration(elapsed);
+			gameLog::append(tally.finish(game.getPlayerCount(), after - Game::LIBERAL_POLICY_WIN, botCount > 0,
+					game.getLiberalPolicies(), game.getFascistPolicies(), elapsed));
 		}
+	}
+
+	void dispatch(int id, std::string_view message) {
 		unsigned firstByte = static_cast<unsigned char>(message.data()[0]);
 		switch(firstByte % 8) {
 			case 0:
@@ -745,9 +1066,49 @@ public:
 		}
 	}
 
+public:
+	/** Applies one message from a seat, writing what it causes to each socket at once
+	 *
+	 * A single vote can announce the vote, the ballot and the president's policies, three frames to each
+	 * player. They are held while the message is dispatched and then each socket is corked for its own
+	 * frames in turn, since uWS corks one socket at a time, so every socket gets one write per message.
+	 */
+	void handleMessage(int id, std::string_view message) {
+		if (message.size() < 1) {
+			return;
+		}
+		auto before = game.getState();
+		metrics::local().messagesIn[metrics::inCode(static_cast<unsigned char>(message[0]))].inc();
+		trace::record(trace::DISPATCH, static_cast<unsigned char>(message[0]), id);
+		bool outermost = !Client<Socket>::corked;
+		Client<Socket>::corked = true;
+		dispatch(id, message);
+		if (outermost) {
+			Client<Socket>::corked = false;
+			for (auto &c : clients) {
+				c.uncork();
+			}
+		}
+		auto after = game.getState();
+		if (before != after) {
+			trace::record(trace::TRANSITION, after, id);
+			recordTransition(before, after);
+		}
+		// last, since leaving can destroy the game
+		if (refusedName == id) {
+			refusedName = -1;
+			clients[id].refuse(NAME_TOO_LONG);
+			leave(id);
+		}
+	}
+
 	int getClientCount() const {
 		return clientCount;
 	}
+
+	typename Game::State getState() const {
+		return game.getState();
+	}
 };
 
 #endif //SERVER_COMMUNICATION_MANAGER_H
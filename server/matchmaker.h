@@ -0,0 +1,104 @@
+#ifndef SERVER_MATCHMAKER_H
+#define SERVER_MATCHMAKER_H
+#include <algorithm>
+#include <vector>
+#include "bot.h"
+#include "manager.h"
+#include "metrics.h"
+#include "rateLimit.h"
+#include "slotMap.h"
+
+/** Groups quickplay sockets into games
+ *
+ * Sockets wait in arrival order. Each tick takes full games of 10 off the front of the queue, then, if the
+ * oldest socket has waited at least `maxWaitMillis`, starts a smaller game with everyone left (at least 5).
+ * With bots, a queue still short of 5 once the oldest has waited `botFillMillis` is topped up with bots.
+ * Matched games skip the ready round trip.
+ *
+ * Games are admitted against the same ceilings as /create, and need a free key. While there is no room,
+ * everyone stays queued in order and is matched on a later tick.
+ */
+template <typename Socket>
+class Matchmaker {
+	struct Waiting {
+		Socket *ws;
+		uint32_t since;
+	};
+
+	std::vector<Waiting> queue;
+	uint32_t maxWaitMillis;
+	AdmissionLimits limits;
+	BotPool<Socket> *bots;
+	uint32_t botFillMillis;
+
+	// false, leaving everyone queued, if there is no room for another game
+	bool match(SlotMap<Socket> &managers, size_t count, uint32_t now, int botCount = 0) {
+		if (!limits.roomForGame(managers)) {
+			return false;
+		}
+		auto key = managers.getSlot();
+		if (!key) {
+			return false;
+		}
+		Manager<Socket> &m = managers[*key].value();
+		for (size_t i = 0; i < count; i++) {
+			auto *ws = queue[i].ws;
+			// a table is at most 10, so there is always a seat
+			m.join(ws);
+			m.sendGameKey(static_cast<UserData<Socket> *>(ws->getUserData())->playerId, key->gameId());
+			metrics::observeMatchWait(now - queue[i].since);
+		}
+		queue.erase(queue.begin(), queue.begin() + count);
+		if (botCount) {
+			bots->fill(m, botCount);
+		}
+		m.startMatchedGame();
+		return true;
+	}
+
+public:
+	explicit Matchmaker(uint32_t maxWaitMillis, AdmissionLimits limits = {}, BotPool<Socket> *bots = nullptr,
+			uint32_t botFillMillis = 0)
+			: maxWaitMillis(maxWaitMillis), limits(limits), bots(bots), botFillMillis(botFillMillis) {
+	}
+
+	void enqueue(Socket *ws, uint32_t now) {
+		queue.push_back({ ws, now });
+	}
+
+	void remove(Socket *ws) {
+		queue.erase(std::remove_if(queue.begin(), queue.end(), [ws](auto &w) { return w.ws == ws; }), queue.end());
+	}
+
+	size_t waiting() const {
+		return queue.size();
+	}
+
+	// ends every waiting socket with `code`, for when this process stops making games
+	void closeAll(int code) {
+		auto closing = std::move(queue);
+		queue.clear();
+		for (auto &w : closing) {
+			w.ws->end(code);
+		}
+	}
+
+	void tick(SlotMap<Socket> &managers, uint32_t now) {
+		while (queue.size() >= 10) {
+			if (!match(managers, 10, now)) {
+				return;
+			}
+		}
+		if (queue.empty()) {
+			return;
+		}
+		auto waited = now - queue.front().since;
+		if (queue.size() >= 5 && waited >= maxWaitMillis) {
+			match(managers, queue.size(), now);
+		} else if (bots && queue.size() < 5 && waited >= botFillMillis) {
+			match(managers, queue.size(), now, 5 - queue.size());
+		}
+	}
+};
+
+#endif //SERVER_MATCHMAKER_H
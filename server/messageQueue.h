@@ -0,0 +1,88 @@
+#ifndef SERVER_MESSAGE_QUEUE_H
+#define SERVER_MESSAGE_QUEUE_H
+#include <cinttypes>
+#include "slab.h"
+
+struct Message {
+	int length;
+	uint32_t traceId;
+	char data[256];
+	Message() = default;
+};
+
+/** The messages a socket couldn't take yet, oldest first
+ *
+ * Nodes come from the thread's slab arena, so queuing a message never touches the general heap, and the
+ * memory a burst of backpressure took goes back once it drains.
+ */
+class MessageQueue {
+	struct Node {
+		Message message;
+		Node *next;
+	};
+
+	static_assert(slab::CLASS_SIZES[slab::classFor(sizeof(Node))] == sizeof(Node), "Node has a size class of its own");
+
+	Node *head = nullptr;
+	Node *tail = nullptr;
+	size_t count = 0;
+
+public:
+	MessageQueue() = default;
+	MessageQueue(const MessageQueue &) = delete;
+	MessageQueue &operator=(const MessageQueue &) = delete;
+
+	~MessageQueue() {
+		while (!empty()) {
+			pop_front();
+		}
+	}
+
+	bool empty() const {
+		return head == nullptr;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	Message &front() {
+		return head->message;
+	}
+
+	Message &back() {
+		return tail->message;
+	}
+
+	// the new message is left uninitialized, for the caller to fill in
+	Message &emplace_back() {
+		auto *node = slab::make<Node>();
+		node->next = nullptr;
+		if (tail) {
+			tail->next = node;
+		} else {
+			head = node;
+		}
+		tail = node;
+		count++;
+		return node->message;
+	}
+
+	// calls f on each message from the front, until it returns false
+	template <typename F>
+	void forEach(F &&f) {
+		for (auto *node = head; node && f(node->message); node = node->next) {}
+	}
+
+	void pop_front() {
+		auto *node = head;
+		head = node->next;
+		if (!head) {
+			tail = nullptr;
+		}
+		count--;
+		slab::destroy(node);
+	}
+};
+
+#endif //SERVER_MESSAGE_QUEUE_H
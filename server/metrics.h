@@ -0,0 +1,275 @@
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fmt/format.h>
+
+/** Process-wide counters, exported in the Prometheus text format
+ *
+ * Every thread that records a metric gets its own cache-line aligned block of counters.
+ * Only the owning thread writes to a block, so recording is a relaxed load and store with no
+ * locked instructions and no sharing of cache lines. A scrape sums the blocks of every thread.
+ * Gauges are kept as signed sums, so an increment and decrement on different threads still net out.
+ */
+namespace metrics {
+	// GenericGame::State has this many values
+	constexpr int STATE_COUNT = 14;
+
+	// primary client codes (0-4), one slot for invalid codes, then the extended codes
+	constexpr int IN_CODE_COUNT = 14;
+	// Manager::MessageCode, then Manager::ExtendedMessageCodes
+	constexpr int OUT_CODE_COUNT = 32;
+
+	// upper bounds of the game duration buckets, in seconds
+	constexpr std::array<int, 8> durationBuckets = { 300, 600, 900, 1200, 1800, 2700, 3600, 5400 };
+
+	// upper bounds of the quickplay time-to-game buckets, in milliseconds
+	constexpr std::array<int, 8> matchWaitBuckets = { 100, 250, 500, 1000, 2500, 5000, 10000, 30000 };
+
+	class Counter {
+		std::atomic<int64_t> value{0};
+
+	public:
+		void add(int64_t n) {
+			value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		void inc() {
+			add(1);
+		}
+
+		void dec() {
+			add(-1);
+		}
+
+		int64_t get() const {
+			return value.load(std::memory_order_relaxed);
+		}
+	};
+
+	struct alignas(64) Counters {
+		std::array<Counter, STATE_COUNT> gamesByState;
+		Counter gamesCreated;
+		Counter gamesDestroyed;
+		Counter connectedClients;
+		Counter queuedMessages;
+		Counter refusedUpgrades;
+		Counter droppedMessages;
+		Counter draining;
+		Counter redirects;
+		std::array<Counter, IN_CODE_COUNT> messagesIn;
+		std::array<Counter, OUT_CODE_COUNT> messagesOut;
+		std::array<Counter, durationBuckets.size() + 1> gameDuration;
+		Counter gameDurationSum;
+		std::array<Counter, matchWaitBuckets.size() + 1> matchWait;
+		Counter matchWaitSum;
+	};
+
+	namespace detail {
+		inline std::mutex registryMutex;
+		inline std::vector<Counters *> registry;
+
+		inline Counters *registerThread() {
+			// never freed: a scrape may still read the block after its thread exits
+			auto *counters = new Counters;
+			std::lock_guard lock(registryMutex);
+			registry.push_back(counters);
+			return counters;
+		}
+	}
+
+	inline Counters &local() {
+		thread_local Counters *counters = detail::registerThread();
+		return *counters;
+	}
+
+	inline int inCode(unsigned firstByte) {
+		if (firstByte % 8 < 5) {
+			return firstByte % 8;
+		}
+		if (firstByte % 8 != 7) {
+			return 5;
+		}
+		return firstByte / 8 < 7 ? 6 + firstByte / 8 : 5;
+	}
+
+	inline int outCode(unsigned firstByte) {
+		if ((firstByte & 15) != 15) {
+			return firstByte & 15;
+		}
+		return 16 + (firstByte >> 4);
+	}
+
+	inline void observeGameDuration(int64_t seconds) {
+		auto &c = local();
+		unsigned i = 0;
+		while (i < durationBuckets.size() && seconds > durationBuckets[i]) {
+			i++;
+		}
+		c.gameDuration[i].inc();
+		c.gameDurationSum.add(seconds);
+	}
+
+	inline void observeMatchWait(int64_t millis) {
+		auto &c = local();
+		unsigned i = 0;
+		while (i < matchWaitBuckets.size() && millis > matchWaitBuckets[i]) {
+			i++;
+		}
+		c.matchWait[i].inc();
+		c.matchWaitSum.add(millis);
+	}
+
+	constexpr std::array<const char *, STATE_COUNT> stateNames = {
+		"NOT_STARTED",
+		"VOTING",
+		"AWAITING_CHANCELLOR_NOMINATION",
+		"AWAITING_PRESIDENT_POLICY",
+		"AWAITING_CHANCELLOR_POLICY",
+		"AWAITING_CHANCELLOR_POLICY_NO_VETO",
+		"AWAITING_ALLEGIENCE_PEEK_CHOICE",
+		"AWAITING_SPECIAL_PRESIDENT_CHOICE",
+		"AWAITING_KILL_CHOICE",
+		"AWAITING_VETO",
+		"LIBERAL_POLICY_WIN",
+		"LIBERAL_HITLER_WIN",
+		"FASCIST_POLICY_WIN",
+		"FASCIST_HITLER_WIN",
+	};
+
+	constexpr std::array<const char *, IN_CODE_COUNT> inCodeNames = {
+		"NOMINATE_CHANCELLOR",
+		"ELIMINATE_POLICY",
+		"REVEAL",
+		"KILL",
+		"SPECIAL_NOMINATION",
+		"INVALID",
+		"JA_VOTE",
+		"NEIN_VOTE",
+		"ACCEPT_VETO",
+		"REJECT_VETO",
+		"SET_NAME",
+		"READY_UP",
+		"HOLD_ON",
+		"UNUSED",
+	};
+
+	constexpr std::array<const char *, OUT_CODE_COUNT> outCodeNames = {
+		"ANNOUNCE_ELECTION",
+		"REQUEST_PRESIDENT_POLICY_CHOICE",
+		"REQUEST_CHANCELLOR_POLICY_CHOICE",
+		"REQUEST_INVESTIGATION",
+		"REQUEST_KILL",
+		"SEND_LOYALTY",
+		"TOP_CARDS",
+		"VOTE_RECEIVED",
+		"BALLOT",
+		"DISCONNECT",
+		"READY_TO_START",
+		"NOT_READY",
+		"TEAM",
+		"NAME",
+		"DEATH",
+		"EXTENDED",
+		"REQUEST_PRESIDENT_VETO",
+		"LIBERAL_POLICY_WIN",
+		"LIBERAL_HITLER_WIN",
+		"FASCIST_POLICY_WIN",
+		"FASCIST_HITLER_WIN",
+		"REQUEST_SPECIAL_NOMINATION",
+		"REASSIGN",
+		"REGULAR_FASCIST_POLICY",
+		"CHAOTIC_FASCIST_POLICY",
+		"REGULAR_LIBERAL_POLICY",
+		"CHAOTIC_LIBERAL_POLICY",
+		"REQUEST_CHANCELLOR_NOMINATION",
+		"GAME_KEY",
+		"EXTENDED_13",
+		"EXTENDED_14",
+		"EXTENDED_15",
+	};
+
+	namespace detail {
+		template <typename F>
+		int64_t sum(F field) {
+			int64_t total = 0;
+			for (auto *c : registry) {
+				total += field(*c).get();
+			}
+			return total;
+		}
+	}
+
+	inline std::string render() {
+		using detail::sum;
+		std::lock_guard lock(detail::registryMutex);
+		std::string out;
+		auto it = std::back_inserter(out);
+
+		fmt::format_to(it, "# TYPE sh_games gauge\n");
+		for (int i = 0; i < STATE_COUNT; i++) {
+			fmt::format_to(it, "sh_games{{state=\"{}\"}} {}\n", stateNames[i],
+					sum([i](Counters &c) -> Counter & { return c.gamesByState[i]; }));
+		}
+		fmt::format_to(it, "# TYPE sh_games_created_total counter\nsh_games_created_total {}\n",
+				sum([](Counters &c) -> Counter & { return c.gamesCreated; }));
+		fmt::format_to(it, "# TYPE sh_games_destroyed_total counter\nsh_games_destroyed_total {}\n",
+				sum([](Counters &c) -> Counter & { return c.gamesDestroyed; }));
+		fmt::format_to(it, "# TYPE sh_connected_clients gauge\nsh_connected_clients {}\n",
+				sum([](Counters &c) -> Counter & { return c.connectedClients; }));
+		fmt::format_to(it, "# TYPE sh_queued_messages gauge\nsh_queued_messages {}\n",
+				sum([](Counters &c) -> Counter & { return c.queuedMessages; }));
+
+		fmt::format_to(it, "# TYPE sh_refused_upgrades_total counter\nsh_refused_upgrades_total {}\n",
+				sum([](Counters &c) -> Counter & { return c.refusedUpgrades; }));
+		fmt::format_to(it, "# TYPE sh_dropped_messages_total counter\nsh_dropped_messages_total {}\n",
+				sum([](Counters &c) -> Counter & { return c.droppedMessages; }));
+		fmt::format_to(it, "# TYPE sh_redirects_total counter\nsh_redirects_total {}\n",
+				sum([](Counters &c) -> Counter & { return c.redirects; }));
+		fmt::format_to(it, "# TYPE sh_draining gauge\nsh_draining {}\n",
+				sum([](Counters &c) -> Counter & { return c.draining; }));
+
+		fmt::format_to(it, "# TYPE sh_messages_in_total counter\n");
+		for (int i = 0; i < IN_CODE_COUNT; i++) {
+			fmt::format_to(it, "sh_messages_in_total{{code=\"{}\"}} {}\n", inCodeNames[i],
+					sum([i](Counters &c) -> Counter & { return c.messagesIn[i]; }));
+		}
+		fmt::format_to(it, "# TYPE sh_messages_out_total counter\n");
+		for (int i = 0; i < OUT_CODE_COUNT; i++) {
+			fmt::format_to(it, "sh_messages_out_total{{code=\"{}\"}} {}\n", outCodeNames[i],
+					sum([i](Counters &c) -> Counter & { return c.messagesOut[i]; }));
+		}
+
+		fmt::format_to(it, "# TYPE sh_game_duration_seconds histogram\n");
+		int64_t cumulative = 0;
+		for (unsigned i = 0; i < durationBuckets.size(); i++) {
+			cumulative += sum([i](Counters &c) -> Counter & { return c.gameDuration[i]; });
+			fmt::format_to(it, "sh_game_duration_seconds_bucket{{le=\"{}\"}} {}\n", durationBuckets[i], cumulative);
+		}
+		cumulative += sum([](Counters &c) -> Counter & { return c.gameDuration[durationBuckets.size()]; });
+		fmt::format_to(it, "sh_game_duration_seconds_bucket{{le=\"+Inf\"}} {}\n", cumulative);
+		fmt::format_to(it, "sh_game_duration_seconds_sum {}\n",
+				sum([](Counters &c) -> Counter & { return c.gameDurationSum; }));
+		fmt::format_to(it, "sh_game_duration_seconds_count {}\n", cumulative);
+
+		fmt::format_to(it, "# TYPE sh_match_wait_milliseconds histogram\n");
+		cumulative = 0;
+		for (unsigned i = 0; i < matchWaitBuckets.size(); i++) {
+			cumulative += sum([i](Counters &c) -> Counter & { return c.matchWait[i]; });
+			fmt::format_to(it, "sh_match_wait_milliseconds_bucket{{le=\"{}\"}} {}\n", matchWaitBuckets[i], cumulative);
+		}
+		cumulative += sum([](Counters &c) -> Counter & { return c.matchWait[matchWaitBuckets.size()]; });
+		fmt::format_to(it, "sh_match_wait_milliseconds_bucket{{le=\"+Inf\"}} {}\n", cumulative);
+		fmt::format_to(it, "sh_match_wait_milliseconds_sum {}\n",
+				sum([](Counters &c) -> Counter & { return c.matchWaitSum; }));
+		fmt::format_to(it, "sh_match_wait_milliseconds_count {}\n", cumulative);
+		return out;
+	}
+}
+
+#endif //SERVER_METRICS_H
@@ -1,6 +1,7 @@
 #ifndef SERVER_PLAYER_H
 #define SERVER_PLAYER_H
 
+#include <cstdint>
 #include "common.h"
 
 class Player {
@@ -12,10 +13,10 @@ private:
 		INVESTIGATED = ALIVE << 1,
 		LAST_VOTE = INVESTIGATED << 1
 	};
-	unsigned flags = 0;
+	uint8_t flags = 0;
 
 public:
-	Team team() {
+	Team team() const {
 		return (TEAM & flags) == TEAM ? LIBERAL : FASCIST;
 	}
 
@@ -24,7 +25,7 @@ public:
 		flags |= team * TEAM;
 	}
 
-	bool alive() {
+	bool alive() const {
 		return (ALIVE & flags) == ALIVE;
 	}
 
@@ -33,7 +34,7 @@ public:
 		flags |= isAlive * ALIVE;
 	}
 
-	bool voted() {
+	bool voted() const {
 		return (VOTED & flags) == VOTED;
 	}
 
@@ -42,7 +43,7 @@ public:
 		flags |= v * VOTED;
 	}
 
-	Vote lastVote() {
+	Vote lastVote() const {
 		return static_cast<Vote>((flags / LAST_VOTE) & 1);
 	}
 
@@ -51,7 +52,7 @@ public:
 		flags |= lastVote * LAST_VOTE;
 	}
 
-	bool investigated() {
+	bool investigated() const {
 		return (INVESTIGATED & flags) == INVESTIGATED;
 	}
 
@@ -59,6 +60,11 @@ public:
 		flags &= ~INVESTIGATED;
 		flags |= voted * INVESTIGATED;
 	}
+
+	// the flags that matter to the rest of the game; votes are cleared before every election
+	unsigned position() const {
+		return flags & ~(VOTED | LAST_VOTE);
+	}
 };
 
 
@@ -0,0 +1,157 @@
+#ifndef SERVER_PROCESSES_H
+#define SERVER_PROCESSES_H
+#include <cerrno>
+#include <cinttypes>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/** Several server processes on one port, each with its own SlotMap
+ *
+ * With SH_PROCESSES=n, the process that starts forks n workers and only supervises them after that. Each
+ * worker listens on the shared port, which the kernel balances across them with SO_REUSEPORT, and on a
+ * port of its own, SH_WORKER_PORT + its index (SH_WORKER_PORT defaults to the shared port + 1). A worker
+ * hands out game keys whose major index (the key's top byte) is its index mod n, so any worker can tell
+ * which one holds a game. A /join, /spectate or /delayed for another worker's game is closed with
+ * REDIRECT and that worker's port as the reason, and the client connects again there.
+ *
+ * Own ports are bound without SO_REUSEPORT, so a redirect can only reach the worker that holds the game.
+ * A rolling deploy (drain.h) runs both generations side by side for a while, so it gives the new one
+ * another SH_WORKER_PORT; a worker whose port is still taken says so and drains straight away. A
+ * draining worker has closed its own port, and refuses rather than redirects.
+ *
+ * A worker that crashes is started again under the same index, and its games are lost but no one else's
+ * are. SIGTERM to the supervisor is passed on, so every worker drains, and the supervisor exits once they
+ * all have.
+ *
+ * In a cluster (cluster.h) the major index also names the node: every worker of every node is a shard,
+ * and keys carry the shard that made them mod the number of shards. Each of a shard's sets of 65536 games
+ * takes a major index of its own, so with s shards a worker holds at most 256 / s sets, and past that
+ * /create is refused. SH_MAX_GAMES above that is refused at startup.
+ */
+namespace processes {
+	constexpr int PORT = 4545;
+	// a WebSocket close code, after HTTP's 307 Temporary Redirect
+	constexpr int REDIRECT = 4307;
+	// the major index is a byte, and each worker needs at least one
+	constexpr unsigned MAX = 256;
+
+	struct Worker {
+		unsigned index;
+		unsigned count;
+		// this server's place in a cluster
+		unsigned node = 0;
+		unsigned nodes = 1;
+		// the shared port; SH_PORT moves it, so several nodes can run on one machine
+		int port = PORT;
+		// the own port of worker 0, which the others follow
+		int firstPort = PORT + 1;
+
+		// interleaved, so a shard mod the number of nodes is its node
+		unsigned shard() const {
+			return index * nodes + node;
+		}
+
+		unsigned shards() const {
+			return count * nodes;
+		}
+	};
+
+	// the shard that made a key, out of `count`
+	inline unsigned ownerOf(uint32_t gameId, unsigned count) {
+		return (gameId >> 24) % count;
+	}
+
+	inline unsigned nodeOf(uint32_t gameId, unsigned nodes) {
+		return ownerOf(gameId, nodes);
+	}
+
+	inline int portOf(unsigned index, int firstPort = PORT + 1) {
+		return firstPort + index;
+	}
+
+	namespace detail {
+		inline volatile std::sig_atomic_t terminated = 0;
+		inline volatile pid_t workers[MAX];
+		inline unsigned count = 0;
+
+		// kill() is async-signal-safe, so workers hear of a SIGTERM even while the supervisor is in wait()
+		inline void onSignal(int) {
+			terminated = 1;
+			for (unsigned i = 0; i < count; i++) {
+				if (workers[i] > 0) {
+					kill(workers[i], SIGTERM);
+				}
+			}
+		}
+
+		// true in the new worker
+		inline bool start(unsigned i) {
+			pid_t pid = fork();
+			if (pid == 0) {
+				signal(SIGTERM, SIG_DFL);
+				return true;
+			}
+			workers[i] = pid;
+			// a SIGTERM that came in while forking missed this one
+			if (terminated) {
+				kill(pid, SIGTERM);
+			}
+			return false;
+		}
+	}
+
+	/** Forks `count` workers and returns in each of them; the supervisor itself never returns
+	 *
+	 * Called before anything opens a socket or starts a thread. With a count of 1 there is no supervisor,
+	 * and the calling process is the only worker.
+	 */
+	inline Worker supervise(unsigned count) {
+		if (count <= 1) {
+			return { 0, 1 };
+		}
+		detail::count = count;
+		struct sigaction action = {};
+		action.sa_handler = detail::onSignal;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGTERM, &action, nullptr);
+
+		for (unsigned i = 0; i < count; i++) {
+			if (detail::start(i)) {
+				return { i, count };
+			}
+		}
+		size_t running = count;
+		while (running > 0) {
+			int status;
+			pid_t pid = wait(&status);
+			if (pid < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				break;
+			}
+			for (unsigned i = 0; i < count; i++) {
+				if (detail::workers[i] != pid) {
+					continue;
+				}
+				detail::workers[i] = 0;
+				bool drained = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+				if (drained || detail::terminated) {
+					running--;
+					break;
+				}
+				std::cout << "Worker " << i << " died, starting it again" << std::endl;
+				if (detail::start(i)) {
+					return { i, count };
+				}
+				break;
+			}
+		}
+		std::exit(0);
+	}
+}
+
+#endif //SERVER_PROCESSES_H
@@ -0,0 +1,69 @@
+#ifndef SERVER_PROTOCOL_H
+#define SERVER_PROTOCOL_H
+#include "common.h"
+
+/** Codes of the binary wire protocol
+ *
+ * The low nibble of the first byte of every server message is a MessageCode.
+ * EXTENDED messages use the high nibble as a sub-code, listed in ExtendedMessageCodes.
+ *
+ * Player masks have one bit per seat. Up to 10 players, the mask is packed after the first byte of the
+ * message: seats 0-1 in its top two bits, and seats 2-9 in the next byte. When the server is built for
+ * more players, the first byte is left alone and the mask follows as a big endian 16 bit number,
+ * so clients can tell the formats apart by the length of the message.
+ */
+struct Protocol {
+	enum MessageCode {
+		ANNOUNCE_ELECTION = 0,
+		REQUEST_PRESIDENT_POLICY_CHOICE,
+		REQUEST_CHANCELLOR_POLICY_CHOICE,
+		REQUEST_INVESTIGATION,
+		REQUEST_KILL,
+		SEND_LOYALTY,
+		TOP_CARDS,
+		VOTE_RECEIVED,
+		BALLOT,
+		DISCONNECT,
+		READY_TO_START,
+		NOT_READY,
+		TEAM,
+		NAME,
+		DEATH,
+		EXTENDED
+	};
+
+	static_assert(EXTENDED < 16);
+
+	enum ExtendedMessageCodes {
+		REQUEST_PRESIDENT_VETO = 0 * 16 | EXTENDED,
+		LIBERAL_POLICY_WIN = 1 * 16 | EXTENDED,
+		LIBERAL_HITLER_WIN = 2 * 16 | EXTENDED,
+		FASCIST_POLICY_WIN = 3 * 16 | EXTENDED,
+		FASCIST_HITLER_WIN = 4 * 16 | EXTENDED,
+		REQUEST_SPECIAL_NOMINATION = 5 * 16 | EXTENDED,
+		REASSIGN = 6 * 16 | EXTENDED,
+		REGULAR_FASCIST_POLICY = 7 * 16 | EXTENDED,
+		CHAOTIC_FASCIST_POLICY = 8 * 16 | EXTENDED,
+		REGULAR_LIBERAL_POLICY = 9 * 16 | EXTENDED,
+		CHAOTIC_LIBERAL_POLICY = 10 * 16 | EXTENDED,
+		REQUEST_CHANCELLOR_NOMINATION = 11 * 16 | EXTENDED,
+		GAME_KEY = 12 * 16 | EXTENDED
+	};
+
+	static constexpr bool WIDE_MASKS = MAX_PLAYERS > 10;
+
+	// writes a mask into a message whose first byte is ptr[0], and returns the length of the message
+	static int writeMask(unsigned char *ptr, unsigned long mask) {
+		if constexpr (WIDE_MASKS) {
+			ptr[1] = (mask >> 8) & 255;
+			ptr[2] = mask & 255;
+			return 3;
+		} else {
+			ptr[0] |= (mask & 3) << 6;
+			ptr[1] = (mask >> 2) & 255;
+			return 2;
+		}
+	}
+};
+
+#endif //SERVER_PROTOCOL_H
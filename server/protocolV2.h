@@ -0,0 +1,421 @@
+#ifndef SERVER_PROTOCOL_V2_H
+#define SERVER_PROTOCOL_V2_H
+#include <cinttypes>
+#include <cstring>
+#include <string_view>
+#include "protocol.h"
+
+/** Version 2 of what the server sends, for clients that ask for it with ?v=2 on their upgrade
+ *
+ * A frame is a sequence of events, and all that one message causes for a socket arrives as one frame. An
+ * event is a code byte and its payload. Below 128 the code fixes the payload's shape. From 128 up, the
+ * payload's length comes first as a varint, so that events added later in that range can be skipped by
+ * clients that don't know them. Varints are LEB128: 7 bits a byte, least significant first, with the top
+ * bit set on every byte but the last. Payloads, where [x] is a byte and {x} a varint:
+ *
+ * ROSTER [own id, or 255 for a spectator], followed in the same frame by a NAME for each player
+ * READY_TO_START, NOT_READY, DISCONNECT, VOTE_RECEIVED, DEATH [id]
+ * ANNOUNCE_ELECTION [chancellor]
+ * REASSIGN [old id][new id]
+ * GAME_KEY {key}
+ * BALLOT [passed]{ja votes}
+ * REQUEST_CHANCELLOR_NOMINATION [president]{eligible}
+ * REQUEST_INVESTIGATION, REQUEST_KILL {eligible}
+ * REQUEST_PRESIDENT_POLICY_CHOICE [cards], REQUEST_CHANCELLOR_POLICY_CHOICE [cards | can veto << 2], and
+ *   TOP_CARDS [cards | shown << 3]: a bit per card, set for liberal, and clear for everyone but the
+ *   player who is shown them
+ * SEND_LOYALTY [id][Team], with 255 for everyone but the president who investigated
+ * NAME {length}[id] then the name
+ * TEAM {length} then [LIBERAL_ROLE], [HITLER_ROLE], [HITLER_ROLE][the fascist] or
+ *   [FASCIST_ROLE][hitler]{liberals}, for the player's own role
+ * and the rest nothing.
+ *
+ * Messages from clients are the same in both versions, and spectators are always sent version 1, since every
+ * spectator of a game shares one published stream.
+ *
+ * The server builds every message in version 1 and rewrites it here on the way out to a socket that asked
+ * for version 2, so the two can't drift apart. That also means version 2 carries only what version 1 can:
+ * ids and masks are read from version 1's nibbles and masks, so tables are still capped at MAX_PLAYERS, at
+ * most 16, even though a varint mask could name more seats. What version 2 changes is framing. It sends
+ * fewer frames, but more bytes and more server time than version 1 (see bench/protocol.cpp), and no bundled
+ * client asks for it yet.
+ */
+namespace protocolV2 {
+	constexpr int VERSION = 2;
+	// closes an upgrade that asked for a version this server doesn't speak
+	constexpr int UNSUPPORTED = 4426;
+
+	enum Event : uint8_t {
+		ROSTER,
+		READY_TO_START,
+		NOT_READY,
+		DISCONNECT,
+		REASSIGN,
+		GAME_KEY,
+		ANNOUNCE_ELECTION,
+		VOTE_RECEIVED,
+		BALLOT,
+		REQUEST_CHANCELLOR_NOMINATION,
+		REQUEST_PRESIDENT_POLICY_CHOICE,
+		REQUEST_CHANCELLOR_POLICY_CHOICE,
+		REQUEST_PRESIDENT_VETO,
+		REGULAR_LIBERAL_POLICY,
+		CHAOTIC_LIBERAL_POLICY,
+		REGULAR_FASCIST_POLICY,
+		CHAOTIC_FASCIST_POLICY,
+		TOP_CARDS,
+		REQUEST_INVESTIGATION,
+		SEND_LOYALTY,
+		REQUEST_SPECIAL_NOMINATION,
+		REQUEST_KILL,
+		DEATH,
+		LIBERAL_POLICY_WIN,
+		LIBERAL_HITLER_WIN,
+		FASCIST_POLICY_WIN,
+		FASCIST_HITLER_WIN,
+		FIXED_COUNT,
+
+		// sized by a varint
+		NAME = 128,
+		TEAM,
+		SIZED_END
+	};
+
+	// the bytes an event below 128 starts with, and whether a varint follows them
+	struct Shape {
+		uint8_t bytes;
+		bool varint;
+	};
+
+	constexpr Shape SHAPES[FIXED_COUNT] = {
+		{ 1, false }, // ROSTER
+		{ 1, false }, // READY_TO_START
+		{ 1, false }, // NOT_READY
+		{ 1, false }, // DISCONNECT
+		{ 2, false }, // REASSIGN
+		{ 0, true }, // GAME_KEY
+		{ 1, false }, // ANNOUNCE_ELECTION
+		{ 1, false }, // VOTE_RECEIVED
+		{ 1, true }, // BALLOT
+		{ 1, true }, // REQUEST_CHANCELLOR_NOMINATION
+		{ 1, false }, // REQUEST_PRESIDENT_POLICY_CHOICE
+		{ 1, false }, // REQUEST_CHANCELLOR_POLICY_CHOICE
+		{ 0, false }, // REQUEST_PRESIDENT_VETO
+		{ 0, false }, // REGULAR_LIBERAL_POLICY
+		{ 0, false }, // CHAOTIC_LIBERAL_POLICY
+		{ 0, false }, // REGULAR_FASCIST_POLICY
+		{ 0, false }, // CHAOTIC_FASCIST_POLICY
+		{ 1, false }, // TOP_CARDS
+		{ 0, true }, // REQUEST_INVESTIGATION
+		{ 2, false }, // SEND_LOYALTY
+		{ 0, false }, // REQUEST_SPECIAL_NOMINATION
+		{ 0, true }, // REQUEST_KILL
+		{ 1, false }, // DEATH
+		{ 0, false }, // LIBERAL_POLICY_WIN
+		{ 0, false }, // LIBERAL_HITLER_WIN
+		{ 0, false }, // FASCIST_POLICY_WIN
+		{ 0, false }, // FASCIST_HITLER_WIN
+	};
+
+	constexpr bool isSized(uint8_t code) {
+		return code >= 128;
+	}
+
+	enum Role : uint8_t {
+		LIBERAL_ROLE,
+		FASCIST_ROLE,
+		HITLER_ROLE
+	};
+
+	// the version asked for by v=n in an upgrade's query, 1 if it didn't say, or 0 for one we don't speak
+	inline int requested(std::string_view query) {
+		while (!query.empty()) {
+			auto end = std::min(query.find('&'), query.size());
+			auto pair = query.substr(0, end);
+			if (pair.substr(0, 2) == "v=") {
+				auto value = pair.substr(2);
+				return value == "1" ? 1 : value == "2" ? VERSION : 0;
+			}
+			query.remove_prefix(std::min(end + 1, query.size()));
+		}
+		return 1;
+	}
+
+	inline size_t writeVarint(uint8_t *out, uint64_t value) {
+		size_t n = 0;
+		while (value >= 128) {
+			out[n++] = static_cast<uint8_t>(value) | 128;
+			value >>= 7;
+		}
+		out[n++] = static_cast<uint8_t>(value);
+		return n;
+	}
+
+	// takes a varint off the front of `in`; false if it runs past the end or past 64 bits
+	inline bool readVarint(std::string_view &in, uint64_t &value) {
+		value = 0;
+		for (unsigned shift = 0; shift < 64 && !in.empty(); shift += 7) {
+			auto byte = static_cast<uint8_t>(in[0]);
+			in.remove_prefix(1);
+			value |= static_cast<uint64_t>(byte & 127) << shift;
+			if (byte < 128) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/** A frame being built on the stack, with room for a full roster or many small messages */
+	class Frame {
+		static constexpr size_t CAPACITY = 1024;
+
+		uint8_t data[CAPACITY];
+		size_t length = 0;
+
+	public:
+		// false, leaving the frame as it was, if the event doesn't fit
+		bool event(Event code, std::string_view payload) {
+			uint8_t header[11];
+			header[0] = code;
+			size_t n = 1 + (isSized(code) ? writeVarint(header + 1, payload.size()) : 0);
+			if (length + n + payload.size() > CAPACITY) {
+				return false;
+			}
+			std::memcpy(data + length, header, n);
+			std::memcpy(data + length + n, payload.data(), payload.size());
+			length += n + payload.size();
+			return true;
+		}
+
+		size_t size() const {
+			return length;
+		}
+
+		bool empty() const {
+			return length == 0;
+		}
+
+		void truncate(size_t size) {
+			length = std::min(length, size);
+		}
+
+		std::string_view view() const {
+			return std::string_view(reinterpret_cast<const char *>(data), length);
+		}
+	};
+
+	/** Reads a version 1 message as the events version 2 carries, calling f(Event, payload) for each
+	 *
+	 * `roster` marks the first frame a socket is sent. Returns false if the message is malformed, in which
+	 * case f may already have been called for some of it.
+	 */
+	template <typename F>
+	bool fromV1(std::string_view message, bool roster, F &&f) {
+		if (message.empty()) {
+			return false;
+		}
+		auto *m = reinterpret_cast<const uint8_t *>(message.data());
+		size_t size = message.size();
+		uint8_t p[256];
+		auto emit = [&](Event e, size_t n) {
+			f(e, std::string_view(reinterpret_cast<const char *>(p), n));
+			return true;
+		};
+		auto id = [&](Event e, uint8_t value) {
+			p[0] = value;
+			return emit(e, 1);
+		};
+		// a mask written by Protocol::writeMask into a message whose first byte is m[at]
+		auto readMask = [&](size_t at, uint64_t &value) {
+			if constexpr (Protocol::WIDE_MASKS) {
+				if (size < at + 3) {
+					return false;
+				}
+				value = (m[at + 1] << 8) | m[at + 2];
+			} else {
+				if (size < at + 2) {
+					return false;
+				}
+				value = (m[at] >> 6) | (m[at + 1] << 2);
+			}
+			return true;
+		};
+		// the mask as a varint after n bytes of payload
+		auto mask = [&](Event e, size_t at, size_t n) {
+			uint64_t value;
+			return readMask(at, value) && emit(e, n + writeVarint(p + n, value));
+		};
+
+		if (roster) {
+			id(ROSTER, m[0]);
+			for (size_t i = 1; i < size;) {
+				if (i + 2 > size || (m[i] & 15) != Protocol::NAME || i + 2 + m[i + 1] > size) {
+					return false;
+				}
+				p[0] = m[i] >> 4;
+				std::memcpy(p + 1, m + i + 2, m[i + 1]);
+				emit(NAME, 1 + m[i + 1]);
+				i += 2 + m[i + 1];
+			}
+			return true;
+		}
+
+		uint8_t high = m[0] >> 4;
+		switch (m[0] & 15) {
+			case Protocol::ANNOUNCE_ELECTION:
+				return id(ANNOUNCE_ELECTION, high);
+			case Protocol::REQUEST_PRESIDENT_POLICY_CHOICE:
+				return id(REQUEST_PRESIDENT_POLICY_CHOICE, m[0] >> 5);
+			case Protocol::REQUEST_CHANCELLOR_POLICY_CHOICE:
+				return id(REQUEST_CHANCELLOR_POLICY_CHOICE, m[0] >> 5);
+			case Protocol::REQUEST_INVESTIGATION:
+				return mask(REQUEST_INVESTIGATION, 0, 0);
+			case Protocol::REQUEST_KILL:
+				return mask(REQUEST_KILL, 0, 0);
+			case Protocol::SEND_LOYALTY:
+				p[0] = high;
+				p[1] = size > 1 ? m[1] : 255;
+				return emit(SEND_LOYALTY, 2);
+			case Protocol::TOP_CARDS:
+				p[0] = (m[0] >> 5) | ((m[0] & 16) >> 1);
+				return emit(TOP_CARDS, 1);
+			case Protocol::VOTE_RECEIVED:
+				return id(VOTE_RECEIVED, high);
+			case Protocol::BALLOT:
+				p[0] = high & 1;
+				return mask(BALLOT, 0, 1);
+			case Protocol::DISCONNECT:
+				return id(DISCONNECT, high);
+			case Protocol::READY_TO_START:
+				return id(READY_TO_START, high);
+			case Protocol::NOT_READY:
+				return id(NOT_READY, high);
+			case Protocol::TEAM: {
+				if (size == 1) {
+					p[0] = high == 0 ? LIBERAL_ROLE : HITLER_ROLE;
+					p[1] = high - 1;
+					return emit(TEAM, high == 0 || high == 15 ? 1 : 2);
+				}
+				// fascists are told which of them is Hitler by counting, and are sent Hitler's seat instead
+				unsigned number = high & (Protocol::WIDE_MASKS ? 7 : 3);
+				uint64_t liberals;
+				if (!readMask(0, liberals)) {
+					return false;
+				}
+				unsigned hitler = 0;
+				for (unsigned seen = 0; hitler < 64; hitler++) {
+					if (!(liberals >> hitler & 1) && seen++ == number) {
+						break;
+					}
+				}
+				p[0] = FASCIST_ROLE;
+				p[1] = hitler;
+				return emit(TEAM, 2 + writeVarint(p + 2, liberals));
+			}
+			case Protocol::NAME:
+				if (size > sizeof(p)) {
+					return false;
+				}
+				p[0] = high;
+				std::memcpy(p + 1, m + 1, size - 1);
+				return emit(NAME, size);
+			case Protocol::DEATH:
+				return id(DEATH, high);
+			default:
+				break;
+		}
+		switch (m[0]) {
+			case Protocol::REQUEST_PRESIDENT_VETO:
+				return emit(REQUEST_PRESIDENT_VETO, 0);
+			case Protocol::LIBERAL_POLICY_WIN:
+				return emit(LIBERAL_POLICY_WIN, 0);
+			case Protocol::LIBERAL_HITLER_WIN:
+				return emit(LIBERAL_HITLER_WIN, 0);
+			case Protocol::FASCIST_POLICY_WIN:
+				return emit(FASCIST_POLICY_WIN, 0);
+			case Protocol::FASCIST_HITLER_WIN:
+				return emit(FASCIST_HITLER_WIN, 0);
+			case Protocol::REQUEST_SPECIAL_NOMINATION:
+				return emit(REQUEST_SPECIAL_NOMINATION, 0);
+			case Protocol::REGULAR_FASCIST_POLICY:
+				return emit(REGULAR_FASCIST_POLICY, 0);
+			case Protocol::CHAOTIC_FASCIST_POLICY:
+				return emit(CHAOTIC_FASCIST_POLICY, 0);
+			case Protocol::REGULAR_LIBERAL_POLICY:
+				return emit(REGULAR_LIBERAL_POLICY, 0);
+			case Protocol::CHAOTIC_LIBERAL_POLICY:
+				return emit(CHAOTIC_LIBERAL_POLICY, 0);
+			case Protocol::REASSIGN:
+				if (size < 2) {
+					return false;
+				}
+				p[0] = m[1] >> 4;
+				p[1] = m[1] & 15;
+				return emit(REASSIGN, 2);
+			case Protocol::REQUEST_CHANCELLOR_NOMINATION:
+				if (size < 2) {
+					return false;
+				}
+				// narrow masks share the president's byte
+				p[0] = Protocol::WIDE_MASKS ? m[1] : m[1] & 63;
+				return mask(REQUEST_CHANCELLOR_NOMINATION, 1, 1);
+			case Protocol::GAME_KEY:
+				if (size < 5) {
+					return false;
+				}
+				return emit(GAME_KEY, writeVarint(p, (uint32_t(m[1]) << 24) | (m[2] << 16) | (m[3] << 8) | m[4]));
+			default:
+				return false;
+		}
+	}
+
+	// appends the events of a version 1 message to a frame, all of them or, returning false, none
+	inline bool append(Frame &frame, std::string_view message, bool roster = false) {
+		auto before = frame.size();
+		bool fits = true;
+		bool valid = fromV1(message, roster, [&](Event e, std::string_view payload) {
+			fits = fits && frame.event(e, payload);
+		});
+		if (!valid || !fits) {
+			frame.truncate(before);
+			return false;
+		}
+		return true;
+	}
+
+	/** Calls f(Event, payload) for each event in a frame, and returns false if the frame is malformed
+	 *
+	 * Sized events past the ones listed here are passed on too, for the caller to skip.
+	 */
+	template <typename F>
+	bool decode(std::string_view frame, F &&f) {
+		while (!frame.empty()) {
+			auto code = static_cast<uint8_t>(frame[0]);
+			frame.remove_prefix(1);
+			uint64_t length;
+			if (isSized(code)) {
+				if (!readVarint(frame, length) || length > frame.size()) {
+					return false;
+				}
+			} else {
+				if (code >= FIXED_COUNT || SHAPES[code].bytes > frame.size()) {
+					return false;
+				}
+				length = SHAPES[code].bytes;
+				if (SHAPES[code].varint) {
+					auto rest = frame.substr(length);
+					uint64_t value;
+					if (!readVarint(rest, value)) {
+						return false;
+					}
+					length = frame.size() - rest.size();
+				}
+			}
+			f(static_cast<Event>(code), frame.substr(0, length));
+			frame.remove_prefix(length);
+		}
+		return true;
+	}
+}
+
+#endif //SERVER_PROTOCOL_V2_H
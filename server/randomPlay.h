@@ -0,0 +1,87 @@
+#ifndef SERVER_RANDOM_PLAY_H
+#define SERVER_RANDOM_PLAY_H
+#include <random>
+#include <vector>
+#include "game.h"
+
+/** Plays a game to the end with random legal moves, for the benchmarks and for bot rollouts
+ *
+ * Games can be a GameState, or a GenericGame whose comms hear about every transition. Comms of
+ * playRandomGame also get voteReceived(id) for each vote, which the game itself never announces.
+ */
+template <typename Bits>
+int pick(Bits bits, std::minstd_rand &rng) {
+	int count = bits.count();
+	if (count == 0) {
+		return -1;
+	}
+	int skip = rng() % count;
+	for (size_t i = 0;; i++) {
+		if (bits[i] && skip-- == 0) {
+			return i;
+		}
+	}
+}
+
+// plays on from wherever the game is, calling voted(id) before each vote
+template <typename Game, typename Voted>
+void playOut(Game &game, std::minstd_rand &rng, Voted voted) {
+	using State = GameState;
+	while (game.getState() < State::LIBERAL_POLICY_WIN) {
+		switch (game.getState()) {
+			case State::AWAITING_CHANCELLOR_NOMINATION:
+				game.nominateChancellor(pick(game.getEligibleChancellors(), rng));
+				break;
+			case State::VOTING:
+				for (int i = 0; i < game.getPlayerCount(); i++) {
+					if (game.alive()[i] && game.getState() == State::VOTING) {
+						voted(i);
+						game.addVote(i, rng() % 5 < 3 ? JA : NEIN);
+					}
+				}
+				break;
+			case State::AWAITING_PRESIDENT_POLICY:
+				game.removePresidentPolicy(static_cast<State::PolicyChoice>(rng() % 3));
+				break;
+			case State::AWAITING_CHANCELLOR_POLICY:
+			case State::AWAITING_CHANCELLOR_POLICY_NO_VETO:
+				game.removeChancellorPolicy(static_cast<State::PolicyChoice>(rng() % 2));
+				break;
+			case State::AWAITING_VETO:
+				game.presidentVeto(rng() % 2);
+				break;
+			case State::AWAITING_ALLEGIENCE_PEEK_CHOICE:
+				game.revealLoyalty(pick(game.eligibleForInvestigation(), rng));
+				break;
+			case State::AWAITING_SPECIAL_PRESIDENT_CHOICE:
+			case State::AWAITING_KILL_CHOICE: {
+				auto candidates = game.alive();
+				candidates[game.getPresidentId()] = false;
+				int choice = pick(candidates, rng);
+				if (game.getState() == State::AWAITING_KILL_CHOICE) {
+					game.killPlayer(choice);
+				} else {
+					game.useSpecialPresident(choice);
+				}
+				break;
+			}
+			default:
+				return;
+		}
+	}
+}
+
+template <typename Game>
+void playOut(Game &game, std::minstd_rand &rng) {
+	playOut(game, rng, [](int) {});
+}
+
+template <typename Comms>
+void playRandomGame(Comms &comms, GenericGame<Comms> &game, unsigned seed) {
+	std::minstd_rand rng(seed);
+	game.init(seed);
+	game.start();
+	playOut(game, rng, [&comms](int id) { comms.voteReceived(id); });
+}
+
+#endif //SERVER_RANDOM_PLAY_H
@@ -0,0 +1,135 @@
+#ifndef SERVER_RATE_LIMIT_H
+#define SERVER_RATE_LIMIT_H
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+inline uint32_t currentMillis() {
+	using namespace std::chrono;
+	return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct RateLimit {
+	float rate; // tokens per second
+	float burst;
+};
+
+class TokenBucket {
+	float tokens = -1;
+	uint32_t lastRefill = 0;
+
+public:
+	bool take(const RateLimit &limit, uint32_t now) {
+		if (tokens < 0) {
+			tokens = limit.burst;
+		} else {
+			tokens = std::min(limit.burst, tokens + (now - lastRefill) * limit.rate / 1000);
+		}
+		lastRefill = now;
+		if (tokens < 1) {
+			return false;
+		}
+		tokens -= 1;
+		return true;
+	}
+
+	uint32_t lastUsed() const {
+		return lastRefill;
+	}
+};
+
+/** Token buckets keyed by remote address
+ *
+ * Open addressing with linear probing over a fixed power-of-two table, so lookups never allocate.
+ * Entries are never deleted. When every slot in the probe window is taken, the one that was used
+ * least recently is handed over to the new address; an evicted address starts again with a full bucket.
+ */
+class RateLimitTable {
+	struct Entry {
+		uint64_t hash = 0;
+		TokenBucket bucket;
+	};
+
+	std::vector<Entry> entries;
+
+public:
+	static constexpr unsigned MAX_PROBES = 8;
+
+	// an address's entry is within MAX_PROBES slots of this, mod the table's size; never 0, which marks an empty slot
+	static uint64_t hashAddress(std::string_view address) {
+		uint64_t h = 14695981039346656037ULL;
+		for (unsigned char c : address) {
+			h ^= c;
+			h *= 1099511628211ULL;
+		}
+		return h | 1;
+	}
+
+	explicit RateLimitTable(unsigned capacityLog2 = 16) : entries(1U << capacityLog2) {
+	}
+
+	bool take(std::string_view address, const RateLimit &limit, uint32_t now) {
+		auto h = hashAddress(address);
+		auto mask = entries.size() - 1;
+		Entry *victim = nullptr;
+		for (unsigned i = 0; i < MAX_PROBES; i++) {
+			auto &e = entries[(h + i) & mask];
+			if (e.hash == h) {
+				return e.bucket.take(limit, now);
+			}
+			if (e.hash == 0) {
+				victim = &e;
+				break;
+			}
+			if (!victim || now - e.bucket.lastUsed() > now - victim->bucket.lastUsed()) {
+				victim = &e;
+			}
+		}
+		victim->hash = h;
+		victim->bucket = TokenBucket();
+		return victim->bucket.take(limit, now);
+	}
+};
+
+/** Limits read from the environment at startup; a ceiling of 0 means unlimited */
+struct AdmissionLimits {
+	RateLimit createPerAddress = { 1, 10 };
+	RateLimit messagesPerSocket = { 20, 40 };
+	size_t maxGames = 0;
+	size_t maxMemoryBytes = 0;
+
+	/** Whether the game and memory ceilings leave room for one more game in `managers`, a SlotMap */
+	template <typename Slots>
+	bool roomForGame(const Slots &managers) const {
+		if (maxGames && managers.size() >= maxGames) {
+			return false;
+		}
+		if (maxMemoryBytes && managers.reservedBytes() + managers.bytesForNextSlot() > maxMemoryBytes) {
+			return false;
+		}
+		return true;
+	}
+
+	static AdmissionLimits fromEnvironment() {
+		AdmissionLimits limits;
+		auto read = [](const char *key, auto &value) {
+			if (const char *s = getenv(key)) {
+				value = std::strtod(s, nullptr);
+			}
+		};
+		read("SH_CREATE_RATE", limits.createPerAddress.rate);
+		read("SH_CREATE_BURST", limits.createPerAddress.burst);
+		read("SH_MESSAGE_RATE", limits.messagesPerSocket.rate);
+		read("SH_MESSAGE_BURST", limits.messagesPerSocket.burst);
+		read("SH_MAX_GAMES", limits.maxGames);
+		size_t megabytes = 0;
+		read("SH_MAX_MEMORY_MB", megabytes);
+		limits.maxMemoryBytes = megabytes * 1024 * 1024;
+		return limits;
+	}
+};
+
+#endif //SERVER_RATE_LIMIT_H
@@ -0,0 +1,243 @@
+#ifndef SERVER_SLAB_H
+#define SERVER_SLAB_H
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <string>
+#include <utility>
+#include <sys/mman.h>
+#include <fmt/format.h>
+
+/** Fixed-size objects carved out of 64 KiB slabs, with one arena per event loop thread
+ *
+ * Per-connection and per-game state that outgrows its socket or its slot comes from here instead of the
+ * general heap, so objects of one size sit together and 100k sockets churning can't leave small holes
+ * between everything else. Slabs are mapped straight from the kernel, aligned to their size, so an
+ * object's slab is its address with the low bits masked off, and freeing needs no size.
+ *
+ * Each size class allocates from its oldest slab with room. A full slab that gets space back goes behind
+ * the others, so the older ones fill up while it drains. One empty slab per class is kept for the next
+ * burst, and any others are unmapped, which gives the memory back to the kernel after a peak.
+ *
+ * Objects must be freed on the thread that allocated them.
+ */
+namespace slab {
+	constexpr size_t SLAB_SIZE = 64 * 1024;
+
+	// the classes with a user are a queued Message with its link (272) and a delayed spectator's EventRing (4104)
+	constexpr std::array<uint32_t, 7> CLASS_SIZES = { 32, 64, 128, 272, 512, 1024, 4104 };
+
+	constexpr int classFor(size_t size) {
+		for (size_t i = 0; i < CLASS_SIZES.size(); i++) {
+			if (size <= CLASS_SIZES[i]) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	struct ClassStats {
+		uint32_t objectSize;
+		size_t slabs;
+		size_t live;
+		size_t capacity;
+	};
+
+	class Arena {
+		struct Slab {
+			Slab *prev;
+			Slab *next;
+			// freed objects, linked through their first bytes
+			void *free;
+			uint32_t used;
+			// objects past this index have never been handed out, so their pages may not be resident
+			uint32_t untouched;
+			uint32_t capacity;
+			uint32_t sizeClass;
+		};
+
+		static constexpr size_t HEADER = (sizeof(Slab) + 63) / 64 * 64;
+
+		struct List {
+			Slab *head = nullptr;
+			Slab *tail = nullptr;
+
+			void unlink(Slab *s) {
+				(s->prev ? s->prev->next : head) = s->next;
+				(s->next ? s->next->prev : tail) = s->prev;
+			}
+
+			void pushBack(Slab *s) {
+				s->prev = tail;
+				s->next = nullptr;
+				(tail ? tail->next : head) = s;
+				tail = s;
+			}
+		};
+
+		struct SizeClass {
+			// slabs with room, oldest first
+			List partial;
+			List full;
+			size_t slabs = 0;
+			size_t live = 0;
+			size_t empty = 0;
+		};
+
+		std::array<SizeClass, CLASS_SIZES.size()> classes;
+
+		static char *objects(Slab *s) {
+			return reinterpret_cast<char *>(s) + HEADER;
+		}
+
+		// maps twice the size and trims it down to a slab aligned to its size
+		static Slab *map(int sizeClass) {
+			void *p = mmap(nullptr, 2 * SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == MAP_FAILED) {
+				throw std::bad_alloc();
+			}
+			auto start = reinterpret_cast<uintptr_t>(p);
+			auto aligned = (start + SLAB_SIZE - 1) & ~(SLAB_SIZE - 1);
+			if (aligned > start) {
+				munmap(p, aligned - start);
+			}
+			munmap(reinterpret_cast<void *>(aligned + SLAB_SIZE), start + SLAB_SIZE - aligned);
+			auto *s = reinterpret_cast<Slab *>(aligned);
+			*s = { nullptr, nullptr, nullptr, 0, 0, static_cast<uint32_t>((SLAB_SIZE - HEADER) / CLASS_SIZES[sizeClass]),
+					static_cast<uint32_t>(sizeClass) };
+			return s;
+		}
+
+	public:
+		Arena() = default;
+		Arena(const Arena &) = delete;
+		Arena &operator=(const Arena &) = delete;
+
+		~Arena() {
+			for (auto &c : classes) {
+				for (auto *list : { &c.partial, &c.full }) {
+					while (auto *s = list->head) {
+						list->unlink(s);
+						munmap(s, SLAB_SIZE);
+					}
+				}
+			}
+		}
+
+		void *allocate(int sizeClass) {
+			auto &c = classes[sizeClass];
+			auto *s = c.partial.head;
+			if (!s) {
+				s = map(sizeClass);
+				c.partial.pushBack(s);
+				c.slabs++;
+				c.empty++;
+			}
+			void *p;
+			if (s->free) {
+				p = s->free;
+				s->free = *static_cast<void **>(p);
+			} else {
+				p = objects(s) + size_t(s->untouched++) * CLASS_SIZES[sizeClass];
+			}
+			c.empty -= s->used == 0;
+			s->used++;
+			c.live++;
+			if (s->used == s->capacity) {
+				c.partial.unlink(s);
+				c.full.pushBack(s);
+			}
+			return p;
+		}
+
+		void deallocate(void *p) {
+			auto *s = reinterpret_cast<Slab *>(reinterpret_cast<uintptr_t>(p) & ~(SLAB_SIZE - 1));
+			auto &c = classes[s->sizeClass];
+			*static_cast<void **>(p) = s->free;
+			s->free = p;
+			c.live--;
+			if (s->used-- == s->capacity) {
+				// behind the older slabs, which fill up first while this one drains
+				c.full.unlink(s);
+				c.partial.pushBack(s);
+			}
+			if (s->used > 0) {
+				return;
+			}
+			if (c.empty > 0) {
+				c.partial.unlink(s);
+				munmap(s, SLAB_SIZE);
+				c.slabs--;
+				return;
+			}
+			c.empty++;
+		}
+
+		ClassStats stats(int sizeClass) const {
+			auto &c = classes[sizeClass];
+			size_t perSlab = (SLAB_SIZE - HEADER) / CLASS_SIZES[sizeClass];
+			return { CLASS_SIZES[sizeClass], c.slabs, c.live, c.slabs * perSlab };
+		}
+	};
+
+	inline Arena &local() {
+		static thread_local Arena arena;
+		return arena;
+	}
+
+	template <typename T, typename... Args>
+	T *make(Args &&...args) {
+		constexpr int sizeClass = classFor(sizeof(T));
+		static_assert(sizeClass >= 0, "too big for a slab size class");
+		static_assert(alignof(T) <= 8 || CLASS_SIZES[sizeClass] % alignof(T) == 0, "size class breaks alignment");
+		void *p = local().allocate(sizeClass);
+		if constexpr (sizeof...(Args) == 0) {
+			// default-initialized, like new T, so buffers aren't zeroed only to be overwritten
+			return new (p) T;
+		} else {
+			return new (p) T(std::forward<Args>(args)...);
+		}
+	}
+
+	template <typename T>
+	void destroy(T *p) {
+		p->~T();
+		local().deallocate(p);
+	}
+
+	// for unique_ptr
+	struct Delete {
+		template <typename T>
+		void operator()(T *p) const {
+			destroy(p);
+		}
+	};
+
+	/** Appends this thread's slab usage to a Prometheus scrape
+	 *
+	 * Fragmentation is the share of mapped slab memory not holding a live object.
+	 */
+	inline void render(std::string &out) {
+		auto it = std::back_inserter(out);
+		auto &arena = local();
+		size_t mapped = 0, live = 0;
+		fmt::format_to(it, "# TYPE sh_slab_bytes gauge\n");
+		for (size_t i = 0; i < CLASS_SIZES.size(); i++) {
+			auto s = arena.stats(i);
+			fmt::format_to(it, "sh_slab_bytes{{size=\"{}\"}} {}\n", s.objectSize, s.slabs * SLAB_SIZE);
+			mapped += s.slabs * SLAB_SIZE;
+		}
+		fmt::format_to(it, "# TYPE sh_slab_live_bytes gauge\n");
+		for (size_t i = 0; i < CLASS_SIZES.size(); i++) {
+			auto s = arena.stats(i);
+			fmt::format_to(it, "sh_slab_live_bytes{{size=\"{}\"}} {}\n", s.objectSize, s.live * s.objectSize);
+			live += s.live * s.objectSize;
+		}
+		fmt::format_to(it, "# TYPE sh_slab_fragmentation gauge\nsh_slab_fragmentation {:.4f}\n",
+				mapped ? 1 - double(live) / mapped : 0.0);
+	}
+}
+
+#endif //SERVER_SLAB_H
@@ -5,8 +5,10 @@
 #include <optional>
 #include <functional>
 #include "manager.h"
+#include "metrics.h"
 
 
+template <typename Socket>
 class SlotMap {
 	typedef uint8_t Generation;
 	typedef uint8_t MajorIndex;
@@ -33,71 +35,129 @@ public:
 	};
 
 private:
-	std::vector<std::vector<std::tuple<Manager, Generation>>> managers;
+	// the flag is set while the slot holds a game, so keys for empty slots find nothing
+	std::vector<std::vector<std::tuple<Manager<Socket>, Generation, bool>>> managers;
 	std::vector<std::vector<Key>> freeSlots;
+	size_t liveCount = 0;
+	// when processes share a port, this one owns the major indexes equal to `process` mod `processes`
+	unsigned process;
+	unsigned processes;
 
-	void addManagerSet() {
-		managers.emplace_back().resize(1U << (8 * sizeof(MinorIndex)));
+	static constexpr unsigned MAJOR_INDEXES = 1U << (8 * sizeof(MajorIndex));
+	static constexpr unsigned SET_SIZE = 1U << (8 * sizeof(MinorIndex));
+	static constexpr size_t managerSetBytes = sizeof(std::tuple<Manager<Socket>, Generation, bool>) * SET_SIZE;
+
+	// false once the next set's major index wouldn't fit in a key
+	bool addManagerSet() {
+		unsigned major = managers.size() * processes + process;
+		if (major >= MAJOR_INDEXES) {
+			return false;
+		}
+		managers.emplace_back().resize(SET_SIZE);
 		auto &keys = freeSlots.emplace_back();
-		keys.reserve(sizeof(MinorIndex));
-		constexpr unsigned secondTierSize = (1U << (8 * sizeof(MinorIndex)));
-		for (unsigned i = 0; i < secondTierSize; i++) {
-			keys.push_back(Key(0, managers.size() - 1, secondTierSize - 1 - i));
+		keys.reserve(SET_SIZE);
+		for (unsigned i = 0; i < SET_SIZE; i++) {
+			keys.push_back(Key(0, major, SET_SIZE - 1 - i));
 		}
+		return true;
+	}
+
+	size_t setOf(Key key) const {
+		return key.M / processes;
 	}
 
 	void reclaim(Key key) {
+		liveCount--;
 		key.g++;
-		freeSlots[key.M].push_back(key);
+		freeSlots[setOf(key)].push_back(key);
 
-		auto &outer = managers[key.M];
+		auto &outer = managers[setOf(key)];
 		std::get<1>(outer[key.m])++;
+		std::get<2>(outer[key.m]) = false;
 	}
 
 public:
-	Key getSlot() {
-		if (freeSlots.back().size() == 0) {
-			addManagerSet();
-		}
+	/** A key to a new game, or nothing if every slot this process can name a key for is in use */
+	std::optional<Key> getSlot() {
 		auto it = std::find_if(freeSlots.begin(), freeSlots.end(), [](auto &x) { return x.size() > 0; });
-		Key key;
 		if (it == freeSlots.end()) {
-			addManagerSet();
-			auto &v = freeSlots.back();
-			key = v.back();
-			v.pop_back();
-		} else {
-			key = it->back();
-			it->pop_back();
+			if (!addManagerSet()) {
+				return {};
+			}
+			it = freeSlots.end() - 1;
 		}
+		Key key = it->back();
+		it->pop_back();
+		liveCount++;
 
-		Manager &manager = (*this)[key].value();
-		new (&manager) Manager;
-		auto self = this;
-		manager.setDeleter([self, key]() {
-			Manager &m = (*self)[key].value();
+		std::get<2>(managers[setOf(key)][key.m]) = true;
+		Manager<Socket> &manager = (*this)[key].value();
+		new (&manager) Manager<Socket>;
+		manager.setGameId(key.gameId());
+		auto &counters = metrics::local();
+		counters.gamesCreated.inc();
+		counters.gamesByState[manager.getState()].inc();
+		manager.setDeleter([](void *context, uint32_t gameId) {
+			auto *self = static_cast<SlotMap *>(context);
+			Key key(gameId);
+			Manager<Socket> &m = (*self)[key].value();
+			auto &counters = metrics::local();
+			counters.gamesDestroyed.inc();
+			counters.gamesByState[m.getState()].dec();
 			m.~Manager();
 			self->reclaim(key);
-		});
+		}, this);
 		return key;
 	}
 
-	std::optional<std::reference_wrapper<Manager>> operator[](Key key) {
-		if (key.M >= managers.size()) {
+	std::optional<std::reference_wrapper<Manager<Socket>>> operator[](Key key) {
+		if (key.M % processes != process || setOf(key) >= managers.size()) {
 			return {};
 		}
-		auto &outer = managers[key.M];
+		auto &outer = managers[setOf(key)];
 		if (key.m >= outer.size()) {
 			return {};
 		}
-		auto &[manager, generation] = outer[key.m];
-		if (generation != key.g) {
+		auto &[manager, generation, live] = outer[key.m];
+		if (!live || generation != key.g) {
 			return {};
 		}
 		return std::optional(std::reference_wrapper(manager));
 	}
 
-	SlotMap() {
+	size_t size() const {
+		return liveCount;
+	}
+
+	/** Calls `f` with every live game, which `f` may end */
+	template <typename F>
+	void forEach(F f) {
+		for (auto &set : managers) {
+			for (auto &slot : set) {
+				if (std::get<2>(slot)) {
+					f(std::get<0>(slot));
+				}
+			}
+		}
+	}
+
+	// memory held by manager sets, whether or not their slots are in use
+	size_t reservedBytes() const {
+		return managers.size() * managerSetBytes;
+	}
+
+	// the most games each of `processes` can hold at once, as every set takes a major index of its own
+	static constexpr size_t capacity(unsigned processes) {
+		return MAJOR_INDEXES / processes * SET_SIZE;
+	}
+
+	// the memory the next call to getSlot will need
+	size_t bytesForNextSlot() const {
+		bool hasFreeSlot = std::any_of(freeSlots.begin(), freeSlots.end(), [](auto &x) { return x.size() > 0; });
+		return hasFreeSlot ? 0 : managerSetBytes;
+	}
+
+	explicit SlotMap(unsigned process = 0, unsigned processes = 1) : process(process), processes(processes) {
 		addManagerSet();
 	}
 };
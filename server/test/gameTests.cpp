@@ -1,5 +1,23 @@
 #include <gtest/gtest.h>
-#include "../game.h"
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "../manager.h"
+#include "../bot.h"
+#include "../cluster.h"
+#include "../drain.h"
+#include "../eventRing.h"
+#include "../lobbyIndex.h"
+#include "../matchmaker.h"
+#include "../processes.h"
+#include "../protocolV2.h"
+#include "../rateLimit.h"
+#include "../slotMap.h"
+#include "../trace.h"
+#include "invariants.h"
 
 #include <fmt/core.h>
 
@@ -8,171 +26,1202 @@ int method##_calls = 0;\
 void method() { method##_calls++; }
 
 namespace {
-	class TestCommunicationManager5 {
+	class TestCommunicationManager {
 	public:
-		Game<FIVE, TestCommunicationManager5> game;
+		GenericGame<TestCommunicationManager> game;
+		using Game = GenericGame<TestCommunicationManager>;
+		int playerCount;
 
-		TestCommunicationManager5() : game(*this, 100) {}
+		explicit TestCommunicationManager(int playerCount, unsigned long long seed = 100) : game(*this), playerCount(playerCount) {
+			game.init(seed);
+			game.start();
+		}
+
+		int getClientCount() const {
+			return playerCount;
+		}
 
-		Mock(announceVote)
+		Mock(announceElection)
+		Mock(successfulElection)
+		Mock(failedElection)
+		Mock(chaoticFascistPolicy)
+		Mock(chaoticLiberalPolicy)
+		Mock(regularFascistPolicy)
+		Mock(regularLiberalPolicy)
 		Mock(fascistHitlerWin)
 		Mock(fascistPolicyWin)
+		Mock(liberalHitlerWin)
 		Mock(liberalPolicyWin)
 		Mock(requestChancellorNomination)
 		Mock(sendPresidentPolicyChoice)
 		Mock(sendChancellorPolicyChoice)
 		Mock(sendPresidentVetoOption)
 		Mock(requestInvestigation)
-		Mock(sendTopCards)
 		Mock(requestSpecialPresidentNomination)
 		Mock(requestKill)
 
-		void initState() {
-			EXPECT_LT(game.getPresidentId(), game.noPlayers);
-			EXPECT_LT(game.getPresidentCounter(), game.noPlayers);
-			EXPECT_LT(game.getHitler(), game.noPlayers);
+		int sendLoyalty_calls = 0;
+		void sendLoyalty(int, int, Team) { sendLoyalty_calls++; }
+
+		int sendTopCards_calls = 0;
+		void sendTopCards(int) { sendTopCards_calls++; }
+
+		int announceDeath_calls = 0;
+		void announceDeath(int) { announceDeath_calls++; }
+
+		// nominates someone the president is allowed to, and returns them
+		int nominateAnyone() {
+			auto eligible = game.getEligibleChancellors();
+			for (int i = 0; i < playerCount; i++) {
+				if (eligible[i]) {
+					game.nominateChancellor(i);
+					return i;
+				}
+			}
+			return -1;
+		}
+
+		void voteAll(Vote v) {
+			for (int i = 0; i < playerCount; i++) {
+				game.addVote(i, v);
+			}
+		}
+	};
+
+	TEST(GameStart, InitialState) {
+		for (int players = FIVE; players <= MAX_PLAYERS; players++) {
+			TestCommunicationManager manager(players);
+			auto &game = manager.game;
+			EXPECT_LT(game.getPresidentId(), players);
+			EXPECT_LT(game.getPresidentCounter(), players);
+			EXPECT_LT(game.getHitler(), players);
 			EXPECT_GE(game.getPresidentId(), 0);
 			EXPECT_GE(game.getHitler(), 0);
 			EXPECT_EQ(game.getState(), game.AWAITING_CHANCELLOR_NOMINATION);
 			EXPECT_EQ(game.getElectionTracker(), 0);
 			EXPECT_EQ(game.getPreviousChancellorId(), -1);
 			EXPECT_EQ(game.getPreviousPresidentId(), -1);
+			EXPECT_EQ(game.getDeckSize(), game.policyCount);
+			EXPECT_EQ(game.getDeckLiberals(), game.totalLiberalPolicies);
+			EXPECT_EQ(manager.requestChancellorNomination_calls, 1);
+		}
+	}
+
+	TEST(GameStart, FascistCounts) {
+		constexpr int fascists[] = { 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7 };
+		for (int players = FIVE; players <= MAX_PLAYERS; players++) {
+			TestCommunicationManager manager(players);
+			auto liberals = manager.game.getTeams().count();
+			EXPECT_EQ(players - static_cast<int>(liberals), fascists[players - FIVE]) << players << " players";
 		}
+	}
 
-		void round0() {
-			game.nominateChancellor(3);
-			ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_NOMINATION);
+	TEST(Nomination, PresidentCannotNominateThemselves) {
+		TestCommunicationManager manager(FIVE);
+		auto &game = manager.game;
+		game.nominateChancellor(game.getPresidentId());
+		ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_NOMINATION);
+		ASSERT_EQ(manager.announceElection_calls, 0);
+	}
 
-			game.nominateChancellor(1);
-			ASSERT_EQ(announceVote_calls, 1);
-			ASSERT_EQ(game.getState(), game.VOTING);
+	TEST(Election, FailedElectionMovesThePresidency) {
+		TestCommunicationManager manager(FIVE);
+		auto &game = manager.game;
+		auto president = game.getPresidentId();
+		manager.nominateAnyone();
+		ASSERT_EQ(game.getState(), game.VOTING);
+		manager.voteAll(NEIN);
+		ASSERT_EQ(manager.failedElection_calls, 1);
+		ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_NOMINATION);
+		ASSERT_EQ(game.getElectionTracker(), 1);
+		ASSERT_EQ(game.getPresidentId(), (president + 1) % FIVE);
+	}
 
+	TEST(Election, VotesOnlyCountOnce) {
+		TestCommunicationManager manager(FIVE);
+		auto &game = manager.game;
+		manager.nominateAnyone();
+		for (int i = 0; i < 10; i++) {
 			game.addVote(0, JA);
-			ASSERT_EQ(game.getState(), game.VOTING);
-			game.addVote(1, NEIN);
-			ASSERT_EQ(game.getState(), game.VOTING);
-			game.addVote(2, NEIN);
-			ASSERT_EQ(game.getState(), game.VOTING);
-			game.addVote(3, JA);
-			ASSERT_EQ(game.getState(), game.VOTING);
-			game.addVote(4, NEIN);
-			ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_NOMINATION);
-			ASSERT_EQ(game.getElectionTracker(), 1);
-			ASSERT_EQ(game.getPresidentId(), 4);
-		}
-
-		void round1() {
-			game.nominateChancellor(1);
-			ASSERT_EQ(game.getState(), game.VOTING);
-			game.addVote(0, JA);
-			ASSERT_EQ(game.getState(), game.VOTING);
-			game.addVote(1, JA);
-			ASSERT_EQ(game.getState(), game.VOTING);
-			game.addVote(2, NEIN);
-			ASSERT_EQ(game.getState(), game.VOTING);
-			game.addVote(3, JA);
-			ASSERT_EQ(game.getState(), game.VOTING);
-			game.addVote(4, NEIN);
-			ASSERT_EQ(game.getState(), game.AWAITING_PRESIDENT_POLICY);
-			ASSERT_EQ(sendPresidentPolicyChoice_calls, 1);
-			ASSERT_EQ(game.getElectionTracker(), 1);
-
-			game.removePresidentPolicy(game.FIRST);
-			ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_POLICY);
-			ASSERT_EQ(sendChancellorPolicyChoice_calls, 1);
-
-			game.removeChancellorPolicy(game.SECOND);
-			ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_NOMINATION);
-			ASSERT_EQ(game.getPresidentId(), 0);
-			ASSERT_EQ(game.getElectionTracker(), 0);
-			ASSERT_EQ(game.getFascistPolicies(), 1);
-		}
-
-		// fail three elections
-		void round2() {
-			game.nominateChancellor(4);
-			game.addVote(0, JA);
-			game.addVote(1, NEIN);
-			game.addVote(2, NEIN);
-			game.addVote(3, JA);
-			game.addVote(4, NEIN);
-			ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_NOMINATION);
-			ASSERT_EQ(game.getElectionTracker(), 1);
-
-			game.nominateChancellor(4);
-			game.addVote(0, NEIN);
-			game.addVote(1, JA);
-			game.addVote(2, NEIN);
-			game.addVote(3, JA);
-			game.addVote(4, NEIN);
-			ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_NOMINATION);
-			ASSERT_EQ(game.getElectionTracker(), 2);
-
-			game.nominateChancellor(4);
-			game.addVote(0, JA);
-			game.addVote(1, JA);
-			game.addVote(2, NEIN);
-			game.addVote(3, NEIN);
-			game.addVote(4, NEIN);
-			ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_NOMINATION);
-			ASSERT_EQ(game.getElectionTracker(), 0);
-			ASSERT_EQ(game.getLiberalPolicies() + game.getFascistPolicies(), 2);
+		}
+		ASSERT_EQ(game.getState(), game.VOTING);
+	}
 
-			ASSERT_EQ(game.getLiberalPolicies(), 0);
-			ASSERT_EQ(game.getFascistPolicies(), 2);
+	TEST(Election, ThreeFailedElectionsEnactTheTopPolicy) {
+		TestCommunicationManager manager(FIVE);
+		auto &game = manager.game;
+		auto top = std::get<0>(game.peekTopCards());
+		for (int i = 0; i < 3; i++) {
+			manager.nominateAnyone();
+			manager.voteAll(NEIN);
 		}
+		ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_NOMINATION);
+		ASSERT_EQ(game.getElectionTracker(), 0);
+		ASSERT_EQ(game.getLiberalPolicies() + game.getFascistPolicies(), 1);
+		ASSERT_EQ(top == LIBERAL ? manager.chaoticLiberalPolicy_calls : manager.chaoticFascistPolicy_calls, 1);
+		ASSERT_EQ(game.getPreviousPresidentId(), -1);
+		ASSERT_EQ(game.getPreviousChancellorId(), -1);
+	}
 
-		// we should have powers now
-		void round3() {
-			game.nominateChancellor(0);
-			game.addVote(0, JA);
-			game.addVote(1, JA);
-			game.addVote(2, NEIN);
-			game.addVote(3, JA);
-			game.addVote(4, NEIN);
-
-			ASSERT_EQ(game.getState(), game.AWAITING_PRESIDENT_POLICY);
-			ASSERT_EQ(sendPresidentPolicyChoice_calls, 2);
-			ASSERT_EQ(game.getElectionTracker(), 0);
-
-			ASSERT_EQ(game.getFirstPolicy(), LIBERAL);
-			ASSERT_EQ(game.getSecondPolicy(), FASCIST);
-			ASSERT_EQ(game.getSecondPolicy(), FASCIST);
-			game.removePresidentPolicy(game.SECOND);
-
-			ASSERT_EQ(game.getFirstPolicy(), LIBERAL);
-			ASSERT_EQ(game.getSecondPolicy(), FASCIST);
-			ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_POLICY);
-			ASSERT_EQ(sendChancellorPolicyChoice_calls, 2);
-
-			game.removeChancellorPolicy(game.FIRST);
-			ASSERT_EQ(game.getFascistPolicies(), 3);
-			ASSERT_EQ(game.getLiberalPolicies(), 0);
-			ASSERT_EQ(sendTopCards_calls, 1);
-			ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_NOMINATION);
-		}
-
-		// do two liberal policies
-		void round4() {
-			game.nominateChancellor(1);
-			game.addVote(0, JA);
-			game.addVote(1, JA);
-			game.addVote(2, NEIN);
-			game.addVote(3, JA);
-			game.addVote(4, NEIN);
+	TEST(Legislation, ChancellorEnactsTheCardTheyKeep) {
+		TestCommunicationManager manager(FIVE);
+		auto &game = manager.game;
+		manager.nominateAnyone();
+		manager.voteAll(JA);
+		ASSERT_EQ(manager.successfulElection_calls, 1);
+		ASSERT_EQ(game.getState(), game.AWAITING_PRESIDENT_POLICY);
+		ASSERT_EQ(game.getDeckSize(), game.policyCount - 3);
+
+		auto third = game.getThirdPolicy();
+		game.removePresidentPolicy(game.FIRST);
+		ASSERT_EQ(game.getState(), game.AWAITING_CHANCELLOR_POLICY);
+		ASSERT_EQ(game.getFirstPolicy(), third);
+
+		auto kept = game.getFirstPolicy();
+		game.removeChancellorPolicy(game.SECOND);
+		ASSERT_EQ(kept == LIBERAL ? game.getLiberalPolicies() : game.getFascistPolicies(), 1);
+		ASSERT_EQ(game.getElectionTracker(), 0);
+	}
+
+	/** Plays games with random moves, including invalid ones, and checks the rules after every move
+	 *
+	 * On top of the shared invariants, this tracks discarded policies, so that the deck, the cards in hand,
+	 * the discards and the enacted policies always add up to the 17 policies of the game.
+	 */
+	class RandomPlayer {
+		TestCommunicationManager &manager;
+		std::minstd_rand rng;
+		int discardedLiberals = 0;
+		int discardedFascists = 0;
+		int lastDeckSize;
+
+		void discard(Team p) {
+			(p == LIBERAL ? discardedLiberals : discardedFascists)++;
+		}
+
+	public:
+		RandomPlayer(TestCommunicationManager &manager, unsigned seed) : manager(manager), rng(seed) {
+			lastDeckSize = manager.game.getDeckSize();
+		}
+
+		void move() {
+			using Game = TestCommunicationManager::Game;
+			auto &game = manager.game;
+			int target = rng() % manager.playerCount;
+			switch (game.getState()) {
+				case Game::AWAITING_CHANCELLOR_NOMINATION:
+					game.nominateChancellor(target);
+					break;
+				case Game::VOTING:
+					game.addVote(target, rng() % 5 < 3 ? JA : NEIN);
+					break;
+				case Game::AWAITING_PRESIDENT_POLICY: {
+					Team hand[] = { game.getFirstPolicy(), game.getSecondPolicy(), game.getThirdPolicy() };
+					auto choice = rng() % 3;
+					discard(hand[choice]);
+					game.removePresidentPolicy(static_cast<Game::PolicyChoice>(choice));
+					break;
+				}
+				case Game::AWAITING_CHANCELLOR_POLICY:
+				case Game::AWAITING_CHANCELLOR_POLICY_NO_VETO: {
+					auto first = game.getFirstPolicy();
+					auto second = game.getSecondPolicy();
+					auto choice = rng() % 3;
+					if (choice == Game::FIRST) {
+						discard(first);
+					} else if (choice == Game::SECOND) {
+						discard(second);
+					}
+					game.removeChancellorPolicy(static_cast<Game::PolicyChoice>(choice));
+					break;
+				}
+				case Game::AWAITING_VETO: {
+					bool accept = rng() % 2;
+					if (accept) {
+						discard(game.getFirstPolicy());
+						discard(game.getSecondPolicy());
+					}
+					game.presidentVeto(accept);
+					break;
+				}
+				case Game::AWAITING_ALLEGIENCE_PEEK_CHOICE:
+					game.revealLoyalty(target);
+					break;
+				case Game::AWAITING_SPECIAL_PRESIDENT_CHOICE:
+					game.useSpecialPresident(target);
+					break;
+				case Game::AWAITING_KILL_CHOICE:
+					game.killPlayer(target);
+					break;
+				default:
+					break;
+			}
+			// a reshuffle puts every discard back into the deck
+			if (game.getDeckSize() > lastDeckSize) {
+				discardedLiberals = 0;
+				discardedFascists = 0;
+			}
+			lastDeckSize = game.getDeckSize();
+		}
 
-			ASSERT_EQ(game.getState(), game.FASCIST_HITLER_WIN);
-			ASSERT_EQ(fascistHitlerWin_calls, 1);
+		int liberalsInPlay() {
+			auto &game = manager.game;
+			int hand = 0;
+			switch (game.getState()) {
+				case TestCommunicationManager::Game::AWAITING_PRESIDENT_POLICY:
+					hand += game.getThirdPolicy();
+					[[fallthrough]];
+				case TestCommunicationManager::Game::AWAITING_CHANCELLOR_POLICY:
+				case TestCommunicationManager::Game::AWAITING_CHANCELLOR_POLICY_NO_VETO:
+				case TestCommunicationManager::Game::AWAITING_VETO:
+					hand += game.getFirstPolicy() + game.getSecondPolicy();
+					break;
+				default:
+					break;
+			}
+			return game.getDeckLiberals() + hand + discardedLiberals + game.getLiberalPolicies();
+		}
+
+		int cardsInPlay() {
+			auto &game = manager.game;
+			int hand = 0;
+			switch (game.getState()) {
+				case TestCommunicationManager::Game::AWAITING_PRESIDENT_POLICY:
+					hand = 3;
+					break;
+				case TestCommunicationManager::Game::AWAITING_CHANCELLOR_POLICY:
+				case TestCommunicationManager::Game::AWAITING_CHANCELLOR_POLICY_NO_VETO:
+				case TestCommunicationManager::Game::AWAITING_VETO:
+					hand = 2;
+					break;
+				default:
+					break;
+			}
+			return game.getDeckSize() + hand + discardedLiberals + discardedFascists
+					+ game.getLiberalPolicies() + game.getFascistPolicies();
 		}
 	};
 
-	TEST(FivePeople, FascistHitlerWinGame) {
-		TestCommunicationManager5 manager;
-		manager.initState();
-		manager.round0();
-		manager.round1();
-		manager.round2();
-		manager.round3();
-		manager.round4();
+	TEST(RandomPlay, RulesHoldAfterEveryMove) {
+		constexpr unsigned seeds = 500;
+		constexpr int maxMoves = 20000;
+		for (int players = FIVE; players <= MAX_PLAYERS; players++) {
+			int finished = 0;
+			for (unsigned seed = 1; seed <= seeds; seed++) {
+				TestCommunicationManager manager(players, seed);
+				RandomPlayer player(manager, seed);
+				auto &game = manager.game;
+				for (int move = 0; move < maxMoves && game.getState() < game.LIBERAL_POLICY_WIN; move++) {
+					player.move();
+					auto broken = brokenInvariant(game, players);
+					ASSERT_EQ(broken, nullptr) << broken << " in state " << game.getState() << " (" << players << " players, seed " << seed << ", move " << move << ")";
+					ASSERT_EQ(player.cardsInPlay(), game.policyCount) << players << " players, seed " << seed << ", move " << move;
+					ASSERT_EQ(player.liberalsInPlay(), game.totalLiberalPolicies) << players << " players, seed " << seed << ", move " << move;
+				}
+				finished += game.getState() >= game.LIBERAL_POLICY_WIN;
+			}
+			EXPECT_EQ(finished, static_cast<int>(seeds)) << players << " players";
+		}
+	}
+
+	// a copied state is the whole game: with the same moves it ends where the game it came from does
+	TEST(GameState, CopiesPlayOutTheSame) {
+		for (int players = FIVE; players <= MAX_PLAYERS; players++) {
+			for (unsigned seed = 1; seed <= 50; seed++) {
+				TestCommunicationManager manager(players, seed);
+				auto &game = manager.game;
+				std::minstd_rand rng(seed);
+				for (int move = 0; move < 10 && game.getState() < game.LIBERAL_POLICY_WIN; move++) {
+					game.nominateChancellor(pick(game.getEligibleChancellors(), rng));
+					for (int i = 0; i < players && game.getState() == game.VOTING; i++) {
+						game.addVote(i, rng() % 2 ? JA : NEIN);
+					}
+				}
+				GameState copy;
+				std::memcpy(&copy, static_cast<GameState *>(&game), sizeof(GameState));
+				ASSERT_TRUE(copy.samePosition(game)) << players << " players, seed " << seed;
+
+				std::minstd_rand first(seed), second(seed);
+				playOut(game, first);
+				playOut(copy, second);
+				EXPECT_TRUE(copy.samePosition(game)) << players << " players, seed " << seed;
+				EXPECT_EQ(copy.getState(), game.getState()) << players << " players, seed " << seed;
+			}
+		}
+	}
+
+	TEST(GameLog, RecordsReadBackWhatWasTallied) {
+		gameLog::Tally tally;
+		for (int i = 0; i < 20; i++) {
+			gameLog::Tally::increment(tally.vetoesProposed);
+		}
+		gameLog::Tally::increment(tally.vetoesAccepted);
+		for (int i = 0; i < 300; i++) {
+			gameLog::Tally::increment(tally.trackerResets);
+		}
+		tally.failedElections = 7;
+		auto record = tally.finish(MAX_PLAYERS, GameState::FASCIST_HITLER_WIN - GameState::LIBERAL_POLICY_WIN, true, 4, 5,
+				1000);
+		EXPECT_EQ(record.players, MAX_PLAYERS);
+		EXPECT_EQ(record.ending(), GameState::FASCIST_HITLER_WIN - GameState::LIBERAL_POLICY_WIN);
+		EXPECT_TRUE(record.bots());
+		EXPECT_EQ(record.liberalPolicies(), 4);
+		EXPECT_EQ(record.fascistPolicies(), 5);
+		EXPECT_EQ(record.vetoesProposed(), 15);
+		EXPECT_EQ(record.vetoesAccepted(), 1);
+		EXPECT_EQ(record.trackerResets, 255);
+		EXPECT_EQ(record.failedElections, 7);
+		EXPECT_EQ(record.duration(), 1000U);
+		EXPECT_EQ(tally.finish(FIVE, 0, false, 5, 0, 1UL << 20).duration(), 65535U);
+	}
+
+	// finished games cost no write until the timer flushes them, or the buffer fills up
+	TEST(GameLog, WritesRecordsInBatches) {
+		static const std::string path = ::testing::TempDir() + "gameLogTest.bin";
+		unlink(path.c_str());
+		gameLog::configure(path.c_str());
+		auto size = [] {
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			return file ? static_cast<long>(file.tellg()) : -1L;
+		};
+		gameLog::Tally tally;
+		for (int i = 0; i < 3; i++) {
+			gameLog::append(tally.finish(FIVE, 0, false, 5, i, 60));
+		}
+		EXPECT_EQ(size(), -1);
+		gameLog::flush();
+		EXPECT_EQ(size(), 3 * 8);
+		gameLog::flush();
+		EXPECT_EQ(size(), 3 * 8);
+		for (size_t i = 0; i < gameLog::detail::pending.size(); i++) {
+			gameLog::append(tally.finish(FIVE, 0, false, 5, 0, 60));
+		}
+		EXPECT_EQ(size(), static_cast<long>(3 + gameLog::detail::pending.size()) * 8);
+
+		std::ifstream file(path, std::ios::binary);
+		gameLog::Record record;
+		file.seekg(2 * sizeof(record));
+		file.read(reinterpret_cast<char *>(&record), sizeof(record));
+		EXPECT_EQ(record.fascistPolicies(), 2);
+		gameLog::configure(nullptr);
+		close(gameLog::detail::fd);
+		gameLog::detail::fd = -1;
+		unlink(path.c_str());
+	}
+
+	TEST(MessageQueue, KeepsOrderAndGivesNodesBack) {
+		auto before = slab::local().stats(slab::classFor(sizeof(Message) + sizeof(void *)));
+		for (int round = 0; round < 3; round++) {
+			MessageQueue a, b;
+			for (int i = 0; i < 100; i++) {
+				auto &queue = i % 2 ? a : b;
+				queue.emplace_back().length = i;
+			}
+			EXPECT_EQ(a.size(), 50U);
+			for (int i = 1; i < 100; i += 2) {
+				ASSERT_EQ(a.front().length, i);
+				a.pop_front();
+			}
+			EXPECT_TRUE(a.empty());
+			EXPECT_EQ(b.front().length, 0);
+			EXPECT_EQ(b.back().length, 98);
+		}
+		// b gave its nodes back when it was destroyed, and only one empty slab is kept
+		auto after = slab::local().stats(slab::classFor(sizeof(Message) + sizeof(void *)));
+		EXPECT_EQ(after.live, before.live);
+		EXPECT_LE(after.slabs, before.slabs + 1);
+	}
+
+	TEST(Redeal, KeepsWhatTheSeatKnows) {
+		for (int players = FIVE; players <= MAX_PLAYERS; players++) {
+			for (unsigned seed = 1; seed <= 50; seed++) {
+				TestCommunicationManager manager(players, seed);
+				auto &game = manager.game;
+				PlayerMask known;
+				known[0] = true;
+				known[seed % players] = true;
+				auto copy = game;
+				std::minstd_rand rng(seed);
+				copy.redeal(0, known, rng);
+
+				auto before = game.getTeams();
+				auto after = copy.getTeams();
+				EXPECT_EQ(before.count(), after.count()) << players << " players, seed " << seed;
+				for (int i = 0; i < players; i++) {
+					if (known[i]) {
+						EXPECT_EQ(before[i], after[i]) << players << " players, seed " << seed;
+						EXPECT_EQ(game.getHitler() == i, copy.getHitler() == i) << players << " players, seed " << seed;
+					}
+				}
+				EXPECT_FALSE(copy.getTeams()[copy.getHitler()]);
+				EXPECT_EQ(copy.getDeckSize(), game.getDeckSize());
+				EXPECT_EQ(copy.getDeckLiberals(), game.getDeckLiberals());
+			}
+		}
+	}
+
+	// every move a bot can pick must be one the game takes, or the bot would wait forever
+	TEST(Bots, EveryLegalMoveIsAccepted) {
+		for (int players = FIVE; players <= MAX_PLAYERS; players++) {
+			for (unsigned seed = 1; seed <= 50; seed++) {
+				GameState game;
+				game.init(seed, players);
+				game.start();
+				std::minstd_rand rng(seed);
+				while (game.getState() < GameState::LIBERAL_POLICY_WIN) {
+					std::vector<std::pair<int, uint8_t>> options;
+					for (int seat = 0; seat < players; seat++) {
+						for (auto move : bots::legalMoves(game, seat)) {
+							auto next = game;
+							bots::applyMove(next, seat, move);
+							bool accepted = next.getState() != game.getState() || next.hasVoted(seat)
+									|| next.getPresidentId() != game.getPresidentId();
+							ASSERT_TRUE(accepted) << "move " << int(move) << " in state " << game.getState() << " ("
+									<< players << " players, seed " << seed << ")";
+							options.emplace_back(seat, move);
+						}
+					}
+					ASSERT_FALSE(options.empty()) << "no moves in state " << game.getState();
+					auto [seat, move] = options[rng() % options.size()];
+					bots::applyMove(game, seat, move);
+				}
+			}
+		}
+	}
+
+	// a ring that wraps keeps the newest SIZE messages, and hands them back oldest first once they are due
+	TEST(EventRing, WrapsAndDrainsInOrder) {
+		auto ring = std::make_unique<EventRing>();
+		constexpr unsigned extra = 44;
+		// the clock wraps too, partway through
+		uint32_t start = UINT32_MAX - 100;
+		for (unsigned i = 0; i < EventRing::SIZE + extra; i++) {
+			ring->push(start + i, fmt::format("m{}", i));
+		}
+		std::vector<std::string> drained;
+		auto collect = [&](std::string_view message) { drained.emplace_back(message); };
+		// nothing before the oldest message left is due
+		ring->drain(start + extra - 1, collect);
+		EXPECT_TRUE(drained.empty());
+		ring->drain(start + extra + 9, collect);
+		ASSERT_EQ(drained.size(), 10u);
+		EXPECT_EQ(drained.front(), fmt::format("m{}", extra));
+		EXPECT_FALSE(ring->empty());
+		ring->drain(start + EventRing::SIZE + extra, collect);
+		ASSERT_EQ(drained.size(), size_t(EventRing::SIZE));
+		for (unsigned i = 0; i < EventRing::SIZE; i++) {
+			EXPECT_EQ(drained[i], fmt::format("m{}", extra + i));
+		}
+		EXPECT_TRUE(ring->empty());
+
+		// longer messages are cut to what a slot holds
+		std::string longMessage(EventRing::MAX_MESSAGE_SIZE + 5, 'x');
+		ring->push(start, longMessage);
+		drained.clear();
+		ring->drain(start, collect);
+		ASSERT_EQ(drained.size(), 1u);
+		EXPECT_EQ(drained[0], longMessage.substr(0, EventRing::MAX_MESSAGE_SIZE));
+	}
+
+	// removal fills the hole with the last entry, whose manager must then find it at its new position
+	TEST(LobbyIndex, RemovalMovesTheLastEntryAndItsPosition) {
+		LobbyIndex lobbies;
+		std::vector<std::string> deltas;
+		lobbies.listenerContext = &deltas;
+		lobbies.onChange = [](void *context, std::string_view delta) {
+			static_cast<std::vector<std::string> *>(context)->emplace_back(delta);
+		};
+		int positions[5] = { -1, -1, -1, -1, -1 };
+		for (int i = 0; i < 5; i++) {
+			lobbies.upsert(&positions[i], 0x01020300 + i, i + 1, 0);
+			EXPECT_EQ(positions[i], i);
+		}
+		EXPECT_EQ(deltas[2], std::string("\x00\x01\x02\x03\x02\x03\x00\x00", 8));
+		lobbies.upsert(&positions[2], 0x01020302, 4, 0x0105);
+		EXPECT_EQ(lobbies.size(), 5u);
+		EXPECT_EQ(deltas.back(), std::string("\x00\x01\x02\x03\x02\x04\x01\x05", 8));
+
+		auto ids = [&] {
+			std::vector<uint32_t> listed;
+			lobbies.forEach(0, 10, [&](const LobbyIndex::Entry &e) { listed.push_back(e.gameId & 0xff); });
+			return listed;
+		};
+		lobbies.remove(&positions[1]);
+		EXPECT_EQ(positions[1], -1);
+		EXPECT_EQ(positions[4], 1);
+		EXPECT_EQ(ids(), (std::vector<uint32_t>{ 0, 4, 2, 3 }));
+		EXPECT_EQ(deltas.back(), std::string("\x01\x01\x02\x03\x01\x02\x00\x00", 8));
+
+		// the moved entry is still updated and removed through its manager's position
+		lobbies.upsert(&positions[4], 0x01020304, 9, 0);
+		EXPECT_EQ(lobbies.size(), 4u);
+		lobbies.remove(&positions[4]);
+		EXPECT_EQ(positions[3], 1);
+		EXPECT_EQ(ids(), (std::vector<uint32_t>{ 0, 3, 2 }));
+
+		// removing the last entry moves nothing, and removing twice does nothing
+		lobbies.remove(&positions[2]);
+		auto count = deltas.size();
+		lobbies.remove(&positions[2]);
+		EXPECT_EQ(deltas.size(), count);
+		EXPECT_EQ(ids(), (std::vector<uint32_t>{ 0, 3 }));
+		EXPECT_EQ(positions[0], 0);
+		EXPECT_EQ(positions[3], 1);
+
+		// a page is a slice
+		std::vector<uint32_t> page;
+		lobbies.forEach(1, 5, [&](const LobbyIndex::Entry &e) { page.push_back(e.gameId & 0xff); });
+		EXPECT_EQ(page, (std::vector<uint32_t>{ 3 }));
+	}
+
+	TEST(RateLimit, BucketsRefillUpToTheirBurst) {
+		RateLimit limit{ 2, 3 };
+		TokenBucket bucket;
+		for (int i = 0; i < 3; i++) {
+			EXPECT_TRUE(bucket.take(limit, 1000));
+		}
+		EXPECT_FALSE(bucket.take(limit, 1000));
+		// two a second is one every 500 ms
+		EXPECT_FALSE(bucket.take(limit, 1499));
+		EXPECT_TRUE(bucket.take(limit, 1500));
+		EXPECT_FALSE(bucket.take(limit, 1500));
+		// a long wait fills the bucket, and no further
+		for (int i = 0; i < 3; i++) {
+			EXPECT_TRUE(bucket.take(limit, 60000));
+		}
+		EXPECT_FALSE(bucket.take(limit, 60000));
+	}
+
+	// an address that finds its window full takes over the entry used longest ago, even with room elsewhere
+	TEST(RateLimit, TablesEvictTheLeastRecentlyUsedInTheWindow) {
+		constexpr unsigned capacityLog2 = 8;
+		constexpr uint64_t mask = (1U << capacityLog2) - 1;
+		std::vector<std::string> colliding;
+		for (int i = 0; colliding.size() <= RateLimitTable::MAX_PROBES; i++) {
+			auto address = fmt::format("10.0.{}.{}", i / 256, i % 256);
+			if ((RateLimitTable::hashAddress(address) & mask) == 1) {
+				colliding.push_back(address);
+			}
+		}
+		RateLimitTable table(capacityLog2);
+		// one token each, never refilled, so a fresh entry is the only way to get another
+		RateLimit once{ 0, 1 };
+		for (unsigned i = 0; i < RateLimitTable::MAX_PROBES; i++) {
+			EXPECT_TRUE(table.take(colliding[i], once, i));
+		}
+		// a refused take still counts as a use
+		EXPECT_FALSE(table.take(colliding[0], once, 100));
+		EXPECT_TRUE(table.take(colliding.back(), once, 101));
+		EXPECT_FALSE(table.take(colliding.back(), once, 102));
+		EXPECT_FALSE(table.take(colliding[0], once, 103));
+		EXPECT_TRUE(table.take(colliding[1], once, 104));
+		for (unsigned i = 3; i < RateLimitTable::MAX_PROBES; i++) {
+			EXPECT_FALSE(table.take(colliding[i], once, 105));
+		}
+	}
+
+	// a reader on another thread sees whole events in order, however far the writer laps it
+	TEST(Trace, SnapshotsHoldOnlyWholeEvents) {
+		auto ring = std::make_unique<trace::Ring>();
+		std::atomic<bool> done{false};
+		std::thread writer([&] {
+			for (uint32_t n = 0; n < 2000000; n++) {
+				ring->push({ n, n, static_cast<uint8_t>(n), static_cast<uint8_t>(n >> 8), static_cast<int8_t>(n >> 16) });
+			}
+			done = true;
+		});
+		// a torn event is one whose fields came from different pushes
+		size_t snapshots = 0, torn = 0, gaps = 0;
+		while (!done || snapshots == 0) {
+			auto events = ring->snapshot();
+			for (size_t i = 0; i < events.size(); i++) {
+				auto &e = events[i];
+				auto n = e.traceId;
+				torn += e.time != n || e.point != static_cast<uint8_t>(n) || e.code != static_cast<uint8_t>(n >> 8)
+						|| e.player != static_cast<int8_t>(n >> 16);
+				gaps += i > 0 && n != events[i - 1].traceId + 1;
+			}
+			snapshots++;
+		}
+		writer.join();
+		EXPECT_EQ(torn, 0u);
+		EXPECT_EQ(gaps, 0u);
+		EXPECT_EQ(ring->snapshot().back().traceId, 1999999u);
+	}
+
+	// as the server does on upgrade: user data constructed in the socket, pointing back at it
+	template <typename Socket>
+	void connect(Socket &socket, uint8_t version = 1) {
+		new (&socket.data) UserData<Socket>;
+		socket.data.socket = &socket;
+		socket.data.version = version;
+	}
+
+	// connects a socket and takes the next free seat of m with it
+	template <typename Socket>
+	void seat(Manager<Socket> &m, Socket &socket, uint8_t version = 1) {
+		connect(socket, version);
+		ASSERT_TRUE(m.join(&socket));
+	}
+
+	struct alignas(8) CorkedSocket {
+		UserData<CorkedSocket> data;
+		bool inCork = false;
+		int frames = 0;
+		int writes = 0;
+
+		void *getUserData() {
+			return &data;
+		}
+
+		bool send(std::string_view, uWS::OpCode, bool) {
+			frames++;
+			writes += !inCork;
+			return true;
+		}
+
+		template <typename F>
+		void cork(F &&f) {
+			inCork = true;
+			auto before = frames;
+			f();
+			inCork = false;
+			writes += frames > before;
+		}
+
+		void end(int) {
+		}
+	};
+
+	// a message can cause several frames to one player, and they should leave in one write
+	TEST(Manager, EachSocketGetsOneWritePerMessage) {
+		SlotMap<CorkedSocket> managers;
+		static CorkedSocket sockets[FIVE];
+		auto key = *managers.getSlot();
+		Manager<CorkedSocket> &m = managers[key].value();
+		for (auto &s : sockets) {
+			seat(m, s);
+		}
+		std::minstd_rand rng(1);
+		auto &game = m.getGame();
+		int multiFrame = 0;
+		for (int messages = 0; messages < 2000 && game.getState() < GameState::LIBERAL_POLICY_WIN; messages++) {
+			int before[FIVE];
+			for (int i = 0; i < FIVE; i++) {
+				sockets[i].writes = 0;
+				before[i] = sockets[i].frames;
+			}
+			uint8_t move = bots::move(bots::OTHER, 5);
+			int seat = messages % FIVE;
+			if (game.getState() != GameState::NOT_STARTED) {
+				std::vector<std::pair<int, uint8_t>> options;
+				for (int s = 0; s < FIVE; s++) {
+					for (auto legal : bots::legalMoves(game, s)) {
+						options.emplace_back(s, legal);
+					}
+				}
+				std::tie(seat, move) = options[rng() % options.size()];
+			}
+			char message = static_cast<char>(move);
+			m.handleMessage(seat, std::string_view(&message, 1));
+			for (int i = 0; i < FIVE; i++) {
+				EXPECT_LE(sockets[i].writes, 1);
+				EXPECT_TRUE(sockets[i].data.queue.empty());
+				multiFrame += sockets[i].frames - before[i] > 1;
+			}
+		}
+		EXPECT_GE(game.getState(), GameState::LIBERAL_POLICY_WIN);
+		EXPECT_GT(multiFrame, 0);
+		for (int i = 0; i < FIVE; i++) {
+			sockets[i].data.~UserData();
+			m.onDisconnect(i, 1000);
+		}
+	}
+
+	struct alignas(8) RecordingSocket {
+		UserData<RecordingSocket> data;
+		std::vector<std::string> frames;
+		int closedWith = 0;
+
+		void *getUserData() {
+			return &data;
+		}
+
+		bool send(std::string_view message, uWS::OpCode, bool) {
+			frames.emplace_back(message);
+			return true;
+		}
+
+		template <typename F>
+		void cork(F &&f) {
+			f();
+		}
+
+		void end(int code) {
+			closedWith = code;
+		}
+	};
+
+	using Events = std::vector<std::pair<int, std::string>>;
+
+	// every frame each seat is sent over a game with names, a game key and random legal moves; returns Hitler
+	int playRecorded(RecordingSocket *sockets, int players, uint8_t version, unsigned seed) {
+		Manager<RecordingSocket> m;
+		m.setDeleter([](void *, uint32_t) {}, nullptr);
+		for (int i = 0; i < players; i++) {
+			seat(m, sockets[i], version);
+			char name[] = { static_cast<char>(bots::SET_NAME), 'P', static_cast<char>('a' + i) };
+			m.handleMessage(i, std::string_view(name, sizeof(name)));
+		}
+		m.sendGameKey(0, 0x12345678);
+		m.startMatchedGame(seed);
+		std::minstd_rand rng(seed);
+		auto &game = m.getGame();
+		while (game.getState() < GameState::LIBERAL_POLICY_WIN) {
+			std::vector<std::pair<int, uint8_t>> options;
+			for (int seat = 0; seat < players; seat++) {
+				for (auto move : bots::legalMoves(game, seat)) {
+					options.emplace_back(seat, move);
+				}
+			}
+			auto [seat, move] = options[rng() % options.size()];
+			char message = static_cast<char>(move);
+			m.handleMessage(seat, std::string_view(&message, 1));
+		}
+		for (int i = 0; i < players; i++) {
+			sockets[i].data.~UserData();
+		}
+		return game.getHitler();
+	}
+
+	// version 2 is version 1 in other words, so both decode to the same events
+	TEST(ProtocolV2, CarriesWhatV1Does) {
+		static RecordingSocket v1[MAX_PLAYERS], v2[MAX_PLAYERS];
+		for (int players = FIVE; players <= MAX_PLAYERS; players++) {
+			for (unsigned seed = 1; seed <= 10; seed++) {
+				for (int i = 0; i < players; i++) {
+					v1[i].frames.clear();
+					v2[i].frames.clear();
+				}
+				playRecorded(v1, players, 1, seed);
+				playRecorded(v2, players, protocolV2::VERSION, seed);
+				for (int i = 0; i < players; i++) {
+					Events expected, actual;
+					auto collect = [](Events &events) {
+						return [&events](protocolV2::Event e, std::string_view payload) {
+							events.emplace_back(e, payload);
+						};
+					};
+					for (size_t f = 0; f < v1[i].frames.size(); f++) {
+						ASSERT_TRUE(protocolV2::fromV1(v1[i].frames[f], f == 0, collect(expected)));
+					}
+					for (auto &frame : v2[i].frames) {
+						ASSERT_TRUE(protocolV2::decode(frame, collect(actual)));
+					}
+					ASSERT_EQ(expected, actual) << players << " players, seed " << seed << ", seat " << i;
+					EXPECT_LT(v2[i].frames.size(), v1[i].frames.size());
+				}
+			}
+		}
+	}
+
+	TEST(ProtocolV2, FascistsAreToldHitlersSeat) {
+		static RecordingSocket sockets[MAX_PLAYERS];
+		for (int players = FIVE; players <= MAX_PLAYERS; players++) {
+			for (auto &s : sockets) {
+				s.frames.clear();
+			}
+			int hitler = playRecorded(sockets, players, protocolV2::VERSION, players);
+			int fascists = 0;
+			for (int i = 0; i < players; i++) {
+				for (auto &frame : sockets[i].frames) {
+					protocolV2::decode(frame, [&](protocolV2::Event e, std::string_view payload) {
+						if (e == protocolV2::TEAM && payload[0] == protocolV2::FASCIST_ROLE) {
+							fascists++;
+							EXPECT_EQ(payload[1], hitler);
+						}
+					});
+				}
+			}
+			EXPECT_GT(fascists, 0);
+		}
+	}
+
+	TEST(ProtocolV2, VersionComesFromTheQuery) {
+		EXPECT_EQ(protocolV2::requested(""), 1);
+		EXPECT_EQ(protocolV2::requested("v=1"), 1);
+		EXPECT_EQ(protocolV2::requested("v=2"), 2);
+		EXPECT_EQ(protocolV2::requested("name=x&v=2"), 2);
+		EXPECT_EQ(protocolV2::requested("dev=2"), 1);
+		EXPECT_EQ(protocolV2::requested("v=3"), 0);
+	}
+
+	TEST(Protocol, MasksPastTenSeatsAreWide) {
+		unsigned char message[3] = { Protocol::TEAM, 0, 0 };
+		// seats 0 and 9, which both layouts can hold
+		int length = Protocol::writeMask(message, 1 << 9 | 1);
+		if constexpr (Protocol::WIDE_MASKS) {
+			ASSERT_EQ(length, 3);
+			EXPECT_EQ(message[0], Protocol::TEAM);
+			EXPECT_EQ(message[1], 0x02);
+			EXPECT_EQ(message[2], 0x01);
+			// seats 10 and 15, past what the packed layout can hold
+			length = Protocol::writeMask(message, 1 << 15 | 1 << 10);
+			ASSERT_EQ(length, 3);
+			EXPECT_EQ(message[1], 0x84);
+			EXPECT_EQ(message[2], 0x00);
+		} else {
+			ASSERT_EQ(length, 2);
+			EXPECT_EQ(message[0], Protocol::TEAM | 1 << 6);
+			EXPECT_EQ(message[1], 0x80);
+		}
+	}
+
+	// every seat is told its role, and fascists get a mask of the liberals on either side of 10 seats
+	TEST(Manager, DealsRolesAtEveryTableSize) {
+		constexpr int fascists[] = { 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7 };
+		static RecordingSocket sockets[MAX_PLAYERS];
+		for (int players : { TEN, ELEVEN, SIXTEEN }) {
+			if (players > MAX_PLAYERS) {
+				continue;
+			}
+			for (auto &s : sockets) {
+				s.frames.clear();
+			}
+			int hitler = playRecorded(sockets, players, 1, players);
+			unsigned long liberals = 0;
+			std::vector<std::string> teamMessages;
+			for (int i = 0; i < players; i++) {
+				// the first frame is the roster, which has a layout of its own
+				auto team = std::find_if(sockets[i].frames.begin() + 1, sockets[i].frames.end(), [](auto &frame) {
+					return (frame[0] & 15) == Protocol::TEAM;
+				});
+				ASSERT_NE(team, sockets[i].frames.end()) << players << " players, seat " << i;
+				if (*team == std::string(1, Protocol::TEAM)) {
+					liberals |= 1UL << i;
+				} else if (team->size() == 1) {
+					EXPECT_EQ(i, hitler);
+					EXPECT_EQ(static_cast<unsigned char>((*team)[0]), Protocol::TEAM | 15 << 4);
+				} else {
+					teamMessages.push_back(*team);
+				}
+			}
+			int fascistCount = players - __builtin_popcountl(liberals);
+			EXPECT_EQ(fascistCount, fascists[players - FIVE]) << players << " players";
+			ASSERT_EQ(static_cast<int>(teamMessages.size()), fascistCount - 1) << players << " players";
+			int fascistsBeforeHitler = 0;
+			for (int i = 0; i < hitler; i++) {
+				fascistsBeforeHitler += !(liberals >> i & 1);
+			}
+			for (auto &message : teamMessages) {
+				auto *m = reinterpret_cast<const unsigned char *>(message.data());
+				unsigned long mask;
+				if constexpr (Protocol::WIDE_MASKS) {
+					ASSERT_EQ(message.size(), 3u);
+					mask = m[1] << 8 | m[2];
+					EXPECT_EQ(m[0] >> 4, fascistsBeforeHitler);
+				} else {
+					ASSERT_EQ(message.size(), 2u);
+					mask = (m[0] >> 6 & 3) | m[1] << 2;
+					EXPECT_EQ(m[0] >> 4 & 3, fascistsBeforeHitler);
+				}
+				EXPECT_EQ(mask, liberals) << players << " players";
+			}
+		}
+	}
+
+	struct NullSocket {
+		void *getUserData() {
+			return nullptr;
+		}
+
+		bool send(std::string_view, uWS::OpCode, bool) {
+			return true;
+		}
+
+		void end(int) {
+		}
+	};
+
+	// names are stored inline, so a longer one is refused outright rather than cut short
+	TEST(Manager, NamesTooLongToStoreCloseTheSeat) {
+		static RecordingSocket sockets[3];
+		Manager<RecordingSocket> m;
+		bool destroyed = false;
+		m.setDeleter([](void *context, uint32_t) { *static_cast<bool *>(context) = true; }, &destroyed);
+		for (auto &s : sockets) {
+			seat(m, s);
+		}
+		std::string name(1 + Client<RecordingSocket>::MAX_NAME_SIZE, 'x');
+		name[0] = static_cast<char>(bots::SET_NAME);
+		m.handleMessage(0, name);
+		EXPECT_EQ(sockets[0].closedWith, 0);
+		ASSERT_EQ(sockets[1].frames.back(), std::string(1, static_cast<char>(Protocol::NAME)) + name.substr(1));
+
+		sockets[1].frames.clear();
+		m.handleMessage(1, name + "x");
+		EXPECT_EQ(sockets[1].closedWith, Manager<RecordingSocket>::NAME_TOO_LONG);
+		EXPECT_EQ(m.getClientCount(), 2);
+		EXPECT_TRUE(sockets[1].frames.empty());
+		EXPECT_EQ(sockets[2].frames.back(), std::string(1, static_cast<char>(Protocol::DISCONNECT | 1 << 4)));
+		// the close handler still runs, and changes nothing
+		m.onDisconnect(1, Manager<RecordingSocket>::NAME_TOO_LONG);
+		EXPECT_EQ(m.getClientCount(), 2);
+
+		m.handleMessage(0, name + "x");
+		m.handleMessage(2, name + "x");
+		EXPECT_TRUE(destroyed);
+		for (auto &s : sockets) {
+			s.data.~UserData();
+		}
+	}
+
+	class MatchmakerTest : public ::testing::Test {
+	protected:
+		static constexpr int SOCKETS = 20;
+		static inline RecordingSocket sockets[SOCKETS];
+		int next = 0;
+		SlotMap<RecordingSocket> managers;
+
+		void enqueue(Matchmaker<RecordingSocket> &matchmaker, int count, uint32_t now) {
+			for (int i = 0; i < count; i++, next++) {
+				connect(sockets[next]);
+				matchmaker.enqueue(&sockets[next], now);
+			}
+		}
+
+		Manager<RecordingSocket> *gameOf(int socket) {
+			return sockets[socket].data.manager;
+		}
+
+		void TearDown() override {
+			std::vector<Manager<RecordingSocket> *> games;
+			for (int i = 0; i < next; i++) {
+				if (gameOf(i) && std::find(games.begin(), games.end(), gameOf(i)) == games.end()) {
+					games.push_back(gameOf(i));
+				}
+			}
+			for (auto *m : games) {
+				m->destroyGame();
+			}
+			for (int i = 0; i < next; i++) {
+				sockets[i].data.~UserData();
+			}
+		}
+	};
+
+	TEST_F(MatchmakerTest, FullTablesStartAtOnceAndShortOnesAfterTheWait) {
+		Matchmaker<RecordingSocket> matchmaker(1000);
+		enqueue(matchmaker, 12, 0);
+		matchmaker.tick(managers, 0);
+		ASSERT_NE(gameOf(0), nullptr);
+		EXPECT_EQ(gameOf(0)->getClientCount(), 10);
+		EXPECT_NE(gameOf(0)->getState(), GameState::NOT_STARTED);
+		EXPECT_EQ(matchmaker.waiting(), 2u);
+
+		enqueue(matchmaker, 3, 500);
+		matchmaker.tick(managers, 999);
+		EXPECT_EQ(matchmaker.waiting(), 5u);
+		EXPECT_EQ(gameOf(10), nullptr);
+		matchmaker.tick(managers, 1000);
+		EXPECT_EQ(matchmaker.waiting(), 0u);
+		ASSERT_NE(gameOf(10), nullptr);
+		EXPECT_EQ(gameOf(14), gameOf(10));
+		EXPECT_EQ(gameOf(10)->getClientCount(), 5);
+	}
+
+	// bots only make up a table short of five, even when they would come before the wait is over
+	TEST_F(MatchmakerTest, BotsOnlyFillTablesShortOfFive) {
+		BotPool<RecordingSocket> bots(1, 8);
+		Matchmaker<RecordingSocket> matchmaker(10000, {}, &bots, 1000);
+		enqueue(matchmaker, 6, 0);
+		matchmaker.tick(managers, 5000);
+		EXPECT_EQ(matchmaker.waiting(), 6u);
+		matchmaker.tick(managers, 10000);
+		ASSERT_NE(gameOf(0), nullptr);
+		EXPECT_EQ(gameOf(0)->getClientCount(), 6);
+
+		enqueue(matchmaker, 2, 20000);
+		matchmaker.tick(managers, 20999);
+		EXPECT_EQ(matchmaker.waiting(), 2u);
+		matchmaker.tick(managers, 21000);
+		ASSERT_NE(gameOf(6), nullptr);
+		EXPECT_EQ(gameOf(6)->getClientCount(), 5);
+		EXPECT_NE(gameOf(6)->getState(), GameState::NOT_STARTED);
+	}
+
+	// with no room for a game, players keep their place until there is
+	TEST_F(MatchmakerTest, WaitsForRoomUnderTheGameCeiling) {
+		AdmissionLimits limits;
+		limits.maxGames = 1;
+		Matchmaker<RecordingSocket> matchmaker(0, limits);
+		enqueue(matchmaker, 15, 0);
+		matchmaker.tick(managers, 0);
+		EXPECT_EQ(managers.size(), 1u);
+		EXPECT_EQ(matchmaker.waiting(), 5u);
+		EXPECT_EQ(gameOf(10), nullptr);
+
+		gameOf(0)->destroyGame();
+		for (int i = 0; i < 10; i++) {
+			sockets[i].data.manager = nullptr;
+		}
+		matchmaker.tick(managers, 0);
+		EXPECT_EQ(matchmaker.waiting(), 0u);
+		ASSERT_NE(gameOf(10), nullptr);
+		EXPECT_EQ(gameOf(10)->getClientCount(), 5);
+	}
+
+	// a draining server sends everyone who hasn't started playing off to create their game again
+	TEST_F(MatchmakerTest, DrainingClosesLobbiesAndTheQueue) {
+		for (auto &s : sockets) {
+			s.closedWith = 0;
+		}
+		Matchmaker<RecordingSocket> matchmaker(1000);
+		enqueue(matchmaker, 12, 0);
+		matchmaker.tick(managers, 0);
+		Manager<RecordingSocket> &lobby = managers[*managers.getSlot()].value();
+		for (; next < 14; next++) {
+			seat(lobby, sockets[next]);
+		}
+		ASSERT_EQ(managers.size(), 2u);
+
+		managers.forEach([](Manager<RecordingSocket> &m) {
+			m.closeLobby(drain::LOBBY_CLOSED);
+		});
+		matchmaker.closeAll(drain::LOBBY_CLOSED);
+		EXPECT_EQ(managers.size(), 1u);
+		EXPECT_EQ(matchmaker.waiting(), 0u);
+		EXPECT_EQ(gameOf(0)->getClientCount(), 10);
+		for (int i = 0; i < 10; i++) {
+			EXPECT_EQ(sockets[i].closedWith, 0) << i;
+		}
+		for (int i = 10; i < 14; i++) {
+			EXPECT_EQ(sockets[i].closedWith, drain::LOBBY_CLOSED) << i;
+		}
+		// the lobby is gone, so there is nothing left for TearDown to destroy
+		sockets[12].data.manager = sockets[13].data.manager = nullptr;
+	}
+
+	// any worker can tell from a key which one holds the game, and only that one finds it
+	TEST(SlotMap, KeysNameTheProcessThatHoldsThem) {
+		constexpr unsigned count = 3;
+		SlotMap<NullSocket> mine(2, count);
+		SlotMap<NullSocket> other(0, count);
+		for (int i = 0; i < 3; i++) {
+			auto key = *mine.getSlot();
+			EXPECT_EQ(processes::ownerOf(key.gameId(), count), 2u);
+			EXPECT_TRUE(mine[key]);
+			EXPECT_FALSE(other[key]);
+		}
+		EXPECT_EQ(processes::ownerOf(other.getSlot()->gameId(), count), 0u);
+	}
+
+	// a process whose next set would need a major index past 255 is full, rather than wrapping onto another's
+	TEST(SlotMap, RunsOutOfKeysInsteadOfWrapping) {
+		constexpr unsigned count = 200;
+		constexpr size_t capacity = SlotMap<NullSocket>::capacity(count);
+		EXPECT_EQ(capacity, 65536u);
+		// the most shards there can be still leaves each a full set, and one shard has every major index
+		EXPECT_EQ(SlotMap<NullSocket>::capacity(processes::MAX), 65536u);
+		EXPECT_EQ(SlotMap<NullSocket>::capacity(1), 256u * 65536u);
+		SlotMap<NullSocket> managers(100, count);
+		uint32_t first = 0;
+		for (size_t i = 0; i < capacity; i++) {
+			auto key = managers.getSlot();
+			ASSERT_TRUE(key);
+			ASSERT_EQ(processes::ownerOf(key->gameId(), count), 100u);
+			if (i == 0) {
+				first = key->gameId();
+			}
+		}
+		EXPECT_FALSE(managers.getSlot());
+		EXPECT_EQ(managers.size(), capacity);
+
+		// a game that ends gives its slot back, under a key the old one doesn't match
+		managers[SlotMap<NullSocket>::Key(first)].value().get().destroyGame();
+		auto key = managers.getSlot();
+		ASSERT_TRUE(key);
+		EXPECT_NE(key->gameId(), first);
+		EXPECT_FALSE(managers[SlotMap<NullSocket>::Key(first)]);
+		EXPECT_TRUE(managers[*key]);
+		EXPECT_FALSE(managers.getSlot());
+	}
+
+	// the coordinator finds a game's node from the key alone, and the node then finds the worker
+	TEST(Cluster, KeysNameTheirNodeAndWorker) {
+		processes::Worker worker{ 1, 2, 2, 3 };
+		SlotMap<NullSocket> managers(worker.shard(), worker.shards());
+		auto id = managers.getSlot()->gameId();
+		EXPECT_EQ(processes::nodeOf(id, worker.nodes), 2u);
+		EXPECT_EQ(processes::ownerOf(id, worker.shards()) / worker.nodes, 1u);
+	}
+
+	TEST(Cluster, NewGamesGoWhereThereAreFewest) {
+		EXPECT_EQ(cluster::liveGames("# TYPE x\nsh_games_created_total 30\nsh_games_destroyed_total 18\n"), 12);
+		EXPECT_FALSE(cluster::liveGames("sh_games_created_total 30\n"));
+		auto nodes = cluster::parseNodes("a:1,b.example:4545");
+		ASSERT_EQ(nodes.size(), 2u);
+		EXPECT_EQ(nodes[1].address(), "b.example:4545");
+
+		cluster::Balancer balancer(3);
+		balancer.report(0, 10);
+		balancer.report(1, 12);
+		balancer.report(2, std::nullopt);
+		// games sent since the last report count, so the first node fills up to the second
+		std::vector<size_t> picks;
+		for (int i = 0; i < 4; i++) {
+			picks.push_back(balancer.pick().value());
+		}
+		EXPECT_EQ(picks, (std::vector<size_t>{ 0, 0, 0, 1 }));
+		// a report replaces what was sent
+		balancer.report(0, 10);
+		EXPECT_EQ(balancer.pick(), 0u);
+		EXPECT_EQ(balancer.first(), 0u);
+		balancer.report(0, std::nullopt);
+		balancer.report(1, std::nullopt);
+		EXPECT_FALSE(balancer.pick());
+	}
+
+	// the shared port reaches one worker, which names the others' ports, so every worker's games count
+	TEST(Cluster, NodesCountTheGamesOfEveryWorker) {
+		// two listening sockets on neighbouring ports, as a node's first two workers have
+		int listeners[2] = { -1, -1 };
+		int firstPort = 0;
+		for (int port = 40000; port < 40100 && listeners[1] < 0; port += 2) {
+			for (int i = 0; i < 2; i++) {
+				sockaddr_in address = {};
+				address.sin_family = AF_INET;
+				address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+				address.sin_port = htons(port + i);
+				listeners[i] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+				if (bind(listeners[i], reinterpret_cast<sockaddr *>(&address), sizeof(address)) || listen(listeners[i], 1)) {
+					close(listeners[0]);
+					close(listeners[1]);
+					listeners[0] = listeners[1] = -1;
+					break;
+				}
+			}
+			firstPort = port;
+		}
+		ASSERT_GE(listeners[1], 0);
+		std::thread workers([&listeners] {
+			for (int i = 0; i < 2; i++) {
+				auto body = fmt::format("sh_games_created_total {}\nsh_games_destroyed_total 1\n", 5 + 10 * i);
+				auto response = fmt::format("HTTP/1.1 200 OK\r\nContent-Length: {}\r\n\r\n{}", body.size(), body);
+				int fd = accept(listeners[i], nullptr, nullptr);
+				char request[512];
+				[[maybe_unused]] auto n = read(fd, request, sizeof(request));
+				n = write(fd, response.data(), response.size());
+				close(fd);
+				close(listeners[i]);
+			}
+		});
+		auto shared = fmt::format("sh_games_created_total 5\nsh_games_destroyed_total 1\nsh_workers 2\n"
+				"sh_first_worker_port {}\n", firstPort);
+		EXPECT_EQ(cluster::nodeGames({ "127.0.0.1", 0 }, shared, 1000), 4 + 14);
+		workers.join();
+		// a worker that doesn't answer counts as empty, and a node with none is down
+		EXPECT_FALSE(cluster::nodeGames({ "127.0.0.1", 0 }, shared, 100));
+		EXPECT_EQ(cluster::nodeGames({ "127.0.0.1", 0 }, "sh_games_created_total 5\nsh_games_destroyed_total 1\nsh_workers 1\n", 100), 4);
 	}
 }
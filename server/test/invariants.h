@@ -0,0 +1,98 @@
+#ifndef SERVER_TEST_INVARIANTS_H
+#define SERVER_TEST_INVARIANTS_H
+#include "../game.h"
+
+/** Rules that must hold between any two transitions of a game, shared by the unit tests and the fuzzer
+ *
+ * Returns a description of the first rule that is broken, or nullptr if they all hold.
+ * The deck is checked against what is left after enacted policies and the cards in hand; the tests also
+ * track discards to check that no card is ever created or lost.
+ */
+template <typename Game>
+const char *brokenInvariant(Game &game, int playerCount) {
+	auto state = game.getState();
+	if (state == Game::NOT_STARTED) {
+		return nullptr;
+	}
+	if (state > Game::FASCIST_HITLER_WIN) {
+		return "state out of range";
+	}
+
+	int liberals = game.getLiberalPolicies();
+	int fascists = game.getFascistPolicies();
+	if (liberals < 0 || liberals > 5 || fascists < 0 || fascists > 6) {
+		return "policy count out of range";
+	}
+	if ((liberals == 5) != (state == Game::LIBERAL_POLICY_WIN)) {
+		return "five liberal policies and a liberal policy win must go together";
+	}
+	if ((fascists == 6) != (state == Game::FASCIST_POLICY_WIN)) {
+		return "six fascist policies and a fascist policy win must go together";
+	}
+
+	int hand = 0;
+	int handLiberals = 0;
+	switch (state) {
+		case Game::AWAITING_PRESIDENT_POLICY:
+			hand = 3;
+			handLiberals = game.getFirstPolicy() + game.getSecondPolicy() + game.getThirdPolicy();
+			break;
+		case Game::AWAITING_CHANCELLOR_POLICY:
+		case Game::AWAITING_CHANCELLOR_POLICY_NO_VETO:
+		case Game::AWAITING_VETO:
+			hand = 2;
+			handLiberals = game.getFirstPolicy() + game.getSecondPolicy();
+			break;
+		default:
+			break;
+	}
+	int deck = game.getDeckSize();
+	int deckLiberals = game.getDeckLiberals();
+	if (deckLiberals < 0 || deckLiberals > deck) {
+		return "deck composition out of range";
+	}
+	if (deckLiberals + handLiberals > Game::totalLiberalPolicies - liberals) {
+		return "more liberal policies in play than remain";
+	}
+	if (deck - deckLiberals + hand - handLiberals > Game::totalFascistPolicies - fascists) {
+		return "more fascist policies in play than remain";
+	}
+
+	auto alive = game.alive();
+	int hitler = game.getHitler();
+	if (hitler < 0 || hitler >= playerCount) {
+		return "hitler out of range";
+	}
+	if (!alive[hitler] && state != Game::LIBERAL_HITLER_WIN) {
+		return "hitler is dead but liberals have not won";
+	}
+	if (static_cast<int>(alive.count()) < playerCount - 2) {
+		return "more than two players were killed";
+	}
+	if (state >= Game::LIBERAL_POLICY_WIN) {
+		return nullptr;
+	}
+
+	// a chaotic policy can end the game before the tracker is reset
+	if (game.getElectionTracker() < 0 || game.getElectionTracker() > 2) {
+		return "election tracker out of range";
+	}
+
+	// there is one president, and they are a living player
+	int president = game.getPresidentId();
+	if (president < 0 || president >= playerCount || !alive[president]) {
+		return "president is not a living player";
+	}
+	if (state == Game::AWAITING_CHANCELLOR_NOMINATION && deck < 3) {
+		return "too few policies in the deck for the next legislative session";
+	}
+	if (state == Game::VOTING || hand) {
+		int chancellor = game.getChancellorId();
+		if (chancellor < 0 || chancellor >= playerCount || !alive[chancellor] || chancellor == president) {
+			return "chancellor is not a living player other than the president";
+		}
+	}
+	return nullptr;
+}
+
+#endif //SERVER_TEST_INVARIANTS_H
@@ -0,0 +1,57 @@
+#ifndef SERVER_TLS_H
+#define SERVER_TLS_H
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <fmt/core.h>
+#include <openssl/ssl.h>
+
+/** TLS settings, read from the environment at startup
+ *
+ * TLS is enabled when both SSL_KEY and SSL_CERT are set.
+ * SSL_PASSPHRASE: passphrase of the key file
+ * SSL_TICKET_KEY: a file holding 80 bytes of session ticket key material. Without it, each process
+ *         makes its own keys, and tickets stop working across a restart.
+ */
+struct TlsConfig {
+	const char *keyFile;
+	const char *certFile;
+	const char *passphrase;
+	const char *ticketKeyFile;
+
+	static std::optional<TlsConfig> fromEnvironment() {
+		const char *key = getenv("SSL_KEY");
+		const char *cert = getenv("SSL_CERT");
+		if (!(key && cert)) {
+			return {};
+		}
+		return TlsConfig{ key, cert, getenv("SSL_PASSPHRASE"), getenv("SSL_TICKET_KEY") };
+	}
+};
+
+/** Enables session resumption, so reconnecting phones skip the full handshake
+ *
+ * Both mechanisms are turned on: a server-side session cache for clients that resume by id, and session
+ * tickets for clients that resume statelessly.
+ */
+inline bool configureTls(SSL_CTX *ctx, const TlsConfig &config) {
+	static const unsigned char sessionContext[] = "secret-hitler";
+	SSL_CTX_set_session_id_context(ctx, sessionContext, sizeof(sessionContext) - 1);
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_sess_set_cache_size(ctx, 1 << 16);
+	SSL_CTX_set_timeout(ctx, 24 * 60 * 60);
+	SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+
+	if (config.ticketKeyFile) {
+		unsigned char keys[80];
+		std::ifstream file(config.ticketKeyFile, std::ios::binary);
+		if (!file.read(reinterpret_cast<char *>(keys), sizeof(keys))) {
+			fmt::print("Couldn't read {} bytes of ticket keys from {}\n", sizeof(keys), config.ticketKeyFile);
+			return false;
+		}
+		SSL_CTX_set_tlsext_ticket_keys(ctx, keys, sizeof(keys));
+	}
+	return true;
+}
+
+#endif //SERVER_TLS_H
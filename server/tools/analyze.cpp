@@ -0,0 +1,263 @@
+/** Summarizes game logs written with SH_GAME_LOG, as CSV with a row per player count
+ *
+ * usage: analyze [-j threads] file...
+ *
+ * Files are memory-mapped and cut into blocks, which threads take in turn. A block is decoded into one
+ * array per field before anything is added up, so each sum is a short loop over one column rather than
+ * a walk over whole records. Every thread keeps its own totals, and they are only added together at the
+ * end, so threads never share a cache line while they work.
+ *
+ * The summary goes to stdout and the timing to stderr, so the CSV can be redirected on its own.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fmt/core.h>
+#include "../gameLog.h"
+#include "../gameState.h"
+
+namespace {
+	using gameLog::Record;
+
+	// records per block: 32 KiB of log, and columns that stay in L1 and L2 while they are summed
+	constexpr size_t BLOCK = 4096;
+	// every player count a record can hold; 0 collects records that don't name a valid one
+	constexpr int COUNTS = 17;
+
+	struct alignas(64) Totals {
+		uint64_t games[COUNTS]{};
+		uint64_t endings[COUNTS][4]{};
+		uint64_t botGames[COUNTS]{};
+		uint64_t vetoGames[COUNTS]{};
+		uint64_t vetoesProposed[COUNTS]{};
+		uint64_t vetoesAccepted[COUNTS]{};
+		uint64_t trackerResets[COUNTS]{};
+		uint64_t failedElections[COUNTS]{};
+		uint64_t seconds[COUNTS]{};
+
+		void add(const Totals &o) {
+			for (int p = 0; p < COUNTS; p++) {
+				games[p] += o.games[p];
+				for (int e = 0; e < 4; e++) {
+					endings[p][e] += o.endings[p][e];
+				}
+				botGames[p] += o.botGames[p];
+				vetoGames[p] += o.vetoGames[p];
+				vetoesProposed[p] += o.vetoesProposed[p];
+				vetoesAccepted[p] += o.vetoesAccepted[p];
+				trackerResets[p] += o.trackerResets[p];
+				failedElections[p] += o.failedElections[p];
+				seconds[p] += o.seconds[p];
+			}
+		}
+	};
+
+	struct Columns {
+		uint8_t players[BLOCK];
+		uint8_t ending[BLOCK];
+		uint8_t bots[BLOCK];
+		uint8_t vetoesProposed[BLOCK];
+		uint8_t vetoesAccepted[BLOCK];
+		uint8_t trackerResets[BLOCK];
+		uint8_t failedElections[BLOCK];
+		uint16_t seconds[BLOCK];
+
+		void decode(const Record *records, size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				auto &r = records[i];
+				bool valid = r.players >= FIVE && r.players < COUNTS;
+				players[i] = valid ? r.players : 0;
+				ending[i] = r.ending();
+				bots[i] = r.bots();
+				vetoesProposed[i] = r.vetoesProposed();
+				vetoesAccepted[i] = r.vetoesAccepted();
+				trackerResets[i] = r.trackerResets;
+				failedElections[i] = r.failedElections;
+				seconds[i] = r.duration();
+			}
+		}
+
+		void sum(size_t n, Totals &t) const {
+			for (size_t i = 0; i < n; i++) {
+				t.games[players[i]]++;
+			}
+			for (size_t i = 0; i < n; i++) {
+				t.endings[players[i]][ending[i]]++;
+			}
+			for (size_t i = 0; i < n; i++) {
+				t.botGames[players[i]] += bots[i];
+			}
+			for (size_t i = 0; i < n; i++) {
+				t.vetoGames[players[i]] += vetoesProposed[i] != 0;
+				t.vetoesProposed[players[i]] += vetoesProposed[i];
+				t.vetoesAccepted[players[i]] += vetoesAccepted[i];
+			}
+			for (size_t i = 0; i < n; i++) {
+				t.trackerResets[players[i]] += trackerResets[i];
+			}
+			for (size_t i = 0; i < n; i++) {
+				t.failedElections[players[i]] += failedElections[i];
+			}
+			for (size_t i = 0; i < n; i++) {
+				t.seconds[players[i]] += seconds[i];
+			}
+		}
+	};
+
+	struct Block {
+		const Record *records;
+		size_t count;
+	};
+
+	struct Mapping {
+		void *data = MAP_FAILED;
+		size_t size = 0;
+	};
+
+	// maps a whole log, and reports why if it can't; a trailing partial record is left out
+	bool map(const char *path, Mapping &m, std::vector<Block> &blocks) {
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			fmt::print(stderr, "{}: {}\n", path, std::strerror(errno));
+			return false;
+		}
+		struct stat st{};
+		if (fstat(fd, &st) < 0) {
+			fmt::print(stderr, "{}: {}\n", path, std::strerror(errno));
+			close(fd);
+			return false;
+		}
+		m.size = st.st_size;
+		if (m.size < sizeof(Record)) {
+			close(fd);
+			return true;
+		}
+		m.data = mmap(nullptr, m.size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (m.data == MAP_FAILED) {
+			fmt::print(stderr, "{}: {}\n", path, std::strerror(errno));
+			return false;
+		}
+		madvise(m.data, m.size, MADV_SEQUENTIAL);
+		madvise(m.data, m.size, MADV_WILLNEED);
+		auto *records = static_cast<const Record *>(m.data);
+		size_t count = m.size / sizeof(Record);
+		for (size_t i = 0; i < count; i += BLOCK) {
+			blocks.push_back({ records + i, std::min(BLOCK, count - i) });
+		}
+		return true;
+	}
+
+	double ratio(uint64_t a, uint64_t b) {
+		return b ? double(a) / b : 0;
+	}
+
+	void printRow(const char *label, const Totals &t, int p) {
+		auto games = t.games[p];
+		auto &e = t.endings[p];
+		auto fascistWins = e[GameState::FASCIST_POLICY_WIN - GameState::LIBERAL_POLICY_WIN]
+				+ e[GameState::FASCIST_HITLER_WIN - GameState::LIBERAL_POLICY_WIN];
+		fmt::print("{},{},{},{},{},{},{:.4f},{},{:.4f},{},{},{:.3f},{:.3f},{:.2f},{}\n", label, games, e[0], e[1],
+				e[2], e[3], ratio(fascistWins, games), t.vetoGames[p], ratio(t.vetoGames[p], games),
+				t.vetoesProposed[p], t.vetoesAccepted[p], ratio(t.trackerResets[p], games),
+				ratio(t.failedElections[p], games), ratio(t.seconds[p], games) / 60, t.botGames[p]);
+	}
+
+	// sums every player count into row 0 of a copy, for the "all" row
+	Totals overall(const Totals &t) {
+		Totals all;
+		for (int p = FIVE; p < COUNTS; p++) {
+			all.games[0] += t.games[p];
+			for (int e = 0; e < 4; e++) {
+				all.endings[0][e] += t.endings[p][e];
+			}
+			all.botGames[0] += t.botGames[p];
+			all.vetoGames[0] += t.vetoGames[p];
+			all.vetoesProposed[0] += t.vetoesProposed[p];
+			all.vetoesAccepted[0] += t.vetoesAccepted[p];
+			all.trackerResets[0] += t.trackerResets[p];
+			all.failedElections[0] += t.failedElections[p];
+			all.seconds[0] += t.seconds[p];
+		}
+		return all;
+	}
+}
+
+int main(int argc, char **argv) {
+	using namespace std::chrono;
+	unsigned threads = std::max(std::thread::hardware_concurrency(), 1U);
+	int first = 1;
+	if (argc > 2 && std::strcmp(argv[1], "-j") == 0) {
+		threads = std::max(std::atoi(argv[2]), 1);
+		first = 3;
+	}
+	if (first >= argc) {
+		fmt::print(stderr, "usage: {} [-j threads] file...\n", argv[0]);
+		return 1;
+	}
+
+	auto start = steady_clock::now();
+	std::vector<Mapping> mappings(argc - first);
+	std::vector<Block> blocks;
+	bool ok = true;
+	for (int i = first; i < argc; i++) {
+		ok &= map(argv[i], mappings[i - first], blocks);
+	}
+
+	std::vector<Totals> totals(threads);
+	std::atomic<size_t> next{0};
+	std::vector<std::thread> workers;
+	for (unsigned t = 0; t < threads; t++) {
+		workers.emplace_back([&, t] {
+			auto columns = std::make_unique<Columns>();
+			for (size_t b; (b = next++) < blocks.size();) {
+				columns->decode(blocks[b].records, blocks[b].count);
+				columns->sum(blocks[b].count, totals[t]);
+			}
+		});
+	}
+	for (auto &w : workers) {
+		w.join();
+	}
+	for (unsigned t = 1; t < threads; t++) {
+		totals[0].add(totals[t]);
+	}
+	auto &result = totals[0];
+
+	fmt::print("players,games,liberal_policy_wins,liberal_hitler_wins,fascist_policy_wins,fascist_hitler_wins,"
+			"fascist_win_rate,veto_games,veto_game_rate,vetoes_proposed,vetoes_accepted,tracker_resets_per_game,"
+			"failed_elections_per_game,mean_minutes,bot_games\n");
+	for (int p = FIVE; p < COUNTS; p++) {
+		if (result.games[p]) {
+			printRow(std::to_string(p).c_str(), result, p);
+		}
+	}
+	printRow("all", overall(result), 0);
+
+	uint64_t records = 0;
+	for (int p = 0; p < COUNTS; p++) {
+		records += result.games[p];
+	}
+	size_t bytes = 0;
+	for (auto &m : mappings) {
+		bytes += m.size;
+		if (m.data != MAP_FAILED) {
+			munmap(m.data, m.size);
+		}
+	}
+	auto seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+	fmt::print(stderr, "{} records ({} invalid) from {} files, {:.1f} MB in {:.2f} s on {} threads ({:.0f}M records/s)\n",
+			records, result.games[0], mappings.size(), bytes / 1e6, seconds, threads, records / seconds / 1e6);
+	return ok ? 0 : 2;
+}
@@ -0,0 +1,344 @@
+/** Explores every position reachable from a seeded game, and solves it for random play
+ *
+ * usage: explorer [players] [first seed] [seeds] [threads]
+ *
+ * From init(seed), every legal input is tried in every position: each eligible nomination, each policy
+ * choice, each target of a power, and the veto. Votes are taken as a whole, with a ballot passing as
+ * often as it would if every living player voted ja or nein at random. Positions are memoized in a
+ * transposition table shared by all threads, which walk the tree in different orders so they split the
+ * work between them. A thread that reaches a position another thread is solving leaves it for last, and
+ * then waits for it rather than solving it again.
+ *
+ * The explorer reports any non-final position with no legal input, any line of play longer than
+ * MAX_DEPTH or that comes back to a position it passed through, and the chance of each ending and of each
+ * seat winning when every input is picked uniformly at random.
+ */
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#include "../gameState.h"
+#include "transpositionTable.h"
+
+namespace {
+	using Game = GameState;
+
+	// the chance of each ending, in the order of the final states
+	struct Outcome {
+		std::array<double, 4> p{};
+
+		void add(const Outcome &o, double weight) {
+			for (size_t i = 0; i < p.size(); i++) {
+				p[i] += weight * o.p[i];
+			}
+		}
+
+		double liberalWin() const {
+			return p[0] + p[1];
+		}
+	};
+
+	struct Entry {
+		enum Status {
+			EMPTY,
+			DONE,
+			// COMPUTING + n is being solved by thread n
+			COMPUTING,
+		};
+		std::atomic<unsigned> status{EMPTY};
+		Outcome outcome;
+	};
+
+	struct PositionHash {
+		size_t operator()(const Game &g) const {
+			return g.positionHash();
+		}
+	};
+
+	struct SamePosition {
+		bool operator()(const Game &a, const Game &b) const {
+			return a.samePosition(b);
+		}
+	};
+
+	struct Move {
+		Game game;
+		double weight;
+	};
+
+	class Explorer {
+		// far longer than any game, which enacts a policy at least every few moves
+		static constexpr int MAX_DEPTH = 1000;
+		// how long a thread waits on a position another thread is solving before it helps instead
+		static constexpr auto MAX_WAIT = std::chrono::seconds(1);
+
+		// what to do on reaching a position another thread is solving
+		enum Busy {
+			DEFER,
+			WAIT,
+			HELP,
+		};
+
+		TranspositionTable<Game, Entry, PositionHash, SamePosition> table;
+		std::atomic<size_t> deadlocks{0};
+		std::atomic<size_t> loops{0};
+		std::atomic<size_t> expansions{0};
+		std::mutex reportMutex;
+
+		// the chance that more than half of `voters` random ballots are ja
+		static double passChance(int voters) {
+			double pass = 0;
+			double ways = 1;
+			for (int ja = 0; ja <= voters; ja++) {
+				if (2 * ja > voters) {
+					pass += ways;
+				}
+				ways = ways * (voters - ja) / (ja + 1);
+			}
+			return pass / std::pow(2.0, voters);
+		}
+
+		template <typename F>
+		static void forEachPlayer(const PlayerMask &mask, int players, F f) {
+			for (int i = 0; i < players; i++) {
+				if (mask[i]) {
+					f(i);
+				}
+			}
+		}
+
+		static std::vector<Move> moves(const Game &g, int players) {
+			std::vector<Move> result;
+			auto uniform = [&result, &g](auto apply, int count) {
+				for (int i = 0; i < count; i++) {
+					result.push_back({ g, 0 });
+					apply(result.back().game, i);
+				}
+				for (auto &m : result) {
+					m.weight = 1.0 / result.size();
+				}
+			};
+			switch (g.getState()) {
+				case Game::AWAITING_CHANCELLOR_NOMINATION:
+					forEachPlayer(g.getEligibleChancellors(), players, [&](int i) {
+						result.push_back({ g, 0 });
+						result.back().game.nominateChancellor(i);
+					});
+					break;
+				case Game::VOTING: {
+					int voters = g.alive().count();
+					double pass = passChance(voters);
+					result.push_back({ g, pass });
+					result.push_back({ g, 1 - pass });
+					for (int i = 0; i < players; i++) {
+						result[0].game.addVote(i, JA);
+						result[1].game.addVote(i, NEIN);
+					}
+					return result;
+				}
+				case Game::AWAITING_PRESIDENT_POLICY:
+					uniform([](Game &next, int i) { next.removePresidentPolicy(static_cast<Game::PolicyChoice>(i)); }, 3);
+					return result;
+				case Game::AWAITING_CHANCELLOR_POLICY:
+					uniform([](Game &next, int i) { next.removeChancellorPolicy(static_cast<Game::PolicyChoice>(i)); },
+							g.getFascistPolicies() == 5 ? 3 : 2);
+					return result;
+				case Game::AWAITING_CHANCELLOR_POLICY_NO_VETO:
+					uniform([](Game &next, int i) { next.removeChancellorPolicy(static_cast<Game::PolicyChoice>(i)); }, 2);
+					return result;
+				case Game::AWAITING_VETO:
+					uniform([](Game &next, int i) { next.presidentVeto(i); }, 2);
+					return result;
+				case Game::AWAITING_ALLEGIENCE_PEEK_CHOICE:
+					forEachPlayer(g.eligibleForInvestigation(), players, [&](int i) {
+						result.push_back({ g, 0 });
+						result.back().game.revealLoyalty(i);
+					});
+					break;
+				case Game::AWAITING_SPECIAL_PRESIDENT_CHOICE:
+				case Game::AWAITING_KILL_CHOICE: {
+					auto targets = g.alive();
+					targets[g.getPresidentId()] = false;
+					forEachPlayer(targets, players, [&](int i) {
+						result.push_back({ g, 0 });
+						if (g.getState() == Game::AWAITING_KILL_CHOICE) {
+							result.back().game.killPlayer(i);
+						} else {
+							result.back().game.useSpecialPresident(i);
+						}
+					});
+					break;
+				}
+				default:
+					break;
+			}
+			for (auto &m : result) {
+				m.weight = 1.0 / result.size();
+			}
+			return result;
+		}
+
+		void reportDeadlock(const Game &g) {
+			if (deadlocks.fetch_add(1) > 0) {
+				return;
+			}
+			report("deadlock", g);
+		}
+
+		void reportLoop(const Game &g) {
+			if (loops.fetch_add(1) > 0) {
+				return;
+			}
+			report("loop", g);
+		}
+
+		void report(const char *what, const Game &g) {
+			std::lock_guard lock(reportMutex);
+			fmt::print("{}: state {}, president {}, chancellor {}, policies {}/{}, alive {}\n", what, int(g.getState()),
+					g.getPresidentId(), g.getChancellorId(), g.getLiberalPolicies(), g.getFascistPolicies(),
+					g.alive().to_string());
+		}
+
+		// solves `g` into `outcome`, or returns false if another thread is solving it and `busy` is DEFER
+		bool solve(const Game &g, int players, unsigned order, int depth, Busy busy, Outcome &outcome) {
+			if (g.getState() >= Game::LIBERAL_POLICY_WIN) {
+				outcome.p[g.getState() - Game::LIBERAL_POLICY_WIN] = 1;
+				return true;
+			}
+			if (depth > MAX_DEPTH) {
+				reportLoop(g);
+				return true;
+			}
+			auto *entry = table.insert(g).first;
+			unsigned mine = Entry::COMPUTING + order;
+			unsigned status = Entry::EMPTY;
+			bool claimed = entry->status.compare_exchange_strong(status, mine, std::memory_order_acquire);
+			if (!claimed) {
+				if (status == mine) {
+					reportLoop(g);
+					return true;
+				}
+				if (status != Entry::DONE && busy == DEFER) {
+					return false;
+				}
+				if (busy == WAIT) {
+					auto giveUp = std::chrono::steady_clock::now() + MAX_WAIT;
+					while (status != Entry::DONE && std::chrono::steady_clock::now() < giveUp) {
+						std::this_thread::yield();
+						status = entry->status.load(std::memory_order_acquire);
+					}
+				}
+				if (status == Entry::DONE) {
+					outcome = entry->outcome;
+					return true;
+				}
+			}
+
+			auto next = moves(g, players);
+			expansions.fetch_add(1, std::memory_order_relaxed);
+			if (next.empty()) {
+				reportDeadlock(g);
+			}
+			// each thread starts from a different child, so they fan out over the tree
+			std::vector<const Move *> deferred;
+			for (size_t i = 0; i < next.size(); i++) {
+				auto &m = next[(i + order) % next.size()];
+				Outcome child;
+				if (solve(m.game, players, order, depth + 1, DEFER, child)) {
+					outcome.add(child, m.weight);
+				} else {
+					deferred.push_back(&m);
+				}
+			}
+			for (auto *m : deferred) {
+				Outcome child;
+				solve(m->game, players, order, depth + 1, WAIT, child);
+				outcome.add(child, m->weight);
+			}
+			if (claimed) {
+				entry->outcome = outcome;
+				entry->status.store(Entry::DONE, std::memory_order_release);
+			}
+			return true;
+		}
+
+	public:
+		// every thread starts at the root, which none of them waits on, so they split it between them
+		Outcome evaluate(const Game &g, int players, unsigned order) {
+			Outcome outcome;
+			solve(g, players, order, 0, HELP, outcome);
+			return outcome;
+		}
+
+		size_t positions() const {
+			return table.size();
+		}
+
+		size_t deadlockCount() const {
+			return deadlocks.load();
+		}
+
+		size_t loopCount() const {
+			return loops.load();
+		}
+
+		size_t expansionCount() const {
+			return expansions.load();
+		}
+	};
+}
+
+int main(int argc, char **argv) {
+	using namespace std::chrono;
+	int players = argc > 1 ? std::atoi(argv[1]) : 5;
+	unsigned firstSeed = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1;
+	unsigned seeds = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1;
+	unsigned threads = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : std::thread::hardware_concurrency();
+	if (players < FIVE || players > MAX_PLAYERS) {
+		fmt::print("players must be between {} and {}\n", int(FIVE), MAX_PLAYERS);
+		return 1;
+	}
+	threads = std::max(threads, 1U);
+
+	Explorer explorer;
+	Outcome total;
+	std::vector<double> seatWins(players);
+	auto start = steady_clock::now();
+	for (unsigned seed = firstSeed; seed < firstSeed + seeds; seed++) {
+		Game root;
+		root.init(seed, players);
+		root.start();
+
+		std::vector<Outcome> results(threads);
+		std::vector<std::thread> workers;
+		for (unsigned t = 0; t < threads; t++) {
+			workers.emplace_back([&, t] { results[t] = explorer.evaluate(root, players, t); });
+		}
+		for (auto &w : workers) {
+			w.join();
+		}
+		auto &outcome = results[0];
+		total.add(outcome, 1.0 / seeds);
+		auto liberals = root.getTeams();
+		for (int i = 0; i < players; i++) {
+			seatWins[i] += (liberals[i] ? outcome.liberalWin() : 1 - outcome.liberalWin()) / seeds;
+		}
+	}
+	auto seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+
+	fmt::print("{} players, seeds {}-{}, {} threads\n", players, firstSeed, firstSeed + seeds - 1, threads);
+	fmt::print("{} positions in {:.2f} s ({:.0f} per second), {} expanded, {} deadlocks, {} loops\n\n",
+			explorer.positions(), seconds, explorer.positions() / seconds, explorer.expansionCount(),
+			explorer.deadlockCount(), explorer.loopCount());
+	fmt::print("liberal policy win  {:.4f}\nliberal hitler win  {:.4f}\nfascist policy win  {:.4f}\nfascist hitler win  {:.4f}\n\n",
+			total.p[0], total.p[1], total.p[2], total.p[3]);
+	for (int i = 0; i < players; i++) {
+		fmt::print("seat {:>2} wins {:.4f}\n", i, seatWins[i]);
+	}
+	return explorer.deadlockCount() || explorer.loopCount() ? 2 : 0;
+}
@@ -0,0 +1,44 @@
+#ifndef SERVER_TOOLS_TRANSPOSITION_TABLE_H
+#define SERVER_TOOLS_TRANSPOSITION_TABLE_H
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+/** A hash map that many threads can insert into at once
+ *
+ * Keys are spread over SHARDS independently locked maps by their hash, so threads only contend when
+ * they land in the same shard. Values never move once inserted, so the returned pointers stay valid
+ * for the life of the table; synchronizing access to a value is up to the caller.
+ */
+template <typename Key, typename Value, typename Hash, typename Equal>
+class TranspositionTable {
+	static constexpr size_t SHARDS = 256;
+
+	struct alignas(64) Shard {
+		std::mutex mutex;
+		std::unordered_map<Key, Value, Hash, Equal> map;
+	};
+
+	std::array<Shard, SHARDS> shards;
+	std::atomic<size_t> count{0};
+
+public:
+	// returns the value for `key`, default constructing it if the key is new, and whether it was new
+	std::pair<Value *, bool> insert(const Key &key) {
+		auto h = Hash()(key);
+		auto &shard = shards[(h >> 32 ^ h) % SHARDS];
+		std::lock_guard lock(shard.mutex);
+		auto [it, inserted] = shard.map.try_emplace(key);
+		if (inserted) {
+			count.fetch_add(1, std::memory_order_relaxed);
+		}
+		return { &it->second, inserted };
+	}
+
+	size_t size() const {
+		return count.load(std::memory_order_relaxed);
+	}
+};
+
+#endif //SERVER_TOOLS_TRANSPOSITION_TABLE_H
@@ -0,0 +1,191 @@
+#ifndef SERVER_TRACE_H
+#define SERVER_TRACE_H
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <ctime>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fmt/format.h>
+#ifdef SH_TRACE_RDTSC
+#include <x86intrin.h>
+#endif
+
+/** Sampled latency tracing of inbound messages
+ *
+ * One in every `sampleRate` inbound messages is given a trace id. While it is being handled, every
+ * interesting point (receive, dispatch, game transition, each send) is timestamped into a per-thread
+ * ring buffer. Messages that were queued by backpressure keep their trace id, so the send that
+ * eventually drains them is attributed to the message that produced them.
+ *
+ * Rings are single-producer: only the owning thread writes, and old events are overwritten once a ring
+ * wraps. A reader on any thread copies a ring out and then checks how far the writer had got, dropping
+ * any event that may have been overwritten while it was being copied.
+ */
+namespace trace {
+	enum Point : uint8_t {
+		RECEIVE = 0,
+		DISPATCH,
+		TRANSITION,
+		SEND,
+		SEND_DRAINED,
+	};
+
+	struct Event {
+		uint64_t time;
+		uint32_t traceId;
+		uint8_t point;
+		uint8_t code;
+		int8_t player;
+	};
+
+	class Ring {
+		static constexpr unsigned SIZE = 1U << 16;
+		// each event is packed into two words so the reader's copy races only on atomics
+		struct Slot {
+			std::atomic<uint64_t> time;
+			std::atomic<uint64_t> rest;
+		};
+		std::array<Slot, SIZE> slots;
+		// events before `head` are complete, and the writer may be past `head` up to `writing`
+		std::atomic<uint64_t> head{0};
+		std::atomic<uint64_t> writing{0};
+
+		static uint64_t pack(const Event &e) {
+			return e.traceId | uint64_t(e.point) << 32 | uint64_t(e.code) << 40 | uint64_t(uint8_t(e.player)) << 48;
+		}
+
+		static Event unpack(uint64_t time, uint64_t rest) {
+			return {time, uint32_t(rest), uint8_t(rest >> 32), uint8_t(rest >> 40), int8_t(uint8_t(rest >> 48))};
+		}
+
+	public:
+		void push(const Event &e) {
+			auto i = head.load(std::memory_order_relaxed);
+			writing.store(i + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			auto &slot = slots[i % SIZE];
+			slot.time.store(e.time, std::memory_order_relaxed);
+			slot.rest.store(pack(e), std::memory_order_relaxed);
+			head.store(i + 1, std::memory_order_release);
+		}
+
+		// the events that were whole both before and after they were copied, oldest first
+		std::vector<Event> snapshot() const {
+			auto end = head.load(std::memory_order_acquire);
+			auto begin = end > SIZE ? end - SIZE : 0;
+			std::vector<Event> copy;
+			copy.reserve(end - begin);
+			for (auto i = begin; i < end; i++) {
+				auto &slot = slots[i % SIZE];
+				copy.push_back(unpack(slot.time.load(std::memory_order_relaxed), slot.rest.load(std::memory_order_relaxed)));
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			auto written = writing.load(std::memory_order_relaxed);
+			// event i shares its slot with event i + SIZE, which the writer may have started on
+			auto overwritten = written > SIZE + begin ? written - SIZE - begin : 0;
+			copy.erase(copy.begin(), copy.begin() + std::min<uint64_t>(overwritten, copy.size()));
+			return copy;
+		}
+	};
+
+	namespace detail {
+		inline unsigned sampleRate = 0;
+		inline double ticksPerMicrosecond = 1000;
+		inline std::atomic<uint32_t> nextId{1};
+		inline thread_local unsigned counter = 0;
+		inline thread_local uint32_t current = 0;
+
+		inline std::mutex registryMutex;
+		inline std::vector<Ring *> registry;
+
+		inline Ring *registerThread() {
+			auto *ring = new Ring;
+			std::lock_guard lock(registryMutex);
+			registry.push_back(ring);
+			return ring;
+		}
+
+		inline Ring &local() {
+			thread_local Ring *ring = registerThread();
+			return *ring;
+		}
+
+		inline uint64_t monotonicNanoseconds() {
+			timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+		}
+	}
+
+	inline uint64_t now() {
+#ifdef SH_TRACE_RDTSC
+		return __rdtsc();
+#else
+		return detail::monotonicNanoseconds();
+#endif
+	}
+
+	/** Turns tracing on for one in every `rate` messages, or off if `rate` is 0 */
+	inline void configure(unsigned rate) {
+		detail::sampleRate = rate;
+#ifdef SH_TRACE_RDTSC
+		auto t0 = detail::monotonicNanoseconds();
+		auto c0 = __rdtsc();
+		while (detail::monotonicNanoseconds() - t0 < 10000000) {}
+		detail::ticksPerMicrosecond = (__rdtsc() - c0) / ((detail::monotonicNanoseconds() - t0) / 1000.0);
+#endif
+	}
+
+	inline uint32_t current() {
+		return detail::current;
+	}
+
+	/** Decides whether the message about to be handled is sampled */
+	inline void begin() {
+		if (detail::sampleRate && ++detail::counter % detail::sampleRate == 0) {
+			detail::current = detail::nextId.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	inline void end() {
+		detail::current = 0;
+	}
+
+	inline void record(uint32_t traceId, Point point, unsigned code, int player = -1) {
+		if (traceId) {
+			detail::local().push({ now(), traceId, point, static_cast<uint8_t>(code), static_cast<int8_t>(player) });
+		}
+	}
+
+	inline void record(Point point, unsigned code, int player = -1) {
+		record(detail::current, point, code, player);
+	}
+
+	/** Renders every buffered event in the Chrome trace event format, with one row per traced message */
+	inline std::string renderChromeTrace() {
+		constexpr std::array<const char *, 5> pointNames = {
+			"receive", "dispatch", "transition", "send", "send (drained)"
+		};
+		std::lock_guard lock(detail::registryMutex);
+		std::string out = "{\"traceEvents\":[";
+		auto it = std::back_inserter(out);
+		bool first = true;
+		for (auto *ring : detail::registry) {
+			for (auto &e : ring->snapshot()) {
+				fmt::format_to(it, "{}{{\"name\":\"{}\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},"
+						"\"args\":{{\"code\":{},\"player\":{}}}}}",
+						first ? "" : ",", pointNames[e.point], e.traceId, e.time / detail::ticksPerMicrosecond,
+						e.code, e.player);
+				first = false;
+			}
+		}
+		out += "]}";
+		return out;
+	}
+}
+
+#endif //SERVER_TRACE_H
@@ -0,0 +1,130 @@
+#ifndef SERVER_WORK_POOL_H
+#define SERVER_WORK_POOL_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Threads for CPU heavy work that must stay off the event loop
+ *
+ * Every worker has its own deque of tasks. A task submitted by a worker goes on the back of that worker's
+ * deque, and workers take from their own back, so a batch tends to stay on the core that made it. A worker
+ * with nothing left steals from the front of the others. Tasks submitted from other threads are dealt out
+ * round robin. Results go back to the loop by the task itself, usually through uWS::Loop::defer.
+ *
+ * Destroying the pool runs every task still queued, then joins the workers.
+ */
+class WorkPool {
+public:
+	using Task = std::function<void()>;
+
+private:
+	struct alignas(64) Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::unique_ptr<Queue[]> queues;
+	unsigned count;
+	std::vector<std::thread> threads;
+	std::atomic<unsigned> nextQueue{0};
+
+	// workers sleep on this while every deque is empty
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::atomic<long> queued{0};
+	bool stopping = false;
+
+	// the pool and index of the worker on this thread, if any
+	static inline thread_local WorkPool *currentPool = nullptr;
+	static inline thread_local unsigned currentIndex = 0;
+
+	bool take(unsigned self, Task &task) {
+		{
+			auto &own = queues[self];
+			std::lock_guard lock(own.mutex);
+			if (!own.tasks.empty()) {
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				queued--;
+				return true;
+			}
+		}
+		for (unsigned i = 1; i < count; i++) {
+			auto &victim = queues[(self + i) % count];
+			std::lock_guard lock(victim.mutex);
+			if (!victim.tasks.empty()) {
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				queued--;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void work(unsigned self) {
+		currentPool = this;
+		currentIndex = self;
+		Task task;
+		while (true) {
+			if (take(self, task)) {
+				task();
+				task = nullptr;
+				continue;
+			}
+			std::unique_lock lock(sleepMutex);
+			wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+			if (stopping && queued.load() <= 0) {
+				return;
+			}
+		}
+	}
+
+public:
+	explicit WorkPool(unsigned threadCount) : queues(new Queue[std::max(threadCount, 1U)]),
+			count(std::max(threadCount, 1U)) {
+		for (unsigned i = 0; i < count; i++) {
+			threads.emplace_back([this, i] { work(i); });
+		}
+	}
+
+	WorkPool(const WorkPool &) = delete;
+	WorkPool &operator=(const WorkPool &) = delete;
+
+	~WorkPool() {
+		{
+			std::lock_guard lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto &t : threads) {
+			t.join();
+		}
+	}
+
+	void submit(Task task) {
+		unsigned i = currentPool == this ? currentIndex : nextQueue++ % count;
+		{
+			std::lock_guard lock(queues[i].mutex);
+			queues[i].tasks.push_back(std::move(task));
+		}
+		{
+			// counted under the sleep lock, so a worker can't miss the wakeup between checking and waiting
+			std::lock_guard lock(sleepMutex);
+			queued++;
+		}
+		wake.notify_one();
+	}
+
+	unsigned size() const {
+		return count;
+	}
+};
+
+#endif //SERVER_WORK_POOL_H
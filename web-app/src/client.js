@@ -13,6 +13,8 @@ function encodeKey(key) {
 	return s;
 }
 
+const MAX_NAME_SIZE = 32;
+
 const ClientMessageCode = {
 	NOMINATE_CHANCELLOR: 0,
 	ELIMINATE_POLICY: 1,
@@ -98,8 +100,20 @@ export class Client {
 		this.ws.send(msg);
 	}
 
+	// servers built for more than 10 players send masks as 16 bits after the first byte
+	isWide(arr) {
+		return arr.length === 3;
+	}
+
 	getFlags(arr) {
 		const flags = [];
+		if (this.isWide(arr)) {
+			const mask = (arr[1] << 8) | arr[2];
+			for (let i = 0; i < this.players.length; i++) {
+				flags[i] = !!(mask & (1 << i));
+			}
+			return flags;
+		}
 		flags[0] = !!((arr[0] >> 6) & 1);
 		flags[1] = !!((arr[0] >> 7) & 1);
 		for (let i = 0; i < this.players.length - 2; i++) {
@@ -267,7 +281,7 @@ export class Client {
 				player: this.players[i],
 				role: flag ? 'liberal' : 'fascist',
 			}));
-			let hitlerOffset = (arr[0] >> 4) & 3;
+			let hitlerOffset = (arr[0] >> 4) & (this.isWide(arr) ? 7 : 3);
 			for (let i = 0; i < roles.length; i++) {
 				if (roles[i].role === 'fascist') {
 					hitlerOffset--;
@@ -299,6 +313,19 @@ export class Client {
 		this.publishEvent('rename', { oldName, newName });
 	}
 
+	// the first frame is our id, followed by a name record for each connected player
+	roster(arr) {
+		let i = 1;
+		while (i + 1 < arr.length) {
+			const length = arr[i + 1];
+			const record = new Uint8Array(length + 1);
+			record[0] = arr[i];
+			record.set(arr.slice(i + 2, i + 2 + length), 1);
+			this.changeName(record);
+			i += 2 + length;
+		}
+	}
+
 	death(arr) {
 		const i = arr[0] >> 4;
 		const player = this.players[i];
@@ -473,10 +500,30 @@ export class Client {
 				this.ws.binaryType = 'arraybuffer';
 				this.ws.onerror = e => console.log(e);
 				this.ws.onopen = e => console.log(e);
+				// somewhere else has the game: a worker's own port, or a node's host:port from a cluster's coordinator
+				this.ws.onclose = (e) => {
+					if (e.code === 4307) {
+						const next = new URL(url);
+						if (String(e.reason).includes(':')) {
+							next.host = e.reason;
+						} else {
+							next.port = e.reason;
+						}
+						resolve(this.connect(next.toString()));
+					}
+					// the server is shutting down and the game hadn't started; a new one reaches the server taking over
+					if (e.code === 4410) {
+						this.publishEvent('lobbyClosed', {});
+						if (/\/(create|quickplay)/.test(new URL(url).pathname)) {
+							resolve(this.connect(url));
+						}
+					}
+				};
 				this.ws.onmessage = (e) => {
 					const arr = new Uint8Array(e.data);
 					this.id = arr[0];
 					this.ws.onmessage = this.onmessage.bind(this);
+					this.roster(arr);
 					resolve(this);
 					this.publishEvent('connect');
 				};
@@ -596,6 +643,9 @@ export class Client {
 				throw new Error('Another player took that name.');
 			}
 		}
+		if (new TextEncoder().encode(name).length > MAX_NAME_SIZE) {
+			throw new Error('Names can be at most ' + MAX_NAME_SIZE + ' bytes.');
+		}
 		this.name = name;
 		this.players[this.id] = name;
 		this.sendName();
@@ -605,6 +655,11 @@ export class Client {
 		return this.connect(`ws://${this.domain}:${this.port}/create/`);
 	}
 
+	// nothing arrives until the server has matched us into a game; the roster comes first
+	quickplay() {
+		return this.connect(`ws://${this.domain}:${this.port}/quickplay`);
+	}
+
 	join(key) {
 		key = key.toLowerCase();
 		this.key = key;